@@ -0,0 +1,203 @@
+#include <ProgramGenerator.h>
+#include <algorithm>
+#include <cstdio>
+#include <string_view>
+
+namespace bench {
+
+// splitmix64, small and identical on every platform
+class Random {
+public:
+  explicit Random(uint64_t seed) : m_state(seed) {}
+
+  uint64_t next() {
+    uint64_t z = (m_state += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+  }
+  uint32_t below(uint32_t bound) {
+    return static_cast<uint32_t>(next() % bound);
+  }
+  template <size_t N>
+  std::string_view pick(const std::string_view (&items)[N]) {
+    return items[below(N)];
+  }
+
+private:
+  uint64_t m_state;
+};
+
+static constexpr size_t moduleStatements = 1024;
+static constexpr size_t labelEvery = 6;
+// At most 3 bytes per statement, so a module always fits its slot and the
+// first originSlots modules never overlap. Past those the 64KB are used again.
+static constexpr uint32_t originSlot = moduleStatements * 3;
+static constexpr uint32_t originSlots = 0x10000 / originSlot;
+
+static constexpr std::string_view registers[] = {"A", "B", "C", "D",
+                                                 "E", "H", "L", "M"};
+static constexpr std::string_view pairs[] = {"B", "D", "H", "SP"};
+static constexpr std::string_view stackPairs[] = {"B", "D", "H", "PSW"};
+static constexpr std::string_view registerOps[] = {"ADD", "ADC", "SUB", "SBB",
+                                                   "ANA", "XRA", "ORA", "CMP"};
+static constexpr std::string_view immediateOps[] = {"ADI", "ACI", "SUI",
+                                                    "ANI", "XRI", "ORI", "CPI"};
+static constexpr std::string_view branches[] = {
+    "JMP", "JC", "JNC", "JZ", "JNZ", "JP", "JM", "CALL", "CZ", "CNZ"};
+static constexpr std::string_view singles[] = {
+    "NOP", "RET", "RZ",  "RNZ", "RLC", "RRC", "RAL",
+    "RAR", "CMA", "CMC", "STC", "XCHG", "DAA", "EI"};
+static constexpr std::string_view comments[] = {
+    "; load the next value", "; loop counter", "; save flags",
+    "; restore pointer", "; check for zero", "; TODO: unroll"};
+
+// Letters only, since identifiers cannot contain digits
+static void appendLetters(std::string &out, size_t value) {
+  char letters[16];
+  size_t count = 0;
+  do {
+    letters[count++] = static_cast<char>('A' + value % 26);
+    value /= 26;
+  } while (value);
+  while (count)
+    out += letters[--count];
+}
+
+static void appendLabel(std::string &out, size_t module, size_t index) {
+  out += "L_";
+  appendLetters(out, module);
+  out += '_';
+  appendLetters(out, index);
+}
+
+// Numbers have no A-F digits in this assembler, so hex is only used when the
+// value happens to print without them
+static void appendNumber(std::string &out, uint32_t value, bool wide,
+                         Random &random) {
+  char text[8];
+  snprintf(text, sizeof(text), wide ? "%04X" : "%02X", value);
+  bool hexDigitsOnly =
+      std::none_of(text, text + (wide ? 4 : 2), [](char c) { return c > '9'; });
+  if (hexDigitsOnly && random.below(2)) {
+    out += text;
+    out += 'H';
+  } else {
+    out += std::to_string(value);
+  }
+}
+
+// A label has to be followed by an instruction, so labeled lines get no DB
+static void appendStatement(std::string &out, Random &random, size_t module,
+                            size_t labels, bool labeled) {
+  uint32_t kind = random.below(100);
+  if (kind < 20) {
+    // MOV M, M would be HLT
+    std::string_view to = random.pick(registers);
+    std::string_view from = random.pick(registers);
+    if (to == "M" && from == "M")
+      from = "A";
+    out += "MOV ";
+    out += to;
+    out += ", ";
+    out += from;
+  } else if (kind < 30) {
+    out += "MVI ";
+    out += random.pick(registers);
+    out += ", ";
+    appendNumber(out, random.below(256), false, random);
+  } else if (kind < 35) {
+    out += "LXI ";
+    out += random.pick(pairs);
+    out += ", ";
+    appendNumber(out, random.below(65536), true, random);
+  } else if (kind < 50) {
+    out += random.pick(registerOps);
+    out += ' ';
+    out += random.pick(registers);
+  } else if (kind < 57) {
+    out += random.pick(immediateOps);
+    out += ' ';
+    appendNumber(out, random.below(256), false, random);
+  } else if (kind < 67) {
+    static constexpr std::string_view counters[] = {"INR", "DCR"};
+    static constexpr std::string_view pairCounters[] = {"INX", "DCX", "DAD"};
+    if (random.below(2)) {
+      out += random.pick(counters);
+      out += ' ';
+      out += random.pick(registers);
+    } else {
+      out += random.pick(pairCounters);
+      out += ' ';
+      out += random.pick(pairs);
+    }
+  } else if (kind < 78) {
+    out += random.pick(branches);
+    out += ' ';
+    appendLabel(out, module, random.below(static_cast<uint32_t>(labels)));
+  } else if (kind < 84) {
+    out += random.below(2) ? "PUSH " : "POP ";
+    out += random.pick(stackPairs);
+  } else if (kind < 88) {
+    out += random.below(2) ? "LDA " : "STA ";
+    appendNumber(out, random.below(65536), true, random);
+  } else if (kind < 92 && !labeled) {
+    out += "DB ";
+    appendNumber(out, random.below(256), false, random);
+  } else {
+    out += random.pick(singles);
+  }
+}
+
+GeneratedProgram generateProgram(size_t targetBytes, uint64_t seed) {
+  GeneratedProgram program;
+  std::string &out = program.source;
+  out.reserve(targetBytes + 16 * 1024);
+  Random random(seed);
+
+  for (size_t module = 0; out.size() < targetBytes; ++module) {
+    // Small targets get a short last module instead of a whole one, the
+    // average statement takes about 14 bytes
+    size_t statements =
+        std::clamp<size_t>((targetBytes - out.size()) / 14 + 1, 1,
+                           moduleStatements);
+    size_t labels = (statements + labelEvery - 1) / labelEvery;
+
+    out += "ORG ";
+    appendNumber(out, (module % originSlots) * originSlot, true, random);
+    if (module >= originSlots)
+      ++program.overlapping;
+    out += '\n';
+    ++program.lines;
+
+    for (size_t i = 0; i < statements; ++i) {
+      uint32_t extra = random.below(32);
+      if (extra == 0) {
+        out += '\n';
+        ++program.lines;
+      } else if (extra == 1) {
+        out += random.pick(comments);
+        out += '\n';
+        ++program.lines;
+      }
+
+      bool labeled = i % labelEvery == 0;
+      if (labeled) {
+        appendLabel(out, module, i / labelEvery);
+        out += ": ";
+      } else {
+        out += "  ";
+      }
+      appendStatement(out, random, module, labels, labeled);
+      if (random.below(8) == 0) {
+        out += ' ';
+        out += random.pick(comments);
+      }
+      out += '\n';
+      ++program.lines;
+    }
+  }
+  return program;
+}
+
+} // namespace bench
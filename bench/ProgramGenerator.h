@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Seeded generator of valid 8085 sources for benchmarking.
+// The program is a sequence of modules of up to 1024 statements, each placed
+// by its own ORG so the code never leaves the 64KB address space. Statements
+// follow a fixed mix of data transfer, arithmetic, logic, branches, stack
+// operations and DB, with labels every few lines, branches to labels of the
+// same module (forward and backward), trailing and whole-line comments and
+// blank lines. The same seed and size always give the same text.
+//
+// Every module gets a 3KB slot of its own, which runs out after 21 modules
+// (about 300KB of source). Later modules are placed over earlier ones again,
+// each of them compiles with one warning that it overwrites earlier code.
+namespace bench {
+
+struct GeneratedProgram {
+  std::string source;
+  size_t lines = 0;
+  size_t overlapping = 0; // modules placed over earlier ones
+};
+
+// Stops at the first module boundary at or past targetBytes, so the result is
+// at most one module (about 16KB) larger than asked for
+GeneratedProgram generateProgram(size_t targetBytes, uint64_t seed);
+
+} // namespace bench
@@ -0,0 +1,226 @@
+// c85_bench.cpp : Throughput of the lexer, the parser and the whole compiler
+// on generated sources.
+//
+#include <Logger.h>
+#include <ProgramGenerator.h>
+#include <algorithm>
+#include <asm_driver.h>
+#include <asm_lexer.h>
+#include <asm_output.h>
+#include <asm_parser.h>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <functional>
+using namespace std;
+
+struct BenchOptions {
+  vector<size_t> sizes;
+  uint64_t seed = 1;
+  unsigned warmup = 2;
+  unsigned iterations = 10;
+  unsigned threads = 1;
+  bool lex = true;
+  bool parse = true;
+  bool compile = true;
+  string savePath;
+};
+
+struct Stats {
+  double min = 0;
+  double median = 0;
+  double mean = 0;
+  double stddev = 0;
+};
+
+static Stats summarize(vector<double> samples) {
+  Stats stats;
+  sort(samples.begin(), samples.end());
+  size_t n = samples.size();
+  stats.min = samples.front();
+  stats.median = n % 2 ? samples[n / 2]
+                       : (samples[n / 2 - 1] + samples[n / 2]) / 2;
+  for (double sample : samples)
+    stats.mean += sample;
+  stats.mean /= n;
+  for (double sample : samples)
+    stats.stddev += (sample - stats.mean) * (sample - stats.mean);
+  stats.stddev = n > 1 ? sqrt(stats.stddev / (n - 1)) : 0;
+  return stats;
+}
+
+// Runs setup untimed before every run of body, returns the timings of the
+// measured runs in seconds. Warm-up runs fault in the source and let the
+// allocators and arenas reach their steady state.
+static vector<double> measure(const BenchOptions &options,
+                              const function<void()> &setup,
+                              const function<void()> &body) {
+  vector<double> samples;
+  for (unsigned i = 0; i < options.warmup + options.iterations; ++i) {
+    setup();
+    auto start = chrono::steady_clock::now();
+    body();
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+    if (i >= options.warmup)
+      samples.push_back(elapsed.count());
+  }
+  return samples;
+}
+
+static void report(const char *phase, const Stats &stats, size_t bytes,
+                   size_t lines) {
+  Logger::fmtLog("%-8s %10.3f %10.3f %10.3f %9.3f %10.1f %10.2f", phase,
+                 stats.median * 1e3, stats.min * 1e3, stats.mean * 1e3,
+                 stats.stddev * 1e3, bytes / stats.median / 1e6,
+                 lines / stats.median / 1e6);
+}
+
+static bool runSize(size_t size, const BenchOptions &options) {
+  bench::GeneratedProgram program = bench::generateProgram(size, options.seed);
+  string_view source = program.source;
+  if (!options.savePath.empty() &&
+      !output::writeFile(options.savePath,
+                         vector<uint8_t>(source.begin(), source.end())))
+    return false;
+
+  Logger::fmtLog("\nsource: %zu bytes, %zu lines, seed %llu, %u runs after "
+                 "%u warm-up",
+                 source.size(), program.lines,
+                 static_cast<unsigned long long>(options.seed),
+                 options.iterations, options.warmup);
+  if (program.overlapping)
+    Logger::fmtLog("modules over earlier ones: %zu, one warning each",
+                   program.overlapping);
+  Logger::fmtLog("%-8s %10s %10s %10s %9s %10s %10s", "phase", "median ms",
+                 "min ms", "mean ms", "stddev", "MB/s", "Mlines/s");
+
+  // Kept alive across runs so the results cannot be optimized away
+  size_t sink = 0;
+  bool ok = true;
+
+  if (options.lex) {
+    vector<double> samples = measure(options, [] {}, [&] {
+      Lexer lexer(source);
+      sink += lexer.tokenize().size();
+    });
+    report("lex", summarize(move(samples)), source.size(), program.lines);
+  }
+
+  if (options.parse) {
+    Lexer lexer(source);
+    const vector<Token> tokens = lexer.tokenize();
+    vector<Token> input;
+    unique_ptr<ASTProgram> ast;
+    Diagnostics diagnostics(20);
+    vector<double> samples = measure(
+        options, [&] { input = tokens; },
+        [&] {
+          diagnostics.clear();
+          Parser parser(input, move(ast), &diagnostics);
+          ast = move(parser.parseProgram());
+          sink += ast->statements.size();
+        });
+    report("parse", summarize(move(samples)), source.size(), program.lines);
+    if (diagnostics.hasErrors()) {
+      diagnostics.print("<generated>");
+      ok = false;
+    }
+  }
+
+  if (options.compile) {
+    CompileOptions compileOptions;
+    compileOptions.threads = options.threads;
+    CompileWorkspace workspace;
+    CompileResult result;
+    vector<double> samples = measure(options, [] {}, [&] {
+      result = compileSource(source, compileOptions, &workspace);
+      sink += result.output.size();
+    });
+    report("compile", summarize(move(samples)), source.size(), program.lines);
+    if (!result.success) {
+      result.diagnostics.print("<generated>");
+      ok = false;
+    } else if (result.diagnostics.warningCount() != program.overlapping) {
+      result.diagnostics.print("<generated>");
+      ok = false;
+    }
+  }
+
+  if (!sink)
+    Logger::fmtLog(LogLevel::Warning, "Nothing was produced");
+  return ok;
+}
+
+// 64K, 16M, 1G or plain bytes
+static size_t parseSize(const string &text) {
+  char *end = nullptr;
+  double value = strtod(text.c_str(), &end);
+  switch (end ? *end : 0) {
+  case 'k':
+  case 'K':
+    value *= 1 << 10;
+    break;
+  case 'm':
+  case 'M':
+    value *= 1 << 20;
+    break;
+  case 'g':
+  case 'G':
+    value *= 1 << 30;
+    break;
+  }
+  return static_cast<size_t>(value);
+}
+
+static void printUsage() {
+  Logger::fmtLog(LogLevel::Info,
+                 "\n\tUsage: c85_bench [--size=<n>[K|M|G],...] [--seed=<n>] "
+                 "[--warmup=<n>] [--iterations=<n>]"
+                 "\n\t       [--phase=lex,parse,compile] [-j <threads>] "
+                 "[--save=<file>]");
+}
+
+int main(int argc, char *argv[]) {
+  BenchOptions options;
+  for (int i = 1; i < argc; ++i) {
+    string flag = argv[i];
+    if (flag.rfind("--size=", 0) == 0) {
+      size_t start = 7;
+      while (start <= flag.size()) {
+        size_t comma = min(flag.find(',', start), flag.size());
+        options.sizes.push_back(parseSize(flag.substr(start, comma - start)));
+        start = comma + 1;
+      }
+    } else if (flag.rfind("--seed=", 0) == 0)
+      options.seed = strtoull(flag.c_str() + 7, nullptr, 10);
+    else if (flag.rfind("--warmup=", 0) == 0)
+      options.warmup = static_cast<unsigned>(strtoul(flag.c_str() + 9, nullptr,
+                                                     10));
+    else if (flag.rfind("--iterations=", 0) == 0)
+      options.iterations = max(
+          1u, static_cast<unsigned>(strtoul(flag.c_str() + 13, nullptr, 10)));
+    else if (flag.rfind("--phase=", 0) == 0) {
+      string phases = ",";
+      phases += flag.substr(8);
+      phases += ',';
+      options.lex = phases.find(",lex,") != string::npos;
+      options.parse = phases.find(",parse,") != string::npos;
+      options.compile = phases.find(",compile,") != string::npos;
+    } else if (flag == "-j" && i + 1 < argc)
+      options.threads = static_cast<unsigned>(strtoul(argv[++i], nullptr, 10));
+    else if (flag.rfind("--save=", 0) == 0)
+      options.savePath = flag.substr(7);
+    else {
+      Logger::fmtLog(LogLevel::Error, "Unknown argument: %s", flag.c_str());
+      printUsage();
+      return 1;
+    }
+  }
+  if (options.sizes.empty())
+    options.sizes.push_back(16 << 20);
+
+  bool ok = true;
+  for (size_t size : options.sizes)
+    ok = runSize(size, options) && ok;
+  return ok ? 0 : 1;
+}
@@ -1,11 +1,13 @@
 #pragma once
+#include <Arena.h>
 #include <asm_lexer.h>
 #include <memory>
 #include <variant>
 #include <vector>
 
 namespace ast {
-template <typename T> using Ptr = std::unique_ptr<T>;
+// Nodes are owned by the Arena of their ASTProgram, never delete them
+template <typename T> using Ptr = T *;
 
 using InstuctionType = TokenType;
 using DirectiveType = TokenType;
@@ -13,6 +15,7 @@ using DirectiveType = TokenType;
 // Symbol debug info struct
 struct symbolDebugInfo {
   int lineNumber;
+  int column;
   uint16_t address; // will be filled in generator stage
 };
 
@@ -48,7 +51,8 @@ struct ASTLabelRef {
       printf("  ");
 
     // Print node type and label
-    printf("[ASTLabelRef]: %s\n", label.rawText.c_str());
+    printf("[ASTLabelRef]: %.*s\n",
+           (int)label.rawText.size(), label.rawText.data());
   }
 };
 
@@ -64,7 +68,9 @@ struct ASTExtendedRegister {
       printf("  ");
 
     // Print node type and label
-    printf("[ASTExtendedRegister]: %s\n", tokenSpRegister.rawText.c_str());
+    printf("[ASTExtendedRegister]: %.*s\n",
+           (int)tokenSpRegister.rawText.size(),
+           tokenSpRegister.rawText.data());
   }
 };
 
@@ -80,7 +86,9 @@ struct ASTRegister {
       printf("  ");
 
     // Print node type and label
-    printf("[ASTRegister]: %s\n", tokenRegister.rawText.c_str());
+    printf("[ASTRegister]: %.*s\n",
+           (int)tokenRegister.rawText.size(),
+           tokenRegister.rawText.data());
   }
 };
 
@@ -175,7 +183,9 @@ struct ASTDirective {
       printf("  ");
 
     // Print node type
-    printf("[ASTDirective] %s:\n", tokenDirective.rawText.c_str());
+    printf("[ASTDirective] %.*s:\n",
+           (int)tokenDirective.rawText.size(),
+           tokenDirective.rawText.data());
 
     // Print child paramaters
     std::visit(
@@ -202,7 +212,9 @@ struct ASTMnemonics {
       printf("  ");
 
     // Print node type
-    printf("[ASTMnemonics] %s:\n", tokenMnemonic.rawText.c_str());
+    printf("[ASTMnemonics] %.*s:\n",
+           (int)tokenMnemonic.rawText.size(),
+           tokenMnemonic.rawText.data());
 
     // Print child operand list if avail
     if (operandList)
@@ -224,9 +236,9 @@ struct ASTLabelDef {
       printf("  ");
 
     // Print node type
-    printf("[ASTLabelDef] %s: {Line: %d, Address: 0x%04X}\n",
-           tokenLabel.rawText.c_str(), labelDbgInfo.lineNumber,
-           labelDbgInfo.address);
+    printf("[ASTLabelDef] %.*s: {Line: %d, Address: 0x%04X}\n",
+           (int)tokenLabel.rawText.size(), tokenLabel.rawText.data(),
+           labelDbgInfo.lineNumber, labelDbgInfo.address);
     // Print mnemonics associated with the label
     if (mnemonic)
       mnemonic->Print(h + 1);
@@ -266,8 +278,21 @@ struct ASTStatement {
 };
 
 struct ASTProgram {
+  // Owns every node reachable from statements, freed in one shot
+  Arena arena;
+  // One arena per chunk of a parallel parse, see parseParallel()
+  vector<Arena> chunkArenas;
   vector<ASTStatement> statements;
 
+  // Drops all statements and rewinds the arenas but keeps their memory, so
+  // the program can be reused for the next compilation
+  void reset() {
+    statements.clear();
+    arena.reset();
+    for (Arena &chunkArena : chunkArenas)
+      chunkArena.reset();
+  }
+
   void Print() {
     // Print ASTProgram header
     printf("The AST Tree contents are dumped below:\n");
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Bump allocator for AST nodes.
+// Objects are carved out of large blocks and are never freed one by one, the
+// whole arena is released (or rewound for reuse) at once. Destructors are not
+// run, so only trivially destructible types may be allocated here.
+class Arena {
+public:
+  explicit Arena(size_t blockSize = 64 * 1024);
+
+  Arena(const Arena &) = delete;
+  Arena &operator=(const Arena &) = delete;
+  Arena(Arena &&other) noexcept;
+  Arena &operator=(Arena &&other) noexcept;
+
+  template <typename T, typename... Args> T *make(Args &&...args) {
+    static_assert(std::is_trivially_destructible_v<T>,
+                  "Arena never runs destructors");
+    void *mem = allocate(sizeof(T), alignof(T));
+    return new (mem) T(std::forward<Args>(args)...);
+  }
+
+  void *allocate(size_t size, size_t align);
+
+  // Forgets every allocation but keeps the blocks for the next compilation
+  void reset();
+
+  size_t bytesAllocated() const;
+  size_t bytesReserved() const;
+
+private:
+  struct Block {
+    std::unique_ptr<std::byte[]> data;
+    size_t size;
+  };
+
+  void nextBlock(size_t minSize);
+
+  std::vector<Block> m_blocks;
+  size_t m_current = 0; // block currently being filled
+  std::byte *m_ptr = nullptr;
+  std::byte *m_end = nullptr;
+  size_t m_blockSize;
+  size_t m_allocated = 0;
+};
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <vector>
+
+// Builds and takes apart the binary messages and cache entries c85 stores or
+// sends. Integers are written in host byte order, strings and blobs as a
+// 32-bit length followed by the bytes.
+class ByteWriter {
+public:
+  ByteWriter() { m_data.reserve(256); }
+
+  void u8(uint8_t value) { m_data.push_back(value); }
+  void u32(uint32_t value) { bytes(&value, sizeof(value)); }
+  void u64(uint64_t value) { bytes(&value, sizeof(value)); }
+  void i32(int32_t value) { bytes(&value, sizeof(value)); }
+  void text(std::string_view value) {
+    u32(static_cast<uint32_t>(value.size()));
+    bytes(value.data(), value.size());
+  }
+  void bytes(const void *data, size_t size) {
+    if (!size)
+      return;
+    size_t offset = m_data.size();
+    m_data.resize(offset + size);
+    memcpy(m_data.data() + offset, data, size);
+  }
+  const std::vector<uint8_t> &data() const { return m_data; }
+
+private:
+  std::vector<uint8_t> m_data;
+};
+
+// Reads past the end return zeroes and clear ok(), so a caller can read a
+// whole record and check once at the end
+class ByteReader {
+public:
+  explicit ByteReader(const std::vector<uint8_t> &data) : m_data(data) {}
+
+  uint8_t u8() { return read<uint8_t>(); }
+  uint32_t u32() { return read<uint32_t>(); }
+  uint64_t u64() { return read<uint64_t>(); }
+  int32_t i32() { return read<int32_t>(); }
+  // Points into the buffer given to the constructor
+  std::string_view text() {
+    uint32_t size = u32();
+    if (!m_ok || m_data.size() - m_pos < size) {
+      m_ok = false;
+      return {};
+    }
+    std::string_view value(
+        reinterpret_cast<const char *>(m_data.data()) + m_pos, size);
+    m_pos += size;
+    return value;
+  }
+  bool ok() const { return m_ok; }
+
+private:
+  template <typename T> T read() {
+    T value{};
+    if (!m_ok || m_data.size() - m_pos < sizeof(T)) {
+      m_ok = false;
+      return value;
+    }
+    memcpy(&value, m_data.data() + m_pos, sizeof(T));
+    m_pos += sizeof(T);
+    return value;
+  }
+
+  const std::vector<uint8_t> &m_data;
+  size_t m_pos = 0;
+  bool m_ok = true;
+};
@@ -4,7 +4,9 @@
 #pragma once
 
 #include <Logger.h>
-#include <asm_lexer.h>
-#include <asm_parser.h>
-#include <fstream>
+#include <Profiler.h>
+#include <SourceFile.h>
+#include <asm_driver.h>
+#include <asm_server.h>
+#include <cstdlib>
 #include <iostream>
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstdarg>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+enum class Severity { Warning, Error };
+
+struct Diagnostic {
+  Severity severity;
+  int line;
+  int column; // 0-based like Token::column, -1 when only the line is known
+  std::string message;
+  // An error in an included file is reported on the line of the INCLUDE,
+  // these say where in the file it is (file 0 for the compiled source)
+  uint16_t file;
+  int fileLine;
+};
+
+// Collects the errors and warnings of one compilation instead of stopping at
+// the first one. Only the first error of a line is kept: the parser resumes at
+// the next line, so anything after it on the same line is a follow-on error.
+// Lines of an included file count apart from the INCLUDE they share. Once
+// errorLimit errors are collected, further ones are dropped and
+// limitReached() tells the front end to stop.
+class Diagnostics {
+public:
+  explicit Diagnostics(size_t errorLimit = 0 /* unlimited */);
+
+  void error(int line, int column, const char *message, ...);
+  void warning(int line, int column, const char *message, ...);
+  // An error at fileLine of an included file (an id, see
+  // includes::Context), reported on the line of its INCLUDE
+  void includedError(uint16_t file, int fileLine, int line,
+                     const char *message, ...);
+
+  size_t errorCount() const { return m_errorCount; }
+  size_t warningCount() const { return m_warningCount; }
+  bool hasErrors() const { return m_errorCount > 0; }
+  bool limitReached() const {
+    return m_errorLimit != 0 && m_errorCount >= m_errorLimit;
+  }
+
+  void setErrorLimit(size_t limit) { m_errorLimit = limit; }
+  size_t errorLimit() const { return m_errorLimit; }
+
+  const std::vector<Diagnostic> &all() const { return m_diagnostics; }
+
+  // va_list form of error() and warning() for forwarding wrappers
+  void report(Severity severity, int line, int column, const char *message,
+              va_list args);
+
+  // Appends the diagnostics of another run, used to merge partial results
+  void append(const Diagnostics &other);
+  // Merges what a separate pass over the same source found (the lexer run on
+  // its own) as if both had run interleaved: in line order, and where both
+  // have an error on a line only the leftmost one is kept
+  void merge(const Diagnostics &other);
+  // Orders by line, keeping the order of diagnostics on the same line
+  void sortByLine();
+  void clear();
+
+  // Prints every diagnostic through the Logger as file:line:column: message
+  void print(const std::string &fileName) const;
+
+private:
+  void add(Severity severity, int line, int column, uint16_t file,
+           int fileLine, const char *message, va_list args);
+  // Counts an error unless it is a follow-on error or over the limit
+  bool countError(uint16_t file, int fileLine);
+
+  std::vector<Diagnostic> m_diagnostics;
+  size_t m_errorLimit;
+  size_t m_errorCount = 0;
+  size_t m_warningCount = 0;
+  uint16_t m_lastErrorFile = 0;
+  int m_lastErrorLine = -1;
+};
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(_MSC_VER) && defined(_M_X64)
+#include <intrin.h>
+#endif
+
+// Fast non-cryptographic 64-bit hash for cache keys, after wyhash: the input
+// is consumed 16 or 48 bytes per step, folded through 64x64 -> 128 bit
+// multiplies. Results are stable across runs and platforms of the same
+// endianness, so they can be stored on disk.
+namespace hash_detail {
+
+// Full 128-bit product of a and b, low half in a and high half in b
+inline void multiply(uint64_t &a, uint64_t &b) {
+#if defined(__SIZEOF_INT128__)
+  __uint128_t r = static_cast<__uint128_t>(a) * b;
+  a = static_cast<uint64_t>(r);
+  b = static_cast<uint64_t>(r >> 64);
+#elif defined(_MSC_VER) && defined(_M_X64)
+  a = _umul128(a, b, &b);
+#else
+  uint64_t ha = a >> 32, hb = b >> 32, la = a & 0xFFFFFFFF,
+           lb = b & 0xFFFFFFFF;
+  uint64_t hh = ha * hb, hl = ha * lb, lh = la * hb, ll = la * lb;
+  uint64_t mid = hl + lh;
+  uint64_t carry = (mid < hl ? 1ull << 32 : 0);
+  uint64_t low = ll + (mid << 32);
+  carry += low < ll;
+  a = low;
+  b = hh + (mid >> 32) + carry;
+#endif
+}
+
+inline uint64_t mix(uint64_t a, uint64_t b) {
+  multiply(a, b);
+  return a ^ b;
+}
+
+inline uint64_t read64(const uint8_t *p) {
+  uint64_t v;
+  memcpy(&v, p, 8);
+  return v;
+}
+
+inline uint64_t read32(const uint8_t *p) {
+  uint32_t v;
+  memcpy(&v, p, 4);
+  return v;
+}
+
+inline constexpr uint64_t secret[4] = {
+    0xa0761d6478bd642full, 0xe7037ed1a0b428dbull, 0x8ebc6af09c88c6e3ull,
+    0x589965cc75374cc3ull};
+
+} // namespace hash_detail
+
+// seed lets several inputs be chained: hashBytes(b, n, hashBytes(a, m))
+inline uint64_t hashBytes(const void *data, size_t size, uint64_t seed = 0) {
+  using namespace hash_detail;
+  const uint8_t *p = static_cast<const uint8_t *>(data);
+  seed ^= mix(seed ^ secret[0], secret[1]);
+
+  uint64_t a, b;
+  if (size <= 16) {
+    if (size >= 4) {
+      size_t step = (size >> 3) << 2;
+      a = (read32(p) << 32) | read32(p + step);
+      b = (read32(p + size - 4) << 32) | read32(p + size - 4 - step);
+    } else if (size > 0) {
+      a = (uint64_t(p[0]) << 16) | (uint64_t(p[size >> 1]) << 8) |
+          p[size - 1];
+      b = 0;
+    } else {
+      a = b = 0;
+    }
+  } else {
+    size_t left = size;
+    if (left > 48) {
+      uint64_t seed1 = seed, seed2 = seed;
+      do {
+        seed = mix(read64(p) ^ secret[1], read64(p + 8) ^ seed);
+        seed1 = mix(read64(p + 16) ^ secret[2], read64(p + 24) ^ seed1);
+        seed2 = mix(read64(p + 32) ^ secret[3], read64(p + 40) ^ seed2);
+        p += 48;
+        left -= 48;
+      } while (left > 48);
+      seed ^= seed1 ^ seed2;
+    }
+    while (left > 16) {
+      seed = mix(read64(p) ^ secret[1], read64(p + 8) ^ seed);
+      p += 16;
+      left -= 16;
+    }
+    // The last 16 bytes, overlapping what was already consumed
+    a = read64(p + left - 16);
+    b = read64(p + left - 8);
+  }
+
+  a ^= secret[1];
+  b ^= seed;
+  multiply(a, b);
+  return mix(a ^ secret[0] ^ size, b ^ secret[1]);
+}
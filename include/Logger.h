@@ -1,7 +1,9 @@
 #pragma once
+#include <atomic>
 #include <cstdarg>
 #include <iostream>
 #include <string>
+#include <string_view>
 
 // Define color escape sequences
 #define RESET_COLOR "\033[0m"
@@ -12,22 +14,78 @@
 
 enum LogLevel { Info = 0, Warning = 1, Error = 2, None = 3 };
 
+// Messages below this level are never formatted or buffered, the check is
+// inline and folds away for a constant level. fmtLog still evaluates its
+// arguments at the call site, C85_LOG below skips them as well. Set with
+// -DC85_LOG_MIN_LEVEL=<n> (see LogLevel).
+#ifndef C85_LOG_MIN_LEVEL
+#define C85_LOG_MIN_LEVEL 0
+#endif
+
+// Every thread formats its messages into its own buffer, which is written to
+// stdout in one call once it fills up, on Flush(), after an error and when
+// the thread ends.
+// Writes are serialized, so the messages of one thread stay together and in
+// order. Colors are only used when stdout is a terminal and NO_COLOR is unset.
 class Logger {
 public:
   static void
   Log(const std::string &message); /* Assume the message to level: none */
-  static void Log(LogLevel level, const std::string &message);
-  static void fmtLog(LogLevel level, const char *message, ...);
-  static void fmtLog(const char *message, ...);
+  static void Log(LogLevel level, const std::string &message) {
+    if (Enabled(level))
+      Put(level, message);
+  }
+
+  template <typename... Args>
+  static void fmtLog(LogLevel level, const char *message, Args... args) {
+    if (Enabled(level))
+      Format(level, message, args...);
+  }
+  template <typename... Args>
+  static void fmtLog(const char *message,
+                     Args... args) /* Assume the log level to be none */
+  {
+    Format(None, message, args...);
+  }
+
+  // Appends text that is already formatted, e.g. messages captured elsewhere
+  static void Raw(std::string_view text);
+  // Writes what the calling thread has buffered, needed before reading stdin
+  // or printing to stdout directly
+  static void Flush();
+
   static void SetLogLevel(LogLevel level);
   static LogLevel GetLogLevel();
+  static bool Enabled(LogLevel level) {
+    return level >= C85_LOG_MIN_LEVEL &&
+           level >= _level.load(std::memory_order_relaxed);
+  }
+  // Whether messages written to stdout get color escapes
+  static bool UseColor();
+
+  // Collects everything the calling thread logs in a buffer instead of
+  // printing it, until EndCapture() hands the text back. Lets jobs running in
+  // parallel print their messages afterwards without interleaving. color
+  // decides the escapes in the captured text, for whoever prints it later.
+  static void BeginCapture();
+  static void BeginCapture(bool color);
+  static std::string EndCapture();
 
 private:
   Logger();
-  static void LogInfo(const std::string &message);
-  static void LogWarning(const std::string &message);
-  static void LogError(const std::string &message);
+  static void Format(LogLevel level, const char *message, ...);
+  static void Put(LogLevel level, std::string_view message);
+  static void Append(const char *prefix, std::string_view text);
 
 private:
-  static LogLevel _level;
+  static std::atomic<LogLevel> _level;
 };
+
+// fmtLog that only evaluates its arguments when level is enabled, for
+// messages whose arguments cost something to compute. A level below
+// C85_LOG_MIN_LEVEL leaves no code at all.
+#define C85_LOG(level, ...)                                                    \
+  do {                                                                         \
+    if (Logger::Enabled(level))                                                \
+      Logger::fmtLog(level, __VA_ARGS__);                                      \
+  } while (0)
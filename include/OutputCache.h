@@ -0,0 +1,45 @@
+#pragma once
+
+#include <asm_driver.h>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+struct UsageIndex;
+
+// Content-addressed store of finished compilations, shared between runs and
+// processes. An entry is keyed by the hash of the source bytes, the compiler
+// version and every option that changes the result, and holds the output file
+// contents together with the diagnostics. Included files are listed in the
+// entry with the hash of their contents, an entry is only used while every
+// one of them is unchanged. Entries are written to a temporary file and
+// renamed into place, so readers never see half an entry. The total size of
+// the entries is kept in a small index file, the directory is only listed
+// when that total passes the cap (and now and then to correct it). The least
+// recently used entries are then removed, a hit refreshes the modification
+// time that eviction goes by.
+class OutputCache {
+public:
+  OutputCache(std::string directory, uint64_t maxBytes);
+
+  static uint64_t key(string_view source, const CompileOptions &options);
+
+  // False on a miss or an unreadable entry
+  bool load(uint64_t key, CompileResult &result, size_t errorLimit) const;
+  // Failures only cost the next run a compile, they are not reported
+  void store(uint64_t key, const CompileResult &result) const;
+
+private:
+  std::string path(uint64_t key) const;
+  // Temporary file renamed into place, false on failure
+  static bool writeAtomically(const std::string &file,
+                              const vector<uint8_t> &data);
+  bool readUsage(UsageIndex &usage) const;
+  void writeUsage(UsageIndex usage) const;
+  // Walks the directory, trims it below the cap if it is over and returns
+  // the size of what is left
+  uint64_t evict() const;
+
+  std::string m_directory;
+  uint64_t m_maxBytes;
+};
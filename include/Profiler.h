@@ -0,0 +1,63 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Per-phase timing behind --time-report and --trace.
+// Phases are marked with ProfileScope objects. While profiling is off a
+// scope is a single test of a flag; while it is on, every scope records a
+// span (start, duration, bytes, peak RSS) into a buffer of its own thread.
+// finish() sums the spans by phase for the report and writes all of them as
+// Chrome trace events (chrome://tracing, Perfetto).
+class Profiler {
+public:
+  // Call before any thread records, tracePath may be empty
+  static void start(bool timeReport, const std::string &tracePath);
+  static bool enabled() { return s_enabled.load(std::memory_order_relaxed); }
+
+  // Prints the report and writes the trace, returns false if the trace could
+  // not be written
+  static bool finish();
+
+  static void record(const char *name, uint64_t begin, uint64_t end,
+                     size_t bytes, std::string_view detail);
+  // Microseconds since start()
+  static uint64_t now();
+
+private:
+  static std::atomic<bool> s_enabled;
+};
+
+class ProfileScope {
+public:
+  // name must outlive the profiler (a string literal), detail must outlive the
+  // scope and is copied when it ends
+  explicit ProfileScope(const char *name, size_t bytes = 0,
+                        std::string_view detail = {}) {
+    if (Profiler::enabled()) {
+      m_name = name;
+      m_bytes = bytes;
+      m_detail = detail;
+      m_begin = Profiler::now();
+    }
+  }
+  ~ProfileScope() {
+    if (m_name)
+      Profiler::record(m_name, m_begin, Profiler::now(), m_bytes, m_detail);
+  }
+
+  ProfileScope(const ProfileScope &) = delete;
+  ProfileScope &operator=(const ProfileScope &) = delete;
+
+  // For phases whose size is only known at their end
+  void setBytes(size_t bytes) { m_bytes = bytes; }
+
+private:
+  const char *m_name = nullptr;
+  size_t m_bytes = 0;
+  std::string_view m_detail;
+  uint64_t m_begin = 0;
+};
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+// Read-only view of a source file on disk.
+// The file is memory-mapped where the platform allows it, so the lexer can
+// hand out tokens that point straight into the mapping without copying the
+// source. Falls back to reading into an owned buffer if mapping fails.
+class SourceFile {
+public:
+  SourceFile() = default;
+  ~SourceFile();
+
+  SourceFile(const SourceFile &) = delete;
+  SourceFile &operator=(const SourceFile &) = delete;
+  SourceFile(SourceFile &&other) noexcept;
+  SourceFile &operator=(SourceFile &&other) noexcept;
+
+  // Opens and maps the file, returns false (and logs) on failure
+  bool open(const std::string &path);
+  void close();
+
+  std::string_view view() const { return {m_data, m_size}; }
+  size_t size() const { return m_size; }
+  bool isMapped() const { return m_mapped; }
+
+private:
+  const char *m_data = nullptr;
+  size_t m_size = 0;
+  bool m_mapped = false;
+
+  // Used only when the file could not be mapped
+  std::string m_fallback;
+};
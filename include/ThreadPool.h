@@ -0,0 +1,54 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads with one task queue each.
+// parallelFor deals the indices out to the queues in contiguous blocks. A
+// worker takes from the front of its own queue and, once that is empty,
+// steals from the back of the others, so a few large jobs in one block do not
+// leave the remaining threads idle.
+class ThreadPool {
+public:
+  // 0 threads means one per hardware thread
+  explicit ThreadPool(unsigned threads = 0);
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  unsigned size() const { return static_cast<unsigned>(m_threads.size()); }
+
+  // Runs task(index, worker) for every index in [0, count) and returns once
+  // all of them finished. worker is in [0, size()) and stays the same for a
+  // thread, for per-worker state. Must not be called from inside a task.
+  void parallelFor(size_t count,
+                   const std::function<void(size_t, unsigned)> &task);
+
+private:
+  struct Queue {
+    std::mutex lock;
+    std::deque<size_t> indices;
+  };
+
+  void run(unsigned worker);
+  bool takeTask(unsigned worker, size_t &index);
+
+  std::vector<std::unique_ptr<Queue>> m_queues;
+  std::vector<std::thread> m_threads;
+
+  std::mutex m_lock;
+  std::condition_variable m_wake; // a new round of tasks or shutdown
+  std::condition_variable m_done; // the last worker finished the round
+  const std::function<void(size_t, unsigned)> *m_task = nullptr;
+  uint64_t m_round = 0;
+  unsigned m_busy = 0;
+  bool m_stop = false;
+};
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <asm_ir.h>
+#include <asm_peephole.h>
+#include <cstdint>
+#include <vector>
+
+// Control-flow graph over the IR rows.
+// A basic block starts at the first row, at every row that defines a label or
+// is an ORG, CYCLES or ENDCYC, and after every jump, call, return, RST, PCHL
+// and HLT. Edges to labels are exact. Numeric branch targets and RST vectors
+// are only known when an ORG starts a block at that address; otherwise the
+// graph is incomplete and passes that need every edge leave the program alone.
+namespace cfg {
+
+constexpr uint32_t noBlock = UINT32_MAX;
+
+// How control leaves a row
+enum class Flow : uint8_t {
+  Next,       // falls through
+  Jump,       // JMP
+  Branch,     // Jcc, falls through when not taken
+  Call,       // CALL, continues after the call
+  CondCall,   // Ccc
+  Return,     // RET
+  CondReturn, // Rcc, falls through when not taken
+  Restart,    // RST, a call to a fixed vector
+  Indirect,   // PCHL
+  Halt,       // HLT
+};
+
+Flow flowOf(TokenType op);
+
+struct Block {
+  uint32_t first; // rows [first, end)
+  uint32_t end;
+  uint32_t next = noBlock;   // fall-through successor
+  uint32_t target = noBlock; // branch, call or RST target
+  bool unknownTarget = false; // the target is an address no block starts at
+};
+
+struct Graph {
+  vector<Block> blocks;
+  vector<uint32_t> blockOf; // block of every row
+  // Blocks execution can start in without an edge: the first block, every
+  // ORG, and blocks with a label used as data (LXI H, TABLE) or holding DB.
+  // In an object every labeled block, other modules may jump there. Code the
+  // hardware enters at a RST or interrupt vector must start at an ORG.
+  vector<uint32_t> entries;
+  bool complete = true; // every branch target is known
+
+  // Blocks reachable from the entries
+  vector<bool> reachable() const;
+  void Print(const ir::Program &program) const;
+};
+
+// exported: the labels are exported from a relocatable object
+Graph build(const ir::Program &program, bool exported = false);
+
+// Points jumps and calls whose target label is itself a JMP straight at the
+// final target, then drops jumps to the row right after them
+void threadJumps(ir::Program &program, peephole::RuleStats &stats);
+
+// Drops the blocks no entry reaches, e.g. code after a JMP, RET or HLT that
+// no label leads to. Does nothing when the graph is incomplete.
+void removeUnreachable(ir::Program &program, peephole::RuleStats &stats,
+                       bool exported = false);
+
+} // namespace cfg
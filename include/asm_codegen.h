@@ -0,0 +1,187 @@
+#pragma once
+
+#include <Diagnostics.h>
+#include <array>
+#include <asm_ir.h>
+#include <cstdint>
+#include <vector>
+
+// Table-driven 8085 machine code generation.
+// Every mnemonic and directive has one row in opcodeTable giving its base
+// opcode, its size in bytes and where each operand goes: register fields are
+// or-ed into the opcode byte at the given bit position, anything else is an
+// immediate emitted after the opcode (low byte first). Sizing and encoding are
+// therefore plain table lookups over the IR rows.
+namespace includes {
+class Context;
+}
+
+namespace codegen {
+
+// Operand is an immediate that follows the opcode, not a field inside it
+constexpr uint8_t noField = 0xFF;
+
+struct OpcodeInfo {
+  TokenType type;
+  uint8_t opcode;
+  uint8_t size;     // bytes emitted, 0 for directives that emit nothing
+  uint8_t field[2]; // bit position of each operand inside the opcode
+};
+
+constexpr size_t opcodeCount = static_cast<size_t>(TokenType::ENDCYC) + 1;
+
+// clang-format off
+inline constexpr std::array<OpcodeInfo, opcodeCount> opcodeTable = {{
+    // Data Transfer
+    {TokenType::MOV,  0x40, 1, {3, 0}},            // 01 ddd sss
+    {TokenType::MVI,  0x06, 2, {3, noField}},      // 00 ddd 110
+    {TokenType::LXI,  0x01, 3, {4, noField}},      // 00 rp0 001
+    {TokenType::LDA,  0x3A, 3, {noField, noField}},
+    {TokenType::STA,  0x32, 3, {noField, noField}},
+    {TokenType::LHLD, 0x2A, 3, {noField, noField}},
+    {TokenType::SHLD, 0x22, 3, {noField, noField}},
+    {TokenType::LDAX, 0x0A, 1, {4, noField}},      // 00 rp1 010
+    {TokenType::STAX, 0x02, 1, {4, noField}},      // 00 rp0 010
+    {TokenType::XCHG, 0xEB, 1, {noField, noField}},
+
+    // Arithmetic
+    {TokenType::ADD,  0x80, 1, {0, noField}},      // 10 000 sss
+    {TokenType::ADI,  0xC6, 2, {noField, noField}},
+    {TokenType::ADC,  0x88, 1, {0, noField}},
+    {TokenType::ACI,  0xCE, 2, {noField, noField}},
+    {TokenType::SUB,  0x90, 1, {0, noField}},
+    {TokenType::SUI,  0xD6, 2, {noField, noField}},
+    {TokenType::SBB,  0x98, 1, {0, noField}},
+    {TokenType::SBI,  0xDE, 2, {noField, noField}},
+    {TokenType::INR,  0x04, 1, {3, noField}},      // 00 ddd 100
+    {TokenType::DCR,  0x05, 1, {3, noField}},      // 00 ddd 101
+    {TokenType::INX,  0x03, 1, {4, noField}},      // 00 rp0 011
+    {TokenType::DCX,  0x0B, 1, {4, noField}},      // 00 rp1 011
+    {TokenType::DAD,  0x09, 1, {4, noField}},      // 00 rp1 001
+    {TokenType::DAA,  0x27, 1, {noField, noField}},
+
+    // Logical
+    {TokenType::ANA,  0xA0, 1, {0, noField}},
+    {TokenType::ANI,  0xE6, 2, {noField, noField}},
+    {TokenType::XRA,  0xA8, 1, {0, noField}},
+    {TokenType::XRI,  0xEE, 2, {noField, noField}},
+    {TokenType::ORA,  0xB0, 1, {0, noField}},
+    {TokenType::ORI,  0xF6, 2, {noField, noField}},
+    {TokenType::CMP,  0xB8, 1, {0, noField}},
+    {TokenType::CPI,  0xFE, 2, {noField, noField}},
+    {TokenType::RLC,  0x07, 1, {noField, noField}},
+    {TokenType::RRC,  0x0F, 1, {noField, noField}},
+    {TokenType::RAL,  0x17, 1, {noField, noField}},
+    {TokenType::RAR,  0x1F, 1, {noField, noField}},
+    {TokenType::CMA,  0x2F, 1, {noField, noField}},
+    {TokenType::CMC,  0x3F, 1, {noField, noField}},
+    {TokenType::STC,  0x37, 1, {noField, noField}},
+
+    // Branch
+    {TokenType::JMP,  0xC3, 3, {noField, noField}},
+    {TokenType::JC,   0xDA, 3, {noField, noField}},
+    {TokenType::JNC,  0xD2, 3, {noField, noField}},
+    {TokenType::JZ,   0xCA, 3, {noField, noField}},
+    {TokenType::JNZ,  0xC2, 3, {noField, noField}},
+    {TokenType::JP,   0xF2, 3, {noField, noField}},
+    {TokenType::JM,   0xFA, 3, {noField, noField}},
+    {TokenType::JPE,  0xEA, 3, {noField, noField}},
+    {TokenType::JPO,  0xE2, 3, {noField, noField}},
+    {TokenType::CALL, 0xCD, 3, {noField, noField}},
+    {TokenType::CC,   0xDC, 3, {noField, noField}},
+    {TokenType::CNC,  0xD4, 3, {noField, noField}},
+    {TokenType::CZ,   0xCC, 3, {noField, noField}},
+    {TokenType::CNZ,  0xC4, 3, {noField, noField}},
+    {TokenType::CP,   0xF4, 3, {noField, noField}},
+    {TokenType::CM,   0xFC, 3, {noField, noField}},
+    {TokenType::CPE,  0xEC, 3, {noField, noField}},
+    {TokenType::CPO,  0xE4, 3, {noField, noField}},
+    {TokenType::RET,  0xC9, 1, {noField, noField}},
+    {TokenType::RC,   0xD8, 1, {noField, noField}},
+    {TokenType::RNC,  0xD0, 1, {noField, noField}},
+    {TokenType::RZ,   0xC8, 1, {noField, noField}},
+    {TokenType::RNZ,  0xC0, 1, {noField, noField}},
+    {TokenType::RP,   0xF0, 1, {noField, noField}},
+    {TokenType::RM,   0xF8, 1, {noField, noField}},
+    {TokenType::RPE,  0xE8, 1, {noField, noField}},
+    {TokenType::RPO,  0xE0, 1, {noField, noField}},
+    {TokenType::RST,  0xC7, 1, {3, noField}},      // 11 nnn 111
+    {TokenType::PCHL, 0xE9, 1, {noField, noField}},
+
+    // Stack & Machine Control
+    {TokenType::PUSH, 0xC5, 1, {4, noField}},      // 11 rp0 101
+    {TokenType::POP,  0xC1, 1, {4, noField}},      // 11 rp0 001
+    {TokenType::XTHL, 0xE3, 1, {noField, noField}},
+    {TokenType::SPHL, 0xF9, 1, {noField, noField}},
+    {TokenType::IN,   0xDB, 2, {noField, noField}},
+    {TokenType::OUT,  0xD3, 2, {noField, noField}},
+    {TokenType::HLT,  0x76, 1, {noField, noField}},
+    {TokenType::NOP,  0x00, 1, {noField, noField}},
+    {TokenType::DI,   0xF3, 1, {noField, noField}},
+    {TokenType::EI,   0xFB, 1, {noField, noField}},
+    {TokenType::RIM,  0x20, 1, {noField, noField}},
+    {TokenType::SIM,  0x30, 1, {noField, noField}},
+
+    // Assembler directives
+    {TokenType::ORG,  0x00, 0, {noField, noField}},
+    {TokenType::DB,   0x00, 1, {0, noField}},      // the data byte itself
+    {TokenType::CYCLES, 0x00, 0, {noField, noField}},
+    {TokenType::ENDCYC, 0x00, 0, {noField, noField}},
+}};
+// clang-format on
+
+constexpr bool opcodeTableInOrder() {
+  for (size_t i = 0; i < opcodeTable.size(); ++i) {
+    if (static_cast<size_t>(opcodeTable[i].type) != i)
+      return false;
+  }
+  return true;
+}
+static_assert(opcodeTableInOrder(), "opcodeTable must follow TokenType order");
+
+constexpr const OpcodeInfo &opcodeInfo(TokenType type) {
+  return opcodeTable[static_cast<size_t>(type)];
+}
+
+// Opcode byte of a row with its register fields filled in, the immediate that
+// may follow is left out
+uint8_t opcodeByte(const ir::Program &program, size_t row);
+
+// A run of bytes placed at a fixed address, a new one starts at every ORG
+struct Section {
+  uint16_t origin;
+  uint32_t offset; // into MachineCode::bytes
+  uint32_t size;
+  int line = 0; // of its first row, for diagnostics
+};
+
+// A 16-bit label operand, kept when assembling a relocatable object
+struct Relocation {
+  uint32_t position; // of the low byte in MachineCode::bytes
+  uint32_t symbol;
+};
+
+struct MachineCode {
+  vector<uint8_t> bytes;
+  vector<Section> sections;
+  vector<uint16_t> symbolAddress; // indexed by ir symbol id
+  vector<bool> symbolDefined;
+  vector<Relocation> relocations; // every label operand, only if relocatable
+
+  void Print() const;
+};
+
+// Single-pass assembly: assigns addresses and emits bytes in one walk over
+// the rows. A reference to a label that is not defined yet emits a zero word
+// and is chained onto that label's fixup list, the chain is patched as soon
+// as the label is defined. References still unresolved at the end are
+// reported as undefined labels. Returns false on error, the errors themselves
+// go to diagnostics.
+// relocatable assembles for an object: every label operand is recorded in
+// relocations and labels that are never defined are left for the linker.
+// includes names the files of included rows in their errors.
+bool generateCode(ir::Program &program, MachineCode &out,
+                  Diagnostics &diagnostics, bool relocatable = false,
+                  const includes::Context *includes = nullptr);
+
+} // namespace codegen
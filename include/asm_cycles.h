@@ -0,0 +1,87 @@
+#pragma once
+
+#include <Diagnostics.h>
+#include <asm_cfg.h>
+#include <asm_ir.h>
+#include <cstdint>
+#include <vector>
+
+// Static T-state analysis on the control-flow graph.
+// Every row costs its entry in asm_timing.h; a conditional jump, call or
+// return costs more when it is taken. Worst cases follow every path through
+// the graph, a call adds the worst case of the subroutine up to its RET.
+// A path that can go around a loop, recurse, or leave through PCHL or a
+// target the graph does not know has no bound.
+//
+// CYCLES n ... ENDCYC puts a budget on the code between the two: the slowest
+// path from CYCLES until it leaves the region, returns or halts must take at
+// most n T-states, otherwise the compilation fails. Regions may nest.
+namespace cycles {
+
+// Worst case of a path that can take any time
+constexpr uint64_t unbounded = UINT64_MAX;
+
+struct Loop {
+  uint32_t header;          // block every iteration starts in
+  vector<uint32_t> latches; // blocks that jump back to the header
+  size_t blocks;            // in the body, the header included
+  uint64_t worst;           // T-states of one iteration, or unbounded
+};
+
+struct Region {
+  uint32_t begin; // CYCLES row
+  uint32_t end;   // ENDCYC row
+  uint32_t budget;
+  uint64_t worst;
+};
+
+class Analysis {
+public:
+  Analysis(const ir::Program &program, const cfg::Graph &graph);
+
+  // Time of a row, for conditional rows when the condition fails
+  uint32_t rowTime(size_t row) const;
+  // What a taken conditional row costs on top of rowTime(), 0 otherwise
+  uint32_t takenTime(size_t row) const;
+  // Every row of the block, with no condition taken
+  uint64_t blockTime(uint32_t block) const;
+
+  // Worst case from the start of block to the RET that leaves it
+  uint64_t subroutine(uint32_t block);
+  // Pairs every CYCLES with its ENDCYC and finds the worst case of the code
+  // in between. A directive without its partner is an error.
+  vector<Region> regions(Diagnostics &diagnostics);
+  // Natural loops, one per header, from the back edges of the dominator tree
+  vector<Loop> loops();
+
+private:
+  struct Visit {
+    uint64_t worst = 0;
+    uint8_t state = 0; // new, on the path being walked, or done
+  };
+  struct Scope;
+  struct Memo;
+
+  uint64_t longestPath(uint32_t start, const Scope &scope, Memo &memo);
+  uint64_t finish(uint32_t block, const Scope &scope, Memo &memo);
+
+  const ir::Program &m_program;
+  const cfg::Graph &m_graph;
+  vector<uint64_t> m_blockTime;
+  // Paths inside a subroutine do not depend on who called it, so their worst
+  // cases are kept for every later call
+  vector<Visit> m_subroutine;
+};
+
+// True when the program has a CYCLES region to check
+bool hasRegions(const ir::Program &program);
+
+// Checks every CYCLES region against its budget, errors go to diagnostics at
+// the CYCLES line. Returns false if any region failed.
+bool checkBudgets(const ir::Program &program, Diagnostics &diagnostics);
+
+// Logs every block with the time of each instruction, then the loops and the
+// regions. Needs the addresses codegen assigned.
+void printReport(const ir::Program &program);
+
+} // namespace cycles
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <ASTStructs.h>
+#include <ByteStream.h>
+#include <Diagnostics.h>
+#include <asm_codegen.h>
+#include <asm_emulator.h>
+#include <asm_include.h>
+#include <asm_ir.h>
+#include <asm_object.h>
+#include <asm_output.h>
+#include <asm_peephole.h>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// One compilation from source text to output file contents, without touching
+// the file system or ending the process. Everything the front end and code
+// generator find wrong is collected in the result instead.
+
+#ifndef C85_VERSION
+#define C85_VERSION "dev"
+#endif
+
+// Part of every output cache key, results of other versions never match
+constexpr string_view compilerVersion = C85_VERSION;
+
+struct CompileOptions {
+  // Object (-c) assembles a relocatable object for linkFiles()
+  output::Format format = output::Format::HexDump;
+  uint8_t fill = 0; // gaps between sections in raw output (--fill)
+  size_t errorLimit = 20; // 0 for no limit
+  bool dump = false;      // print the AST, IR and machine code
+  // Threads for the front end of sources of parallelMinSize or more,
+  // 0 for one per core and 1 to always lex and parse serially
+  unsigned threads = 0;
+  // Run the peephole optimizer before encoding (-O)
+  bool optimize = false;
+  // Log the T-states of every instruction, block, loop and CYCLES region
+  bool cycleReport = false;
+  // Reuse the IR of unchanged lines from the <outputFile>.c85cache sidecar
+  bool incremental = false;
+  // Directory INCLUDE names in the source are resolved against, the working
+  // directory if empty. compileFromFile() uses the directory of the source.
+  string includeDir;
+  // Output cache shared by every compilation, empty to disable
+  string cacheDir;
+  uint64_t cacheMaxBytes = 256ull << 20;
+};
+
+struct CompileResult {
+  bool success = false;
+  Diagnostics diagnostics;
+  vector<uint8_t> output; // formatted file contents, empty on failure
+  peephole::Report optimization;
+  vector<includes::Dependency> dependencies; // every file included
+};
+
+// Serialized form of a result, for the output cache and the compile server
+void writeResult(ByteWriter &out, const CompileResult &result);
+bool readResult(ByteReader &in, CompileResult &result, size_t errorLimit);
+
+// Buffers kept from one compilation to the next, so a worker compiling many
+// files reuses the AST arena and the IR and code vectors instead of
+// allocating them again for every file
+struct CompileWorkspace {
+  unique_ptr<ASTProgram> program;
+  ir::Program code;
+  codegen::MachineCode machineCode;
+  // The included files, label names in the IR point into their text
+  includes::Context includes;
+};
+
+CompileResult compileSource(string_view source, const CompileOptions &options,
+                            CompileWorkspace *workspace = nullptr);
+
+// Same result as compileSource(), lowering through the per-line cache stored
+// in cacheFile, which is updated for the next run
+CompileResult compileIncremental(string_view source,
+                                 const CompileOptions &options,
+                                 const string &cacheFile,
+                                 CompileWorkspace *workspace = nullptr);
+
+// Opens and compiles sourceFile, outputFile only names the incremental cache.
+// A source that cannot be opened is logged and gives a failed result.
+// With a cache directory the result may come from the output cache, and a
+// fresh result is stored there.
+CompileResult compileFromFile(const string &sourceFile,
+                              const string &outputFile,
+                              const CompileOptions &options,
+                              CompileWorkspace *workspace = nullptr);
+
+// Logs the diagnostics of result and writes its output to outputFile,
+// returns false if anything failed
+bool finishFile(const CompileResult &result, const string &sourceFile,
+                const string &outputFile);
+
+// Compiles sourceFile into outputFile and logs its diagnostics, returns false
+// if anything failed
+bool compileFile(const string &sourceFile, const string &outputFile,
+                 const CompileOptions &options,
+                 CompileWorkspace *workspace = nullptr);
+
+struct RunOptions {
+  uint64_t instructionLimit = 100'000'000;
+  size_t hotLoops = 5; // loops to report, 0 runs without profiling
+};
+
+// Compiles sourceFile in-process and executes the image on the emulator from
+// its first ORG until HLT or the instruction limit, then logs the registers,
+// the T-states and the hottest loops. OUT writes are logged as they happen.
+// outputFile is written as usual unless it is empty. Returns false if the
+// compilation failed or the program hit an undocumented opcode.
+bool runFile(const string &sourceFile, const string &outputFile,
+             const CompileOptions &options, const RunOptions &run);
+
+struct BatchJob {
+  string sourceFile;
+  string outputFile;
+};
+
+// Manifest: one "<sourceFile> <outputFile>" pair per line, blank lines and
+// lines starting with '#' are skipped. Returns false (and logs) on error.
+bool readManifest(const string &path, vector<BatchJob> &jobs);
+
+// Compiles every job on a work-stealing pool of threads (0 = one per core),
+// each job on a single thread. The log output of each job is held back and
+// printed in job order once all jobs are done. Returns the number of jobs
+// that failed.
+size_t compileBatch(const vector<BatchJob> &jobs, const CompileOptions &options,
+                    unsigned threads = 0);
+
+// Links relocatable objects into one image and writes it to outputFile in
+// format, gaps in raw output hold fill. See object::link(). Returns false if
+// anything failed.
+bool linkFiles(const vector<string> &objectFiles, const string &outputFile,
+               output::Format format, uint8_t fill,
+               const object::LinkOptions &options);
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <array>
+#include <asm_codegen.h>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// 8085 emulator for running assembled images without external tools.
+// The interpreter is threaded: every opcode maps to a handler, and each
+// handler fetches the next opcode and jumps straight to its handler through a
+// table of label addresses (a switch stands in for compilers without computed
+// goto). Sign, zero and parity come from a 256-entry table, T-states from the
+// shared timing table. Interrupts are not modelled: EI, DI and SIM do nothing
+// and RIM reads 0.
+namespace emulator {
+
+// PSW flag bits
+constexpr uint8_t flagS = 0x80;
+constexpr uint8_t flagZ = 0x40;
+constexpr uint8_t flagAC = 0x10;
+constexpr uint8_t flagP = 0x04;
+constexpr uint8_t flagCY = 0x01;
+
+struct Registers {
+  // Indexed by the register field of the opcode: B C D E H L - A
+  uint8_t r[8] = {};
+  uint8_t f = 0;
+  uint16_t sp = 0;
+  uint16_t pc = 0;
+
+  uint16_t hl() const { return static_cast<uint16_t>(r[4] << 8 | r[5]); }
+};
+
+enum class StopReason {
+  Halted,        // HLT was executed
+  Limit,         // the instruction limit was reached
+  IllegalOpcode, // one of the undocumented opcodes, pc points at it
+};
+
+// Filled in by run() while profiling, every column is indexed by address
+struct ExecutionProfile {
+  vector<uint64_t> counts;  // times an instruction started here
+  vector<uint64_t> tStates; // T-states spent in the instruction here
+  // Taken jumps from a branch here to an address at or before it, and where
+  // the last one went
+  vector<uint64_t> backEdges;
+  vector<uint16_t> backTarget;
+
+  void reset();
+};
+
+// A loop closed by a backward branch, hottest first
+struct HotLoop {
+  uint16_t head; // branch target
+  uint16_t tail; // address of the branch
+  uint64_t iterations;
+  uint64_t tStates; // spent between head and tail, inclusive
+};
+
+// The count loops from [head, tail] ranges that took the most time
+vector<HotLoop> findHotLoops(const ExecutionProfile &profile, size_t count);
+
+class Cpu {
+public:
+  using InHandler = function<uint8_t(uint8_t port)>;
+  using OutHandler = function<void(uint8_t port, uint8_t value)>;
+
+  Cpu();
+
+  // Clears memory and registers, copies every section into memory and starts
+  // at the origin of the first section (0 without sections)
+  void load(const codegen::MachineCode &code);
+  void reset();
+
+  // IN reads 0xFF and OUT is dropped unless a handler is set
+  void setInHandler(InHandler handler) { m_in = move(handler); }
+  void setOutHandler(OutHandler handler) { m_out = move(handler); }
+
+  // Executes until HLT, an undocumented opcode or limit instructions.
+  // Resumes where the last run stopped, after HLT for a halted one.
+  StopReason run(uint64_t limit, ExecutionProfile *profile = nullptr);
+
+  Registers &registers() { return m_regs; }
+  const Registers &registers() const { return m_regs; }
+  array<uint8_t, 0x10000> &memory() { return m_memory; }
+  const array<uint8_t, 0x10000> &memory() const { return m_memory; }
+
+  // Totals since the last load() or reset()
+  uint64_t instructions() const { return m_instructions; }
+  uint64_t tStates() const { return m_tStates; }
+
+  void Print() const;
+
+private:
+  template <bool Profile>
+  StopReason execute(uint64_t limit, ExecutionProfile *profile);
+
+  Registers m_regs;
+  array<uint8_t, 0x10000> m_memory;
+  uint64_t m_instructions = 0;
+  uint64_t m_tStates = 0;
+  InHandler m_in;
+  OutHandler m_out;
+};
+
+} // namespace emulator
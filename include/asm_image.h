@@ -0,0 +1,84 @@
+#pragma once
+
+#include <array>
+#include <asm_codegen.h>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Sparse model of the 64KB address space the sections of a program land in.
+// The space is cut into 256 pages of 256 bytes. A page is only allocated
+// once something is written to it, so scattered ORG sections cost the pages
+// they touch instead of a dense 64KB copy. Every page keeps a bitmap of the
+// bytes written so far: checking a range for overlap is a few word
+// operations per page it touches, however many sections came before. Raw and
+// Intel HEX output are written straight from the pages.
+namespace image {
+
+constexpr uint32_t pageSize = 256;
+constexpr uint32_t pageCount = 0x10000 / pageSize;
+
+// A section that landed on bytes an earlier section had written
+struct Overlap {
+  uint32_t section; // index into MachineCode::sections
+  uint32_t bytes;   // how many of its bytes were already written
+};
+
+class Image {
+public:
+  // Bytes that were never written read as fill
+  explicit Image(uint8_t fill = 0) : m_fill(fill) {}
+  // Places every section of code in order, see overlaps()
+  explicit Image(const codegen::MachineCode &code, uint8_t fill = 0);
+
+  // Copies size bytes to address, later writes win. Returns how many of the
+  // bytes had been written before. The range must end within 64KB.
+  uint32_t write(uint16_t address, const uint8_t *data, uint32_t size);
+
+  uint8_t fill() const { return m_fill; }
+  bool empty() const;
+  // Lowest written address and one past the highest, 0 when empty()
+  uint32_t low() const;
+  uint32_t high() const;
+
+  // Dense copy of [from, to) into out, bytes never written are fill
+  void copy(uint32_t from, uint32_t to, uint8_t *out) const;
+
+  // Calls run(address, bytes, size) for every run of written bytes in
+  // address order. Runs also end where a page does.
+  template <typename Run> void forEachRun(Run &&run) const;
+
+  // Sections of the code the image was built from that overwrote others
+  const vector<Overlap> &overlaps() const { return m_overlaps; }
+
+private:
+  struct Page {
+    array<uint8_t, pageSize> bytes;
+    array<uint64_t, pageSize / 64> written; // a bit per byte
+  };
+
+  Page &allocate(uint32_t index);
+  // First byte at or after from that is written (or not), pageSize if none
+  static uint32_t find(const Page &page, uint32_t from, bool written);
+
+  array<unique_ptr<Page>, pageCount> m_pages;
+  array<uint64_t, pageCount / 64> m_allocated{}; // a bit per page
+  uint8_t m_fill;
+  vector<Overlap> m_overlaps;
+};
+
+template <typename Run> void Image::forEachRun(Run &&run) const {
+  for (uint32_t index = 0; index < pageCount; ++index) {
+    if (!(m_allocated[index / 64] >> (index % 64) & 1))
+      continue;
+    const Page &page = *m_pages[index];
+    for (uint32_t at = find(page, 0, true); at < pageSize;) {
+      uint32_t end = find(page, at, false);
+      run(static_cast<uint16_t>(index * pageSize + at), page.bytes.data() + at,
+          end - at);
+      at = find(page, end, true);
+    }
+  }
+}
+
+} // namespace image
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <Diagnostics.h>
+#include <asm_lexer.h>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// INCLUDE "file" support.
+// An included file is read and lexed once per process: its text and tokens
+// are kept in a shared cache and spliced into the token stream wherever the
+// file is included, so a header included by every file of a batch, or by
+// every compilation a server runs, is scanned only once. A file that changed
+// on disk since it was cached is read and lexed again. The cache is capped in
+// size, the least recently used files go first, so a long-running server
+// does not keep every file it ever included.
+namespace includes {
+
+struct File {
+  string path; // absolute
+  string text; // the tokens point into it
+  vector<Token> tokens;
+  Diagnostics diagnostics; // what the lexer found, reported at every INCLUDE
+  uint64_t hash;
+  filesystem::file_time_type modified;
+  uintmax_t size;
+
+  // Line of a token offset, 1-based
+  int lineOf(uint32_t offset) const;
+};
+
+// Every file the result of a compilation depends on besides its source
+struct Dependency {
+  string path;
+  uint64_t hash; // of the contents
+};
+
+// True if the file still has the contents it had when it was compiled
+bool isCurrent(const Dependency &dependency);
+
+// Included files shared by every compilation in the process
+class Cache {
+public:
+  // Text and tokens kept at most, a file larger than that is not kept
+  static constexpr uint64_t maxBytes = 64ull << 20;
+
+  static Cache &shared();
+
+  // The cached file if it is unchanged on disk, otherwise it is read and
+  // lexed again. nullptr if it cannot be read.
+  shared_ptr<const File> load(const string &path);
+
+private:
+  struct Entry {
+    shared_ptr<const File> file;
+    uint64_t bytes;
+    uint64_t lastUse;
+  };
+
+  // Drops the least recently used files until the rest fit in maxBytes.
+  // Compilations using a dropped file keep their reference to it.
+  void evict();
+
+  mutex m_mutex;
+  unordered_map<string, Entry> m_files;
+  uint64_t m_bytes = 0;
+  uint64_t m_clock = 0;
+};
+
+// The files one compilation includes, numbered for Token::file. Safe to use
+// from the threads of the parallel front end. Keeps the files alive while
+// the IR refers to their text (label names).
+class Context {
+public:
+  // Starts a compilation whose INCLUDE names are resolved against directory,
+  // the working directory if it is empty
+  void reset(string directory);
+
+  // Resolves name against the directory of the file it is included from (0
+  // for the source) and loads it. Returns its id, or 0 with a message in
+  // error.
+  uint16_t open(string_view name, uint16_t from, string &error);
+  const File &file(uint16_t id) const;
+
+  // Every file opened since reset(), by path
+  vector<Dependency> dependencies() const;
+
+private:
+  mutable mutex m_mutex;
+  string m_directory;
+  vector<shared_ptr<const File>> m_files; // id 1 is m_files[0]
+  unordered_map<string, uint16_t> m_ids;  // by path
+};
+
+} // namespace includes
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <ASTStructs.h>
+#include <Diagnostics.h>
+#include <asm_include.h>
+#include <asm_ir.h>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Incremental reassembly.
+// Statements never span lines, so the IR row of a line depends on nothing
+// but the text of that line. The cache maps the hash of a line's text to the
+// row it lowered to; positions (label names, the statement start) are kept
+// relative to the line so a record fits the same text on any line. Only
+// lines that are not in the cache are lexed and parsed, address assignment,
+// fixups and encoding (a table lookup per row) always run on the whole IR.
+namespace incremental {
+
+// Bumped whenever TokenType, the IR or this layout changes
+constexpr uint32_t cacheVersion = 3;
+
+// Opcode of lines without a statement (blank or comment only)
+constexpr uint16_t noStatement = 0xFFFF;
+
+struct LineRecord {
+  uint64_t hash;        // of the line text without the '\n', never 0
+  uint32_t operands[2]; // Label operands hold offset | length << 16
+  uint16_t opcode;      // TokenType, or noStatement
+  uint16_t statement;   // offset of the statement in the line
+  uint16_t labelOffset; // label defined on the line
+  uint16_t labelLength; // 0 if there is none
+  uint8_t operandKinds; // as in ir::Program
+  uint8_t reserved[7];
+};
+static_assert(sizeof(LineRecord) == 32, "LineRecord is stored as is");
+
+class LineCache {
+public:
+  // A missing, unreadable or stale file just leaves the cache empty
+  void load(const std::string &path);
+  // Returns false (and logs) if the file could not be written
+  bool save(const std::string &path) const;
+
+  const LineRecord *find(uint64_t hash) const;
+  // Keeps the first record of a hash, lines with the same text share one
+  void add(const LineRecord &record);
+  void clear();
+  size_t size() const { return m_count; }
+
+private:
+  // Open addressing on the line hash itself, hash 0 marks an empty slot
+  std::vector<LineRecord> m_slots;
+  size_t m_count = 0;
+};
+
+struct Stats {
+  size_t lines = 0;
+  size_t reused = 0; // lines taken from the cache instead of being parsed
+};
+
+// Lowers source into code line by line. Lines found in previous are rebuilt
+// from their record, the others go through the lexer and parser (reusing
+// scratch for the AST). Every line without errors is recorded in next, except
+// INCLUDE lines: the included file may change while the line does not, so
+// they are expanded again on every run.
+// Reports duplicate labels itself since cached lines bypass the parser.
+Stats lowerSource(string_view source, const LineCache &previous,
+                  LineCache &next, ir::Program &code,
+                  unique_ptr<ASTProgram> &scratch, Diagnostics &diagnostics,
+                  includes::Context *includes = nullptr);
+
+} // namespace incremental
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <ASTStructs.h>
+#include <cstdint>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Flat instruction IR lowered from the AST.
+// One row per statement, stored as parallel arrays so later passes (sizing,
+// encoding, analysis) walk linear memory instead of chasing node pointers and
+// visiting variants. The AST stays around for ASTProgram::Print().
+namespace ir {
+
+enum class OperandKind : uint8_t {
+  None = 0,
+  Reg,     // 8085 register field: B=0 C=1 D=2 E=3 H=4 L=5 M=6 A=7
+  RegPair, // 8085 register pair field: B=0 D=1 H=2 SP/PSW=3
+  Imm8,
+  Imm16,
+  Label, // index into Program::symbols
+};
+
+constexpr uint32_t noSymbol = UINT32_MAX;
+
+struct Program {
+  // Per-row columns, all of size()
+  vector<TokenType> opcode;      // mnemonic or directive
+  vector<uint8_t> operandKinds;  // first | second << 4
+  vector<uint64_t> operands;     // first | second << 32
+  vector<uint32_t> srcOffset;    // byte offset of the statement in its file
+  vector<int> line;              // source line, for diagnostics
+  vector<uint16_t> file;         // 0 for the source, see includes::Context
+  vector<uint16_t> address;      // filled in by address assignment
+  vector<uint32_t> labelDef;     // symbol defined on this row, or noSymbol
+
+  // Label names, indexed by symbol id
+  vector<string_view> symbols;
+
+  size_t size() const { return opcode.size(); }
+  void reserve(size_t rows);
+  void clear();
+
+  // Appends a row without operands and returns its index. Rows of an
+  // included file are on the line of the INCLUDE.
+  size_t append(TokenType op, int srcLine, uint32_t offset,
+                uint16_t srcFile = 0);
+
+  // Drops the rows flagged in removed, the others keep their order
+  void removeRows(const vector<bool> &removed);
+
+  void setOperand(size_t row, int slot, OperandKind kind, uint32_t value);
+  OperandKind kind(size_t row, int slot) const {
+    return static_cast<OperandKind>((operandKinds[row] >> (4 * slot)) & 0xF);
+  }
+  uint32_t operand(size_t row, int slot) const {
+    return static_cast<uint32_t>(operands[row] >> (32 * slot));
+  }
+
+  // Returns the id of a label name, adding it on first use
+  uint32_t internSymbol(string_view name);
+  // Returns noSymbol for names that were never interned
+  uint32_t findSymbol(string_view name) const;
+
+  void Print() const;
+
+private:
+  unordered_map<string_view, uint32_t> m_symbolIds;
+};
+
+// Register fields as encoded in 8085 opcodes
+uint8_t registerCode(ast::Register reg);
+uint8_t registerPairCode(ast::ExtendedRegister reg);
+
+Program lowerProgram(const ASTProgram &program);
+// Same, but lowers into an existing program whose capacity is reused
+void lowerProgram(const ASTProgram &program, Program &out);
+// Appends the row of one statement and returns its index
+size_t lowerStatement(const ASTStatement &statement, Program &out);
+
+} // namespace ir
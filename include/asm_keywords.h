@@ -0,0 +1,217 @@
+#pragma once
+
+#include <array>
+#include <asm_lexer.h>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+
+// Compile-time perfect hash over the mnemonic and directive set.
+// Each word is folded to upper case and packed into a 64-bit key, a
+// multiplier found at compile time maps every keyword to its own slot, and a
+// single case-insensitive compare confirms the hit. Nothing is built at
+// startup and a lookup never allocates.
+
+struct Keyword {
+  string_view name;
+  TokenType type;
+};
+
+// Ordered like TokenType, so keywordTable[t] describes TokenType t
+inline constexpr Keyword keywordTable[] = {
+    // Data Transfer
+    {"MOV", TokenType::MOV},
+    {"MVI", TokenType::MVI},
+    {"LXI", TokenType::LXI},
+    {"LDA", TokenType::LDA},
+    {"STA", TokenType::STA},
+    {"LHLD", TokenType::LHLD},
+    {"SHLD", TokenType::SHLD},
+    {"LDAX", TokenType::LDAX},
+    {"STAX", TokenType::STAX},
+    {"XCHG", TokenType::XCHG},
+
+    // Arithmetic
+    {"ADD", TokenType::ADD},
+    {"ADI", TokenType::ADI},
+    {"ADC", TokenType::ADC},
+    {"ACI", TokenType::ACI},
+    {"SUB", TokenType::SUB},
+    {"SUI", TokenType::SUI},
+    {"SBB", TokenType::SBB},
+    {"SBI", TokenType::SBI},
+    {"INR", TokenType::INR},
+    {"DCR", TokenType::DCR},
+    {"INX", TokenType::INX},
+    {"DCX", TokenType::DCX},
+    {"DAD", TokenType::DAD},
+    {"DAA", TokenType::DAA},
+
+    // Logical
+    {"ANA", TokenType::ANA},
+    {"ANI", TokenType::ANI},
+    {"XRA", TokenType::XRA},
+    {"XRI", TokenType::XRI},
+    {"ORA", TokenType::ORA},
+    {"ORI", TokenType::ORI},
+    {"CMP", TokenType::CMP},
+    {"CPI", TokenType::CPI},
+    {"RLC", TokenType::RLC},
+    {"RRC", TokenType::RRC},
+    {"RAL", TokenType::RAL},
+    {"RAR", TokenType::RAR},
+    {"CMA", TokenType::CMA},
+    {"CMC", TokenType::CMC},
+    {"STC", TokenType::STC},
+
+    // Branch
+    {"JMP", TokenType::JMP},
+    {"JC", TokenType::JC},
+    {"JNC", TokenType::JNC},
+    {"JZ", TokenType::JZ},
+    {"JNZ", TokenType::JNZ},
+    {"JP", TokenType::JP},
+    {"JM", TokenType::JM},
+    {"JPE", TokenType::JPE},
+    {"JPO", TokenType::JPO},
+    {"CALL", TokenType::CALL},
+    {"CC", TokenType::CC},
+    {"CNC", TokenType::CNC},
+    {"CZ", TokenType::CZ},
+    {"CNZ", TokenType::CNZ},
+    {"CP", TokenType::CP},
+    {"CM", TokenType::CM},
+    {"CPE", TokenType::CPE},
+    {"CPO", TokenType::CPO},
+    {"RET", TokenType::RET},
+    {"RC", TokenType::RC},
+    {"RNC", TokenType::RNC},
+    {"RZ", TokenType::RZ},
+    {"RNZ", TokenType::RNZ},
+    {"RP", TokenType::RP},
+    {"RM", TokenType::RM},
+    {"RPE", TokenType::RPE},
+    {"RPO", TokenType::RPO},
+    {"RST", TokenType::RST},
+    {"PCHL", TokenType::PCHL},
+
+    // Stack & Machine Control
+    {"PUSH", TokenType::PUSH},
+    {"POP", TokenType::POP},
+    {"XTHL", TokenType::XTHL},
+    {"SPHL", TokenType::SPHL},
+    {"IN", TokenType::IN},
+    {"OUT", TokenType::OUT},
+    {"HLT", TokenType::HLT},
+    {"NOP", TokenType::NOP},
+    {"DI", TokenType::DI},
+    {"EI", TokenType::EI},
+    {"RIM", TokenType::RIM},
+    {"SIM", TokenType::SIM},
+
+    // Directives
+    {"ORG", TokenType::ORG},
+    {"DB", TokenType::DB},
+    {"CYCLES", TokenType::CYCLES},
+    {"ENDCYC", TokenType::ENDCYC},
+    {"INCLUDE", TokenType::INCLUDE}};
+
+namespace keyword_detail {
+constexpr size_t slotBits = 9;
+constexpr size_t slotCount = size_t(1) << slotBits;
+constexpr size_t maxLength = 8;
+
+constexpr char foldCase(char c) {
+  return (c >= 'a' && c <= 'z') ? static_cast<char>(c - ('a' - 'A')) : c;
+}
+
+// First maxLength folded characters, little-endian, mixed with the length
+constexpr uint64_t packKey(string_view word) {
+  uint64_t key = word.size();
+  for (size_t i = 0; i < word.size() && i < maxLength; ++i)
+    key ^= static_cast<uint64_t>(static_cast<unsigned char>(foldCase(word[i])))
+           << (8 * i);
+  return key;
+}
+
+constexpr size_t slotOf(uint64_t key, uint64_t multiplier) {
+  return static_cast<size_t>((key * multiplier) >> (64 - slotBits));
+}
+
+constexpr bool collisionFree(uint64_t multiplier) {
+  array<bool, slotCount> used{};
+  for (const Keyword &kw : keywordTable) {
+    size_t slot = slotOf(packKey(kw.name), multiplier);
+    if (used[slot])
+      return false;
+    used[slot] = true;
+  }
+  return true;
+}
+
+// Walks a splitmix64 sequence until an odd multiplier separates every key
+constexpr uint64_t findMultiplier() {
+  uint64_t state = 0x9E3779B97F4A7C15ULL;
+  for (int attempt = 0; attempt < 100000; ++attempt) {
+    state += 0x9E3779B97F4A7C15ULL;
+    uint64_t z = state;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    z = (z ^ (z >> 31)) | 1;
+    if (collisionFree(z))
+      return z;
+  }
+  return 0;
+}
+
+constexpr uint64_t multiplier = findMultiplier();
+static_assert(multiplier != 0, "No perfect hash found for the keyword set");
+
+// Slot -> index + 1 into keywordTable, 0 marks an empty slot
+constexpr array<uint8_t, slotCount> buildSlots() {
+  array<uint8_t, slotCount> slots{};
+  for (size_t i = 0; i < size(keywordTable); ++i)
+    slots[slotOf(packKey(keywordTable[i].name), multiplier)] =
+        static_cast<uint8_t>(i + 1);
+  return slots;
+}
+
+constexpr array<uint8_t, slotCount> slots = buildSlots();
+
+constexpr bool tableMatchesTokenTypes() {
+  for (size_t i = 0; i < size(keywordTable); ++i) {
+    if (static_cast<size_t>(keywordTable[i].type) != i ||
+        keywordTable[i].name.size() > maxLength)
+      return false;
+  }
+  return true;
+}
+static_assert(tableMatchesTokenTypes(),
+              "keywordTable must follow TokenType order");
+} // namespace keyword_detail
+
+// Case-insensitive keyword classification, empty for plain identifiers
+constexpr optional<TokenType> lookupKeyword(string_view word) {
+  using namespace keyword_detail;
+  if (word.empty() || word.size() > maxLength)
+    return {};
+
+  uint8_t entry = slots[slotOf(packKey(word), multiplier)];
+  if (entry == 0)
+    return {};
+
+  const Keyword &kw = keywordTable[entry - 1];
+  if (kw.name.size() != word.size())
+    return {};
+  for (size_t i = 0; i < word.size(); ++i) {
+    if (foldCase(word[i]) != kw.name[i])
+      return {};
+  }
+  return kw.type;
+}
+
+// Canonical spelling of a mnemonic or directive
+constexpr string_view keywordName(TokenType type) {
+  size_t index = static_cast<size_t>(type);
+  return index < size(keywordTable) ? keywordTable[index].name : string_view();
+}
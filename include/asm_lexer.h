@@ -1,11 +1,15 @@
 #pragma once
 
+#include <array>
+#include <cstdint>
 #include <optional>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
 
+#include <Diagnostics.h>
 #include <Logger.h>
 
 using namespace std;
@@ -104,37 +108,116 @@ enum class TokenType : uint16_t {
   // Assembler directives
   ORG,
   DB,
+  CYCLES, // CYCLES n ... ENDCYC, a T-state budget
+  ENDCYC,
+  INCLUDE, // expanded by the parser, never reaches the IR
 
   // Non-instruction tokens
   Identifier, // labels
   Number,     // numeric constants
+  String,     // "text" on one line, rawText keeps the quotes
   Comma,
   Colon,
   EndOfLine,
   EndOfFile
 };
 
+// rawText is a view into the source buffer (offset/length), tokens never own
+// a copy of their text, so the source must outlive every token made from it.
+// Tokens of an included file carry its id and the line of the INCLUDE in the
+// compiled source, offset and column stay those in the included file.
 struct Token {
   TokenType type;
-  string rawText;
+  uint16_t file; // 0 for the compiled source, see includes::Context
+  uint32_t offset;
+  string_view rawText;
   int line;
   int column;
 };
 
 class Lexer {
 public:
-  Lexer(string &src);
-
+  // Errors go to diagnostics, or to the lexer's own list when none is given
+  Lexer(string_view src, Diagnostics *diagnostics = nullptr);
+  // Lexes only src[begin, end), where begin is the start of line firstLine.
+  // Token offsets stay relative to the whole of src.
+  Lexer(string_view src, size_t begin, size_t end, int firstLine,
+        Diagnostics *diagnostics = nullptr);
+  Lexer(const Lexer &) = delete;
+  Lexer &operator=(const Lexer &) = delete;
+
+  // Returns an empty vector if any character could not be lexed
   vector<Token> tokenize();
 
+  // Pull interface: returns one token at a time, ending with EndOfLine and
+  // then EndOfFile forever. An unexpected character is reported and skipped.
+  Token next();
+  bool hasError() const { return m_error; }
+  Diagnostics &diagnostics() { return *m_diagnostics; }
+
 private:
-  string m_source;
+  Diagnostics m_ownDiagnostics;
+  Diagnostics *m_diagnostics;
+  string_view m_source;
   size_t m_pos;
   int m_line;
   int m_col;
+  bool m_error = false;
+  bool m_finalEol = false;
 
-  optional<char> peek();
   char consume();
+  // Consumes every byte up to pos, as found by the scan kernels
+  void advanceTo(size_t pos);
 
-  Token createToken(TokenType ttype, const string &value);
+  // Token for the source text between start and the current position
+  Token createToken(TokenType ttype, size_t start);
+  // Token with synthetic text that is not part of the source
+  Token createToken(TokenType ttype, string_view text);
+};
+
+// Token source for the parser. Either walks a pre-lexed vector, or pulls from
+// a lexer on demand through a small ring buffer, in which case memory stays
+// bounded by the lookahead instead of the size of the file. Included files
+// are spliced in with include(), their tokens come next and the source
+// resumes after them; a vector source goes through the ring from then on.
+class TokenStream {
+public:
+  explicit TokenStream(vector<Token> tokens);
+  explicit TokenStream(Lexer &lexer);
+
+  // next is relative to the current token, -1 is the last consumed one.
+  // A streaming source only keeps the last ringSize tokens around.
+  optional<Token> peek(int next = 0);
+  Token consume();
+
+  // Serves tokens (ending with EndOfFile, which is dropped) before the rest
+  // of the stream, as coming from file and from the given source line.
+  // Nothing past the current token may have been peeked at.
+  void include(const vector<Token> &tokens, uint16_t file, int line);
+  // True while the tokens of file are being served
+  bool including(uint16_t file) const;
+
+private:
+  static constexpr size_t ringSize = 8;
+
+  struct Include {
+    const vector<Token> *tokens;
+    size_t next;
+    uint16_t file;
+    int line;
+  };
+
+  // Next token of the innermost include, or of the source once they ended.
+  // False when a token vector has run out.
+  bool pull(Token &token);
+
+  vector<Token> m_tokens;
+  size_t m_nextToken = 0; // in m_tokens, once they go through the ring
+  bool m_streaming;       // tokens go through the ring
+  Lexer *m_lexer = nullptr;
+  vector<Include> m_includes;
+  array<Token, ringSize> m_ring;
+  size_t m_current = 0; // absolute index of the next token to consume
+  size_t m_pulled = 0;  // number of tokens pulled into the ring so far
+  bool m_done = false;  // EndOfFile was pulled
 };
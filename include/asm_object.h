@@ -0,0 +1,83 @@
+#pragma once
+
+#include <asm_codegen.h>
+#include <asm_image.h>
+#include <asm_ir.h>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Relocatable objects and the linker behind c85 --link.
+// c85 -c assembles a module into an object instead of an image. The code up
+// to the first ORG is the module's relocatable section, the linker decides
+// where it goes; every ORG starts an absolute section that stays where it
+// is. Every label the module defines is exported, labels it uses without
+// defining them are imported. Each label operand is written as a relocation
+// naming its symbol and patched once the linker knows the address.
+//
+// Object layout (ByteStream.h conventions): "C85O", version, then
+//   sections:    relocatable, origin, bytes
+//   symbols:     name, binding, value
+//   relocations: section, offset into it, symbol
+namespace object {
+
+enum class Binding : uint8_t {
+  Import,   // used here, defined by another module
+  Relative, // value is an offset into the relocatable section
+  Absolute, // value is the address, the label follows an ORG
+};
+
+struct Section {
+  bool relocatable;
+  uint16_t origin; // 0 for the relocatable section
+  vector<uint8_t> bytes;
+};
+
+struct Symbol {
+  string name;
+  Binding binding;
+  uint16_t value;
+};
+
+struct Relocation {
+  uint32_t section;
+  uint32_t offset; // of the low byte of the word inside the section
+  uint32_t symbol;
+};
+
+struct Module {
+  string path;
+  vector<Section> sections; // the relocatable one first, if there is one
+  vector<Symbol> symbols;
+  vector<Relocation> relocations;
+
+  // Bytes of the relocatable section, 0 without one
+  uint32_t relocatableSize() const;
+};
+
+// Object contents of a program assembled with relocatable set
+vector<uint8_t> write(const ir::Program &program,
+                      const codegen::MachineCode &code);
+// Takes apart an object file, false if it is not one or is damaged
+bool read(const vector<uint8_t> &data, Module &module);
+
+struct LinkOptions {
+  // Address the relocatable sections are laid out from, in the order the
+  // objects are given. A section that would overlap an absolute one moves
+  // past it.
+  uint16_t base = 0;
+  unsigned threads = 0; // 0 for one per core
+};
+
+// Reads the objects, lays out their sections, resolves every import against
+// the labels the other modules export and applies the relocations. A module
+// resolves a name to its own label first, an import must be defined by
+// exactly one other module. Reading and relocating run in parallel, one
+// module per task. The sections are then placed in image, a section that
+// overwrites another is warned about. Errors are logged, returns false if
+// there were any.
+bool link(const vector<string> &objectFiles, const LinkOptions &options,
+          codegen::MachineCode &out, image::Image &image);
+
+} // namespace object
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <asm_codegen.h>
+#include <asm_image.h>
+#include <string>
+#include <vector>
+
+// Output file writers.
+// Every format is rendered into one buffer whose exact size is computed up
+// front, bytes are turned into hex digits through a lookup table, and the
+// buffer reaches the file with a single write call (no iostreams). The hex
+// dump lists the sections as they were assembled, raw and Intel HEX output
+// come from the pages of the image, where later sections win.
+namespace output {
+
+enum class Format {
+  HexDump,  // "AAAA: XX XX ..." lines, 16 bytes each (default)
+  Raw,      // dense binary image from the lowest to the highest address
+  IntelHex, // Intel HEX data records plus an end-of-file record
+  Object,   // relocatable object for c85 --link, see asm_object.h
+};
+
+// Dense bytes from the lowest to the highest address written, gaps hold the
+// fill byte of the image
+vector<uint8_t> formatRaw(const image::Image &image);
+vector<uint8_t> formatHexDump(const codegen::MachineCode &code);
+// Records for the written runs only, in address order
+vector<uint8_t> formatIntelHex(const image::Image &image);
+
+// Every format but Object, which needs the symbols of the IR. image holds the
+// sections of code.
+vector<uint8_t> formatOutput(const codegen::MachineCode &code,
+                             const image::Image &image, Format format);
+
+// Creates or truncates path and writes data in one call, logs on failure
+bool writeFile(const string &path, const vector<uint8_t> &data);
+
+} // namespace output
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <ASTStructs.h>
+#include <Diagnostics.h>
+#include <ThreadPool.h>
+#include <asm_include.h>
+#include <memory>
+#include <string_view>
+
+// Parallel front end for large sources.
+// A statement never spans more than one line, so the source is cut at
+// newlines into chunks that are lexed and parsed on the pool at the same
+// time, each into an arena of its own. Line numbers come from a parallel
+// newline count done first. The statements are then concatenated in chunk
+// order, and a label defined in two chunks is reported as a duplicate just
+// like the serial parser would.
+
+// Below this size splitting costs more than it saves
+constexpr size_t parallelMinSize = 1 << 20;
+
+// Same result as Parser::parseProgram() on the whole source. INCLUDE lines
+// are expanded by the chunk they are in.
+unique_ptr<ASTProgram> parseParallel(string_view source, ThreadPool &pool,
+                                     Diagnostics &diagnostics,
+                                     unique_ptr<ASTProgram> program = nullptr,
+                                     includes::Context *includes = nullptr);
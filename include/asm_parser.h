@@ -1,6 +1,7 @@
 #pragma once
 
 #include <ASTStructs.h>
+#include <asm_include.h>
 #include <asm_lexer.h>
 #include <memory>
 #include <variant>
@@ -10,18 +11,55 @@ using namespace std;
 
 class Parser {
 public:
-  Parser(vector<Token> &tokens);
-  ast::Ptr<ASTProgram> &parseProgram();
+  // A program from an earlier compilation can be passed in to reuse its
+  // arena, it is reset before parsing starts.
+  // Errors are collected in diagnostics, a line with an error is skipped and
+  // parsing resumes on the next one until the error limit is reached.
+  Parser(vector<Token> &tokens, unique_ptr<ASTProgram> program = nullptr,
+         Diagnostics *diagnostics = nullptr);
+  // Streaming mode, tokens are pulled from the lexer as the parser needs them.
+  // Shares the lexer's diagnostics unless others are given.
+  Parser(Lexer &lexer, unique_ptr<ASTProgram> program = nullptr,
+         Diagnostics *diagnostics = nullptr);
+  Parser(const Parser &) = delete;
+  Parser &operator=(const Parser &) = delete;
+  unique_ptr<ASTProgram> &parseProgram();
+
+  // Parses up to and including the next statement without adding it to the
+  // program, so callers can process statements while the source is scanned.
+  // Returns empty at end of input.
+  optional<ASTStatement> nextStatement();
 
   unordered_map<string, ast::symbolDebugInfo> &getSymbolTable();
 
+  bool hasError() const;
+  Diagnostics &diagnostics() { return *m_diagnostics; }
+
+  // Where INCLUDE finds its files, without one INCLUDE is an error
+  void setIncludes(includes::Context *includes) { m_includes = includes; }
+  // True once an INCLUDE was expanded
+  bool included() const { return m_included; }
+
 private:
   unique_ptr<ASTProgram> m_program;
-  vector<Token> m_tokens;
-  size_t m_currentTokenIndex = 0;
+  TokenStream m_tokens;
+  Diagnostics m_ownDiagnostics;
+  Diagnostics *m_diagnostics;
+  includes::Context *m_includes = nullptr;
+  bool m_included = false;
+  // First token of the line being parsed, tells which file it comes from
+  Token m_lineStart{};
+
+  // Reports an error and abandons the current line
+  [[noreturn]] void error(int line, int column, const char *message, ...);
+
+  // Allocates an AST node in the program's arena
+  template <typename T> ast::Ptr<T> makeNode() {
+    return m_program->arena.make<T>();
+  }
 
   // Parsing functions
-  void parseLine();
+  optional<ASTStatement> parseLine();
 
   ast::Ptr<ASTLabelDef> parseLabelDef();
 
@@ -29,6 +67,9 @@ private:
 
   ast::Ptr<ASTDirective> parseDirective();
 
+  // Checks INCLUDE "file" and opens the file, returns its id
+  uint16_t parseInclude();
+
   ast::Ptr<ASTOperandList>
   parseOpList(const vector<ast::OperandType> &expectTypes);
 
@@ -37,7 +78,7 @@ private:
   template <typename T> T parseNumber();
 
   optional<Token> peek(int next = 0);
-  Token &consume();
+  Token consume();
 
   // Symbol Table, maps label names to line numbers/addresses
   unordered_map<string, ast::symbolDebugInfo> m_symbolTable;
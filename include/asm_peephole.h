@@ -0,0 +1,43 @@
+#pragma once
+
+#include <array>
+#include <asm_ir.h>
+#include <cstddef>
+#include <cstdint>
+
+// Peephole optimizer behind -O, run on the IR between lowering and encoding.
+// Every rule in the rule table matches a short window of consecutive rows and
+// rewrites or drops some of them. A window never reaches past a row that
+// defines a label (other code may jump there) or a directive, so only
+// straight-line code is touched. Label references are resolved after the
+// pass and follow the code; jumps to numeric addresses are not adjusted.
+// After the window rules, the control-flow passes in asm_cfg.h thread jumps
+// and drop unreachable code, they are reported like rules.
+namespace peephole {
+
+// The window rules, then jump threading and unreachable code
+constexpr size_t ruleCount = 8;
+
+// Name of a rule for the report, e.g. "tail-call"
+const char *ruleName(size_t rule);
+
+struct RuleStats {
+  uint32_t rewrites = 0;
+  uint32_t bytes = 0;   // code size saved
+  uint64_t tStates = 0; // saved once per rewritten site, not per execution
+};
+
+struct Report {
+  bool enabled = false; // the pass ran, even if nothing matched
+  array<RuleStats, ruleCount> rules{};
+
+  RuleStats total() const;
+  // Logs the totals and the rules that matched
+  void print(const string &fileName) const;
+};
+
+// Applies the rules until none matches any more, then the control-flow
+// passes. exported keeps every labeled block of a relocatable object.
+Report optimize(ir::Program &program, bool exported = false);
+
+} // namespace peephole
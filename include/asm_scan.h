@@ -0,0 +1,68 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// Byte classification and bulk scanning kernels used by the lexer.
+// The table replaces the locale-dependent <cctype> calls (it matches the "C"
+// locale), and the kernels consume whole runs of bytes 16 (SSE2) or 32 (AVX2)
+// at a time, falling back to the table on other targets.
+namespace scan {
+
+enum CharClass : uint8_t {
+  Space = 1 << 0,      // isspace() except '\n', which ends a line
+  Newline = 1 << 1,    // '\n'
+  Alpha = 1 << 2,      // starts an identifier
+  Digit = 1 << 3,      // starts a number
+  IdentTail = 1 << 4,  // continues an identifier: letters and '_'
+  NumberTail = 1 << 5, // continues a number: digits and the 'H' suffix
+};
+
+constexpr std::array<uint8_t, 256> buildCharClasses() {
+  std::array<uint8_t, 256> table{};
+  for (int c = 0; c < 256; ++c) {
+    uint8_t cls = 0;
+    bool upper = c >= 'A' && c <= 'Z';
+    bool lower = c >= 'a' && c <= 'z';
+    bool digit = c >= '0' && c <= '9';
+
+    if (c == ' ' || c == '\t' || c == '\v' || c == '\f' || c == '\r')
+      cls |= Space;
+    if (c == '\n')
+      cls |= Newline;
+    if (upper || lower)
+      cls |= Alpha | IdentTail;
+    if (c == '_')
+      cls |= IdentTail;
+    if (digit)
+      cls |= Digit | NumberTail;
+    if (c == 'H' || c == 'h')
+      cls |= NumberTail;
+    table[c] = cls;
+  }
+  return table;
+}
+
+inline constexpr std::array<uint8_t, 256> charClasses = buildCharClasses();
+
+inline uint8_t classOf(char c) {
+  return charClasses[static_cast<unsigned char>(c)];
+}
+
+// Each kernel returns the index of the first byte in [pos, end) that does not
+// belong to the run, or end if the run reaches the end of the buffer.
+
+// Skips blanks other than '\n'
+size_t skipSpaces(const char *src, size_t pos, size_t end);
+
+// Finds the '\n' that ends a comment
+size_t findNewline(const char *src, size_t pos, size_t end);
+
+// Finds the end of an identifier tail (letters and '_')
+size_t skipIdentifier(const char *src, size_t pos, size_t end);
+
+// Number of '\n' bytes in [pos, end)
+size_t countNewlines(const char *src, size_t pos, size_t end);
+
+} // namespace scan
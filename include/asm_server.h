@@ -0,0 +1,31 @@
+#pragma once
+
+#include <asm_driver.h>
+#include <optional>
+#include <string>
+
+// Resident compile server.
+// `c85 --server` listens on a local Unix socket and compiles requests with
+// workspaces (AST arenas, IR and code buffers) that stay warm between them,
+// so a build that runs c85 thousands of times pays for process start-up only
+// in the small client. Every message is a 32-bit length followed by that many
+// bytes. A request carries the options and either a source path or the
+// source text itself; the reply carries the result, the structured
+// diagnostics and any other log output. The client writes the output file.
+// Not available on Windows, where c85 always compiles in-process.
+
+// $C85_SOCKET if set, otherwise c85.sock in $XDG_RUNTIME_DIR or in a
+// c85-<uid> directory in the temp directory. The default directory must be
+// owned by the user and closed to everyone else, and either end of a
+// connection only talks to a process of the same user.
+string defaultSocketPath();
+
+// Serves until interrupted, returns the process exit code
+int runServer(const string &socketPath);
+
+// Forwards one compilation to a running server. Returns empty when no server
+// answers, the caller then compiles in-process.
+optional<CompileResult> compileRemote(const string &socketPath,
+                                      const string &sourceFile,
+                                      const string &outputFile,
+                                      const CompileOptions &options);
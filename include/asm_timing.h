@@ -0,0 +1,123 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+// 8085 instruction timing in T-states, shared by the emulator and the passes
+// that estimate or compare execution time.
+// tStates holds the time of every documented opcode, for conditional jumps,
+// calls and returns the time when the condition fails; takenExtra is what a
+// taken one costs on top. The undocumented opcodes (DSUB, ARHL, RDEL, LDHI,
+// LDSI, RSTV, SHLX, JNK, LHLX, JK) are never emitted and have time 0.
+namespace timing {
+
+constexpr bool isDocumented(uint8_t op) {
+  switch (op) {
+  case 0x08: case 0x10: case 0x18: case 0x28: case 0x38:
+  case 0xCB: case 0xD9: case 0xDD: case 0xED: case 0xFD:
+    return false;
+  default:
+    return true;
+  }
+}
+
+constexpr uint8_t opcodeTStates(uint8_t op) {
+  if (!isDocumented(op))
+    return 0;
+
+  bool memory = (op & 0x07) == 6 || ((op >> 3) & 0x07) == 6;
+  if (op == 0x76) // HLT, where MOV M, M would be
+    return 5;
+  if (op >= 0x40 && op < 0x80) // MOV
+    return memory ? 7 : 4;
+  if (op >= 0x80 && op < 0xC0) // register and M arithmetic and logic
+    return (op & 0x07) == 6 ? 7 : 4;
+
+  if (op < 0x40) {
+    switch (op & 0x0F) {
+    case 0x01: // LXI
+    case 0x09: // DAD
+      return 10;
+    case 0x02: // STAX, SHLD, STA
+    case 0x0A: // LDAX, LHLD, LDA
+      return op < 0x20 ? 7 : op < 0x30 ? 16 : 13;
+    case 0x03: // INX
+    case 0x0B: // DCX
+      return 6;
+    case 0x04: // INR
+    case 0x05: // DCR
+    case 0x0C:
+    case 0x0D:
+      return ((op >> 3) & 0x07) == 6 ? 10 : 4;
+    case 0x06: // MVI
+    case 0x0E:
+      return ((op >> 3) & 0x07) == 6 ? 10 : 7;
+    default: // NOP, RIM, SIM, rotates, DAA, CMA, STC, CMC
+      return 4;
+    }
+  }
+
+  switch (op & 0x07) {
+  case 0: // Rcc
+    return 6;
+  case 1: // POP, RET, PCHL, SPHL
+    if (op == 0xE9 || op == 0xF9)
+      return 6;
+    return 10;
+  case 2: // Jcc
+    return 7;
+  case 3:
+    if (op == 0xE3) // XTHL
+      return 16;
+    if (op == 0xEB || op == 0xF3 || op == 0xFB) // XCHG, DI, EI
+      return 4;
+    return 10; // JMP, OUT, IN
+  case 4: // Ccc
+    return 9;
+  case 5: // PUSH, CALL
+    return op == 0xCD ? 18 : 12;
+  case 6: // immediate arithmetic and logic
+    return 7;
+  default: // RST
+    return 12;
+  }
+}
+
+constexpr uint8_t opcodeTakenExtra(uint8_t op) {
+  if (op < 0xC0)
+    return 0;
+  switch (op & 0x07) {
+  case 0: // Rcc: 6 / 12
+    return 6;
+  case 2: // Jcc: 7 / 10
+    return 3;
+  case 4: // Ccc: 9 / 18
+    return 9;
+  default:
+    return 0;
+  }
+}
+
+constexpr std::array<uint8_t, 256> buildTable(uint8_t (*time)(uint8_t)) {
+  std::array<uint8_t, 256> table{};
+  for (int op = 0; op < 256; ++op)
+    table[op] = time(static_cast<uint8_t>(op));
+  return table;
+}
+
+inline constexpr std::array<uint8_t, 256> tStates = buildTable(opcodeTStates);
+inline constexpr std::array<uint8_t, 256> takenExtra =
+    buildTable(opcodeTakenExtra);
+
+// Spot checks against the 8085 data sheet
+static_assert(tStates[0x00] == 4 && tStates[0x41] == 4 && tStates[0x46] == 7);
+static_assert(tStates[0x36] == 10 && tStates[0x34] == 10 && tStates[0x3C] == 4);
+static_assert(tStates[0x2A] == 16 && tStates[0x3A] == 13 && tStates[0x0A] == 7);
+static_assert(tStates[0xC3] == 10 && tStates[0xC2] == 7 && tStates[0xCD] == 18);
+static_assert(tStates[0xC9] == 10 && tStates[0xC0] == 6 && tStates[0xC7] == 12);
+static_assert(tStates[0xE3] == 16 && tStates[0xE9] == 6 && tStates[0xF5] == 12);
+static_assert(tStates[0x76] == 5 && tStates[0xDB] == 10 && tStates[0x20] == 4);
+static_assert(takenExtra[0xCA] == 3 && takenExtra[0xCC] == 9 &&
+              takenExtra[0xC8] == 6 && takenExtra[0xC3] == 0);
+
+} // namespace timing
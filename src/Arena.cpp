@@ -0,0 +1,82 @@
+#include <Arena.h>
+#include <algorithm>
+#include <cstdint>
+
+Arena::Arena(size_t blockSize) : m_blockSize(blockSize) {}
+
+Arena::Arena(Arena &&other) noexcept { *this = std::move(other); }
+
+Arena &Arena::operator=(Arena &&other) noexcept {
+  if (this == &other)
+    return *this;
+
+  m_blocks = std::move(other.m_blocks);
+  m_current = other.m_current;
+  m_ptr = other.m_ptr;
+  m_end = other.m_end;
+  m_blockSize = other.m_blockSize;
+  m_allocated = other.m_allocated;
+
+  other.m_blocks.clear();
+  other.m_current = 0;
+  other.m_ptr = nullptr;
+  other.m_end = nullptr;
+  other.m_allocated = 0;
+  return *this;
+}
+
+void *Arena::allocate(size_t size, size_t align) {
+  auto alignUp = [align](std::byte *p) {
+    uintptr_t addr = reinterpret_cast<uintptr_t>(p);
+    return (addr + align - 1) & ~static_cast<uintptr_t>(align - 1);
+  };
+
+  uintptr_t start = alignUp(m_ptr);
+  if (!m_ptr || start + size > reinterpret_cast<uintptr_t>(m_end)) {
+    nextBlock(size + align);
+    start = alignUp(m_ptr);
+  }
+
+  m_ptr = reinterpret_cast<std::byte *>(start + size);
+  m_allocated += size;
+  return reinterpret_cast<void *>(start);
+}
+
+void Arena::reset() {
+  m_allocated = 0;
+  m_current = 0;
+  if (m_blocks.empty()) {
+    m_ptr = m_end = nullptr;
+    return;
+  }
+  m_ptr = m_blocks[0].data.get();
+  m_end = m_ptr + m_blocks[0].size;
+}
+
+size_t Arena::bytesAllocated() const { return m_allocated; }
+
+size_t Arena::bytesReserved() const {
+  size_t total = 0;
+  for (const Block &block : m_blocks)
+    total += block.size;
+  return total;
+}
+
+void Arena::nextBlock(size_t minSize) {
+  // Blocks kept by reset() are reused before anything new is allocated
+  size_t next = m_ptr ? m_current + 1 : 0;
+  while (next < m_blocks.size() && m_blocks[next].size < minSize)
+    ++next;
+
+  if (next >= m_blocks.size()) {
+    size_t size = std::max(m_blockSize, minSize);
+    // Plain new[] so the block is not zeroed up front
+    m_blocks.push_back(
+        {std::unique_ptr<std::byte[]>(new std::byte[size]), size});
+    next = m_blocks.size() - 1;
+  }
+
+  m_current = next;
+  m_ptr = m_blocks[next].data.get();
+  m_end = m_ptr + m_blocks[next].size;
+}
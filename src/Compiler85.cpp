@@ -3,66 +3,213 @@
 #include <Compiler85.h>
 using namespace std;
 
+#ifndef DEBUG
+static void printUsage() {
+  Logger::fmtLog(LogLevel::Info,
+                 "\n\tUsage: c85 <sourceFile> <outputFile> [-r | -x] "
+                 "[--max-errors=<n>] [--incremental] [--no-server]"
+                 "\n\t       [-O] [--cycle-report] [--fill=<hex>] "
+                 "[--cache-dir=<dir>] [--cache-size=<MiB>]"
+                 "\n\t       c85 -c <sourceFile> <objectFile> [flags]"
+                 "\n\t       c85 --link <objectFile>... <outputFile> [-r | -x] "
+                 "[--base=<hex>] [--fill=<hex>]"
+                 "\n\t       c85 --batch <manifest> [flags]"
+                 "\n\t       c85 --batch <sourceFile> <outputFile>... [flags]"
+                 "\n\t       c85 --run <sourceFile> [<outputFile>] "
+                 "[--run-limit=<n>] [--hot=<n>]"
+                 "\n\t       c85 --server"
+                 "\n\t-j <threads>: threads for batch mode and for large "
+                 "sources"
+                 "\n\t--time-report, --trace=<file>: time every phase");
+}
+
+static int run(const vector<string> &paths, CompileOptions &options,
+               bool batch, bool useServer, unsigned threads, bool execute,
+               const RunOptions &runOptions, bool link,
+               object::LinkOptions &linkOptions) {
+  if (link) {
+    // An object is no image, it cannot be linked into another
+    if (paths.size() < 2 || options.format == output::Format::Object) {
+      printUsage();
+      return 1;
+    }
+    linkOptions.threads = threads;
+    vector<string> objectFiles(paths.begin(), paths.end() - 1);
+    return linkFiles(objectFiles, paths.back(), options.format, options.fill,
+                     linkOptions)
+               ? 0
+               : 1;
+  }
+
+  if (batch) {
+    vector<BatchJob> jobs;
+    if (paths.size() == 1) {
+      if (!readManifest(paths[0], jobs))
+        return 1;
+    } else if (!paths.empty() && paths.size() % 2 == 0) {
+      for (size_t i = 0; i < paths.size(); i += 2)
+        jobs.push_back({paths[i], paths[i + 1]});
+    } else {
+      printUsage();
+      return 1;
+    }
+
+    size_t failures = compileBatch(jobs, options, threads);
+    if (failures)
+      Logger::fmtLog(LogLevel::Error, "%zu of %zu files failed", failures,
+                     jobs.size());
+    return failures ? 1 : 0;
+  }
+
+  if (execute) {
+    if (paths.empty() || paths.size() > 2 ||
+        options.format == output::Format::Object) {
+      printUsage();
+      return 1;
+    }
+    options.threads = threads;
+    return runFile(paths[0], paths.size() == 2 ? paths[1] : string(), options,
+                   runOptions)
+               ? 0
+               : 1;
+  }
+
+  if (paths.size() != 2) {
+    printUsage();
+    return 1;
+  }
+  const string &sourceFile = paths[0];
+  const string &outputFile = paths[1];
+  options.threads = threads;
+
+  // Let a running server do the work, it has everything warmed up already
+  if (useServer) {
+    if (optional<CompileResult> result = compileRemote(
+            defaultSocketPath(), sourceFile, outputFile, options))
+      return finishFile(*result, sourceFile, outputFile) ? 0 : 1;
+  }
+  return compileFile(sourceFile, outputFile, options) ? 0 : 1;
+}
+#endif // !DEBUG
+
 int main(int argv, char *argc[]) {
-  // Usage: c85 <sourceFile> <outputFile> <flag>?
-  // flag: -r -> output file is raw binary, otherwise output is .hex format
-  string sourceFile;
-  string outputFile;
-  bool rawBinary = false;
+  // Usage: c85 <sourceFile> <outputFile> <flags>...
+  // flags: -r -> output file is raw binary, -x -> Intel HEX, otherwise output
+  // is a readable hex-dump, -c a relocatable object. --fill=<hex> is the
+  // byte between sections of raw output.
+  // --max-errors=<n> stops after n errors (0 = all).
+  // --batch compiles the pairs listed in a manifest, or given on the command
+  // line, in parallel on -j threads (default: one per core). Without --batch,
+  // -j is the number of threads a large source is lexed and parsed with.
+  // --incremental only reparses lines changed since the last run.
+  // --link links objects into an image, relocatable code starts at --base.
+  // -O runs the peephole optimizer and reports what it saved.
+  // --cycle-report logs the T-states of every instruction, block, subroutine,
+  // loop and CYCLES region; it compiles in-process.
+  // --server keeps a compile server running, single files are then sent to
+  // it unless --no-server is given.
+  // --cache-dir (or C85_CACHE_DIR) keeps finished outputs keyed by the source
+  // contents and flags, --cache-size caps it in MiB.
+  // --time-report prints the time spent in every phase, --trace=<file> writes
+  // the phases as Chrome trace events. Both compile in-process.
+  // --run executes the program on the emulator until HLT or --run-limit
+  // instructions and reports the --hot=<n> hottest loops (0 = no profiling).
+  CompileOptions options;
 
 #ifdef DEBUG
+  string sourceFile;
+  string outputFile;
   Logger::fmtLog("Debug mode: No command line arguments required.");
   Logger::fmtLog("Enter the filepath of the source file: ");
+  Logger::Flush();
   cin >> sourceFile;
   Logger::fmtLog("Enter the filepath of the output file: ");
+  Logger::Flush();
   cin >> outputFile;
-  rawBinary = true;
-#else
-  if (argv < 3) {
-    Logger::fmtLog(LogLevel::Info, "\n\tUsage: c85 <sourceFile> <outputFile>");
-    return 1;
-  }
-  sourceFile = argc[1];
-  outputFile = argc[2];
-  if (argv > 3)
-    rawBinary = (string(argc[3]) == "-r");
-#endif // !DEBUG
+  options.format = output::Format::Raw;
+  options.dump = true;
 
-  // Read source file
-  string src;
-  {
-    ifstream srcFile(sourceFile);
-    if (srcFile.fail()) {
-      Logger::fmtLog(LogLevel::Error, "Failed to open source file: %s",
-                     sourceFile.c_str());
+  return compileFile(sourceFile, outputFile, options) ? 0 : 1;
+#else
+  vector<string> paths;
+  bool batch = false;
+  bool server = false;
+  bool useServer = true;
+  bool timeReport = false;
+  bool execute = false;
+  RunOptions runOptions;
+  bool link = false;
+  object::LinkOptions linkOptions;
+  string tracePath;
+  unsigned threads = 0;
+  if (const char *cacheDir = getenv("C85_CACHE_DIR"))
+    options.cacheDir = cacheDir;
+  for (int i = 1; i < argv; ++i) {
+    string flag = argc[i];
+    if (flag == "-r")
+      options.format = output::Format::Raw;
+    else if (flag == "-x")
+      options.format = output::Format::IntelHex;
+    else if (flag == "-c")
+      options.format = output::Format::Object;
+    else if (flag.rfind("--fill=", 0) == 0)
+      options.fill =
+          static_cast<uint8_t>(strtoul(flag.c_str() + 7, nullptr, 16));
+    else if (flag == "-O")
+      options.optimize = true;
+    else if (flag == "--cycle-report")
+      options.cycleReport = true;
+    else if (flag.rfind("--max-errors=", 0) == 0)
+      options.errorLimit = strtoul(flag.c_str() + 13, nullptr, 10);
+    else if (flag == "--incremental")
+      options.incremental = true;
+    else if (flag.rfind("--cache-dir=", 0) == 0)
+      options.cacheDir = flag.substr(12);
+    else if (flag.rfind("--cache-size=", 0) == 0)
+      options.cacheMaxBytes = strtoull(flag.c_str() + 13, nullptr, 10) << 20;
+    else if (flag == "--batch")
+      batch = true;
+    else if (flag == "--server")
+      server = true;
+    else if (flag == "--no-server")
+      useServer = false;
+    else if (flag == "--time-report")
+      timeReport = true;
+    else if (flag.rfind("--trace=", 0) == 0)
+      tracePath = flag.substr(8);
+    else if (flag == "--run")
+      execute = true;
+    else if (flag == "--link")
+      link = true;
+    else if (flag.rfind("--base=", 0) == 0)
+      linkOptions.base =
+          static_cast<uint16_t>(strtoul(flag.c_str() + 7, nullptr, 16));
+    else if (flag.rfind("--run-limit=", 0) == 0)
+      runOptions.instructionLimit = strtoull(flag.c_str() + 12, nullptr, 10);
+    else if (flag.rfind("--hot=", 0) == 0)
+      runOptions.hotLoops = strtoul(flag.c_str() + 6, nullptr, 10);
+    else if (flag == "-j" && i + 1 < argv)
+      threads = static_cast<unsigned>(strtoul(argc[++i], nullptr, 10));
+    else if (flag.size() > 1 && flag[0] == '-') {
+      Logger::fmtLog(LogLevel::Error, "Unknown flag: %s", flag.c_str());
       return 1;
-    }
-    src = string((istreambuf_iterator<char>(srcFile)),
-                 istreambuf_iterator<char>());
+    } else
+      paths.push_back(move(flag));
   }
 
-  // Lexical analysis
-  Lexer asmLexer(src);
-  vector<Token> tokens = asmLexer.tokenize();
+  if (server)
+    return runServer(defaultSocketPath());
 
-  // AST Parser
-  Parser asmParser(tokens);
-  ast::Ptr<ASTProgram> program = move(asmParser.parseProgram());
-#ifdef DEBUG
-  if (program)
-    program->Print();
-  else {
-    Logger::fmtLog(LogLevel::Error, "Program was null!");
-    return 1;
-  }
-#else
-  if (!program) {
-    Logger::fmtLog(LogLevel::Error, "Program was null!");
-    return 1;
-  }
-#endif // DEBUG
-  // TODO: Further compilation steps would go here (machine code gen, symbol
-  // resolution)
+  // The phases and the cycle report would otherwise run in the server, out of
+  // reach of the probes and the terminal
+  Profiler::start(timeReport, tracePath);
+  if (Profiler::enabled() || options.cycleReport)
+    useServer = false;
 
-  return 0;
+  int status = run(paths, options, batch, useServer, threads, execute,
+                   runOptions, link, linkOptions);
+  if (!Profiler::finish())
+    status = 1;
+  return status;
+#endif // !DEBUG
 }
@@ -0,0 +1,135 @@
+#include <Diagnostics.h>
+#include <Logger.h>
+#include <algorithm>
+#include <cstdio>
+#include <iterator>
+
+Diagnostics::Diagnostics(size_t errorLimit) : m_errorLimit(errorLimit) {}
+
+void Diagnostics::error(int line, int column, const char *message, ...) {
+  va_list args;
+  va_start(args, message);
+  report(Severity::Error, line, column, message, args);
+  va_end(args);
+}
+
+void Diagnostics::warning(int line, int column, const char *message, ...) {
+  va_list args;
+  va_start(args, message);
+  report(Severity::Warning, line, column, message, args);
+  va_end(args);
+}
+
+void Diagnostics::includedError(uint16_t file, int fileLine, int line,
+                                const char *message, ...) {
+  va_list args;
+  va_start(args, message);
+  add(Severity::Error, line, -1, file, fileLine, message, args);
+  va_end(args);
+}
+
+void Diagnostics::report(Severity severity, int line, int column,
+                         const char *message, va_list args) {
+  add(severity, line, column, 0, line, message, args);
+}
+
+bool Diagnostics::countError(uint16_t file, int fileLine) {
+  if (limitReached() ||
+      (file == m_lastErrorFile && fileLine == m_lastErrorLine))
+    return false;
+  m_lastErrorFile = file;
+  m_lastErrorLine = fileLine;
+  m_errorCount++;
+  return true;
+}
+
+void Diagnostics::add(Severity severity, int line, int column, uint16_t file,
+                      int fileLine, const char *message, va_list args) {
+  if (severity == Severity::Error) {
+    if (!countError(file, fileLine))
+      return;
+  } else {
+    m_warningCount++;
+  }
+
+  va_list copy;
+  va_copy(copy, args);
+  int length = vsnprintf(nullptr, 0, message, copy);
+  va_end(copy);
+
+  std::string text(length > 0 ? length : 0, '\0');
+  if (length > 0)
+    vsnprintf(text.data(), text.size() + 1, message, args);
+  m_diagnostics.push_back(
+      {severity, line, column, std::move(text), file, fileLine});
+}
+
+void Diagnostics::append(const Diagnostics &other) {
+  for (const Diagnostic &diagnostic : other.m_diagnostics) {
+    if (diagnostic.severity == Severity::Error) {
+      if (limitReached())
+        continue;
+      m_errorCount++;
+      m_lastErrorFile = diagnostic.file;
+      m_lastErrorLine = diagnostic.fileLine;
+    } else {
+      m_warningCount++;
+    }
+    m_diagnostics.push_back(diagnostic);
+  }
+}
+
+void Diagnostics::merge(const Diagnostics &other) {
+  std::vector<Diagnostic> own = std::move(m_diagnostics);
+  std::vector<Diagnostic> merged;
+  merged.reserve(own.size() + other.m_diagnostics.size());
+  // On a tie the other pass came first, the lexer runs ahead of the parser
+  std::merge(other.m_diagnostics.begin(), other.m_diagnostics.end(),
+             own.begin(), own.end(), std::back_inserter(merged),
+             [](const Diagnostic &a, const Diagnostic &b) {
+               return a.line != b.line ? a.line < b.line : a.column < b.column;
+             });
+
+  clear();
+  for (Diagnostic &diagnostic : merged) {
+    if (diagnostic.severity == Severity::Error) {
+      if (!countError(diagnostic.file, diagnostic.fileLine))
+        continue;
+    } else {
+      m_warningCount++;
+    }
+    m_diagnostics.push_back(std::move(diagnostic));
+  }
+}
+
+void Diagnostics::sortByLine() {
+  std::stable_sort(m_diagnostics.begin(), m_diagnostics.end(),
+                   [](const Diagnostic &a, const Diagnostic &b) {
+                     return a.line < b.line;
+                   });
+}
+
+void Diagnostics::clear() {
+  m_diagnostics.clear();
+  m_errorCount = 0;
+  m_warningCount = 0;
+  m_lastErrorFile = 0;
+  m_lastErrorLine = -1;
+}
+
+void Diagnostics::print(const std::string &fileName) const {
+  for (const Diagnostic &diagnostic : m_diagnostics) {
+    LogLevel level = diagnostic.severity == Severity::Error ? LogLevel::Error
+                                                            : LogLevel::Warning;
+    if (diagnostic.column >= 0)
+      Logger::fmtLog(level, "%s:%d:%d: %s", fileName.c_str(), diagnostic.line,
+                     diagnostic.column + 1, diagnostic.message.c_str());
+    else
+      Logger::fmtLog(level, "%s:%d: %s", fileName.c_str(), diagnostic.line,
+                     diagnostic.message.c_str());
+  }
+
+  if (limitReached())
+    Logger::fmtLog(LogLevel::Error, "Too many errors, stopped after %zu",
+                   m_errorLimit);
+}
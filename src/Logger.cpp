@@ -1,7 +1,59 @@
 #include <Logger.h>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+
+#ifdef _WIN32
+#include <io.h>
+#define isatty _isatty
+#define fileno _fileno
+#else
+#include <unistd.h>
+#endif
 
 // Set default value of _level
-LogLevel Logger::_level = LogLevel::Info;
+std::atomic<LogLevel> Logger::_level = LogLevel::Info;
+
+// A thread's buffer is written out once it holds this much
+static constexpr size_t flushSize = 16 * 1024;
+
+// Errors go out right away with what came before them, a long-running
+// thread (a server connection) must not hold them back
+static bool shouldFlush(LogLevel level, const std::string &text) {
+  return level == LogLevel::Error || text.size() >= flushSize;
+}
+
+static std::mutex s_writeLock;
+
+static void writeOut(std::string &text) {
+  if (text.empty())
+    return;
+  std::lock_guard<std::mutex> lock(s_writeLock);
+  fwrite(text.data(), 1, text.size(), stdout);
+  fflush(stdout);
+  text.clear();
+}
+
+// Messages of the calling thread not yet written, or being captured (see
+// BeginCapture()). Whatever is left is written when the thread ends.
+struct ThreadBuffer {
+  std::string text;
+  bool capturing = false;
+  bool color = Logger::UseColor();
+
+  ~ThreadBuffer() {
+    if (!capturing)
+      writeOut(text);
+  }
+};
+
+static thread_local ThreadBuffer t_buffer;
+
+// Level prefixes, plain and with color
+static constexpr const char *prefixes[2][4] = {
+    {"[INFO]: ", "[WARN]: ", "[ERROR]: ", ""},
+    {BLUE_COLOR "[INFO]: " RESET_COLOR, YELLOW_COLOR "[WARN]: " RESET_COLOR,
+     RED_COLOR "[ERROR]: " RESET_COLOR, ""}};
 
 // Constructor
 Logger::Logger() {}
@@ -9,84 +61,88 @@ Logger::Logger() {}
 // Public Functions
 void Logger::Log(const std::string &message) /*Assume the log level to be none*/
 {
-  std::cout << GREEN_COLOR << "[] " << RESET_COLOR << message;
+  Append(t_buffer.color ? GREEN_COLOR "[] " RESET_COLOR : "[] ", message);
 }
 
-void Logger::Log(LogLevel level, const std::string &message) {
-  if (level < _level)
-    return;
-  switch (level) {
-  case Info:
-    LogInfo(message);
-    break;
-  case Warning:
-    LogWarning(message);
-    break;
-  case Error:
-    LogError(message);
-    break;
-  case None:
-    std::cout << RESET_COLOR << message;
-    break;
-  default:
-    break;
-  }
-}
+void Logger::Raw(std::string_view text) { Append("", text); }
 
-void Logger::fmtLog(LogLevel level, const char *const message, ...) {
-  if (level < _level)
-    return;
+void Logger::Flush() {
+  if (!t_buffer.capturing)
+    writeOut(t_buffer.text);
+}
 
-  va_list args;
-  va_start(args, message);
-  switch (level) {
-  case Info:
-    std::cout << BLUE_COLOR << "[INFO]: " << RESET_COLOR;
-    vprintf(message, args);
-
-    break;
-  case Warning:
-    std::cout << YELLOW_COLOR << "[WARN]: " << RESET_COLOR;
-    vprintf(message, args);
-    break;
-  case Error:
-    std::cout << RED_COLOR << "[ERROR]: " << RESET_COLOR;
-    vprintf(message, args);
-    break;
-  case None:
-
-    vprintf(message, args);
-    break;
-  }
-  va_end(args);
-  printf("\n");
+void Logger::SetLogLevel(LogLevel level) {
+  _level.store(level, std::memory_order_relaxed);
 }
 
-void Logger::fmtLog(const char *message,
-                    ...) /* Assume the log level to be none */
-{
-  va_list args;
-  va_start(args, message);
-  vprintf(message, args);
-  va_end(args);
+LogLevel Logger::GetLogLevel() {
+  return _level.load(std::memory_order_relaxed);
+}
 
-  printf("\n");
+bool Logger::UseColor() {
+  static const bool color = isatty(fileno(stdout)) && !getenv("NO_COLOR");
+  return color;
 }
 
-void Logger::SetLogLevel(LogLevel level) { _level = level; }
+void Logger::BeginCapture() { BeginCapture(UseColor()); }
 
-LogLevel Logger::GetLogLevel() { return _level; }
+void Logger::BeginCapture(bool color) {
+  // Messages from before the capture are not part of it
+  Flush();
+  t_buffer.capturing = true;
+  t_buffer.color = color;
+}
+
+std::string Logger::EndCapture() {
+  t_buffer.capturing = false;
+  t_buffer.color = UseColor();
+  return std::move(t_buffer.text);
+}
 
 // Private Functions
-void Logger::LogInfo(const std::string &message) {
-  std::cout << BLUE_COLOR << "[INFO]: " << RESET_COLOR << message << std::endl;
+void Logger::Format(LogLevel level, const char *message, ...) {
+  std::string &text = t_buffer.text;
+  text += prefixes[t_buffer.color][level];
+
+  // Short messages are formatted on the stack, longer ones straight into the
+  // buffer once their length is known
+  char local[512];
+  va_list args;
+  va_start(args, message);
+  va_list copy;
+  va_copy(copy, args);
+  int length = vsnprintf(local, sizeof(local), message, copy);
+  va_end(copy);
+  if (length > 0 && static_cast<size_t>(length) < sizeof(local)) {
+    text.append(local, length);
+  } else if (length > 0) {
+    size_t start = text.size();
+    text.resize(start + length);
+    vsnprintf(text.data() + start, length + 1, message, args);
+  }
+  va_end(args);
+
+  text += '\n';
+  if (!t_buffer.capturing && shouldFlush(level, text))
+    writeOut(text);
 }
 
-void Logger::LogWarning(const std::string &message) {
-  std::cout << YELLOW_COLOR << "[WARN]: " << RESET_COLOR << message
-            << std::endl;
+void Logger::Put(LogLevel level, std::string_view message) {
+  // None keeps the text as is, the other levels make it a line
+  if (level == None) {
+    Append(t_buffer.color ? RESET_COLOR : "", message);
+    return;
+  }
+  Append(prefixes[t_buffer.color][level], message);
+  Append("", "\n");
+  if (level == LogLevel::Error)
+    Flush();
 }
 
-void Logger::LogError(const std::string &message) {
-  std::cout << RED_COLOR << "[ERROR]: " << RESET_COLOR << message << std::endl;
+void Logger::Append(const char *prefix, std::string_view text) {
+  std::string &buffer = t_buffer.text;
+  buffer += prefix;
+  buffer += text;
+  if (!t_buffer.capturing && buffer.size() >= flushSize)
+    writeOut(buffer);
 }
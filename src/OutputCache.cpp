@@ -0,0 +1,212 @@
+#include <Hash.h>
+#include <OutputCache.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <thread>
+
+namespace fs = std::filesystem;
+
+struct EntryHeader {
+  char magic[4];
+  uint32_t version;
+  uint64_t key;
+};
+
+static constexpr char entryMagic[4] = {'C', '8', '5', 'C'};
+static constexpr uint32_t entryVersion = 6;
+static constexpr string_view entryExtension = ".c85o";
+
+// Running size of the entries, kept next to them so that a store only
+// updates this file instead of listing the directory. Writers in other
+// processes can lose each other's updates, so the directory is still walked
+// every rescanInterval stores, besides whenever the size passes the cap.
+struct UsageIndex {
+  char magic[4];
+  uint32_t version;
+  uint64_t bytes;  // of all entries
+  uint64_t stores; // since the directory was last walked
+};
+
+static constexpr char usageMagic[4] = {'C', '8', '5', 'U'};
+static constexpr string_view usageFile = "usage";
+static constexpr uint64_t rescanInterval = 1024;
+
+OutputCache::OutputCache(std::string directory, uint64_t maxBytes)
+    : m_directory(move(directory)), m_maxBytes(maxBytes) {}
+
+uint64_t OutputCache::key(string_view source, const CompileOptions &options) {
+  uint64_t seed = hashBytes(compilerVersion.data(), compilerVersion.size());
+  uint32_t settings[4] = {static_cast<uint32_t>(options.format),
+                          static_cast<uint32_t>(options.errorLimit),
+                          options.optimize, options.fill};
+  seed = hashBytes(settings, sizeof(settings), seed);
+  // The same INCLUDE names other files elsewhere
+  seed = hashBytes(options.includeDir.data(), options.includeDir.size(), seed);
+  return hashBytes(source.data(), source.size(), seed);
+}
+
+std::string OutputCache::path(uint64_t key) const {
+  char name[17];
+  snprintf(name, sizeof(name), "%016llx",
+           static_cast<unsigned long long>(key));
+  return (fs::path(m_directory) / name).string() + string(entryExtension);
+}
+
+bool OutputCache::load(uint64_t key, CompileResult &result,
+                       size_t errorLimit) const {
+  std::string file = path(key);
+  ifstream in(file, ios::binary | ios::ate);
+  if (!in)
+    return false;
+
+  vector<uint8_t> data(static_cast<size_t>(in.tellg()));
+  in.seekg(0);
+  if (data.size() < sizeof(EntryHeader) ||
+      !in.read(reinterpret_cast<char *>(data.data()), data.size()))
+    return false;
+  in.close();
+
+  // The key is checked as well, a file copied under another name is a miss
+  EntryHeader header;
+  memcpy(&header, data.data(), sizeof(header));
+  if (memcmp(header.magic, entryMagic, sizeof(entryMagic)) != 0 ||
+      header.version != entryVersion || header.key != key)
+    return false;
+
+  ByteReader reader(data);
+  for (size_t i = 0; i < sizeof(header); ++i)
+    reader.u8();
+  if (!readResult(reader, result, errorLimit))
+    return false;
+  // An included file that changed since makes the entry stale
+  for (const includes::Dependency &dependency : result.dependencies) {
+    if (!includes::isCurrent(dependency))
+      return false;
+  }
+
+  error_code ec;
+  fs::last_write_time(file, fs::file_time_type::clock::now(), ec);
+  return true;
+}
+
+void OutputCache::store(uint64_t key, const CompileResult &result) const {
+  error_code ec;
+  fs::create_directories(m_directory, ec);
+
+  EntryHeader header;
+  memcpy(header.magic, entryMagic, sizeof(entryMagic));
+  header.version = entryVersion;
+  header.key = key;
+  ByteWriter writer;
+  writer.bytes(&header, sizeof(header));
+  writeResult(writer, result);
+
+  std::string file = path(key);
+  // The entry may replace an older one of the same key
+  uintmax_t replaced = fs::file_size(file, ec);
+  if (ec)
+    replaced = 0;
+  if (!writeAtomically(file, writer.data()))
+    return;
+
+  UsageIndex usage;
+  bool known = readUsage(usage);
+  usage.bytes -= min<uint64_t>(replaced, usage.bytes);
+  usage.bytes += writer.data().size();
+  if (!known || usage.bytes > m_maxBytes || ++usage.stores >= rescanInterval) {
+    usage.bytes = evict();
+    usage.stores = 0;
+  }
+  writeUsage(usage);
+}
+
+bool OutputCache::writeAtomically(const std::string &file,
+                                  const vector<uint8_t> &data) {
+  // Unique per process and call, concurrent writers of one file never share
+  // a temporary file and the last rename wins
+  static atomic<uint64_t> counter{0};
+  uint64_t now = static_cast<uint64_t>(
+      chrono::steady_clock::now().time_since_epoch().count());
+  uint64_t salt[3] = {now, counter++,
+                      std::hash<thread::id>()(this_thread::get_id())};
+  char suffix[24];
+  snprintf(suffix, sizeof(suffix), ".%016llx",
+           static_cast<unsigned long long>(hashBytes(salt, sizeof(salt))));
+
+  error_code ec;
+  std::string temporary = file + suffix;
+  {
+    ofstream out(temporary, ios::binary | ios::trunc);
+    if (!out)
+      return false;
+    if (!out.write(reinterpret_cast<const char *>(data.data()), data.size())) {
+      out.close();
+      fs::remove(temporary, ec);
+      return false;
+    }
+  }
+  fs::rename(temporary, file, ec);
+  if (ec) {
+    fs::remove(temporary, ec);
+    return false;
+  }
+  return true;
+}
+
+bool OutputCache::readUsage(UsageIndex &usage) const {
+  usage = UsageIndex{};
+  ifstream in(fs::path(m_directory) / usageFile, ios::binary);
+  return in && in.read(reinterpret_cast<char *>(&usage), sizeof(usage)) &&
+         memcmp(usage.magic, usageMagic, sizeof(usageMagic)) == 0 &&
+         usage.version == entryVersion;
+}
+
+void OutputCache::writeUsage(UsageIndex usage) const {
+  memcpy(usage.magic, usageMagic, sizeof(usageMagic));
+  usage.version = entryVersion;
+  vector<uint8_t> data(sizeof(usage));
+  memcpy(data.data(), &usage, sizeof(usage));
+  writeAtomically((fs::path(m_directory) / usageFile).string(), data);
+}
+
+uint64_t OutputCache::evict() const {
+  struct Entry {
+    fs::path path;
+    fs::file_time_type time;
+    uint64_t size;
+  };
+
+  error_code ec;
+  vector<Entry> entries;
+  uint64_t total = 0;
+  for (fs::directory_iterator it(m_directory, ec), end; !ec && it != end;
+       it.increment(ec)) {
+    if (it->path().extension() != entryExtension)
+      continue;
+    error_code entryEc;
+    uint64_t size = it->file_size(entryEc);
+    fs::file_time_type time = it->last_write_time(entryEc);
+    if (entryEc)
+      continue;
+    entries.push_back({it->path(), time, size});
+    total += size;
+  }
+  if (total <= m_maxBytes)
+    return total;
+
+  // Down to 90% of the cap, so the next stores stay below it without walking
+  // the directory again
+  uint64_t target = m_maxBytes / 10 * 9;
+  sort(entries.begin(), entries.end(),
+       [](const Entry &a, const Entry &b) { return a.time < b.time; });
+  for (const Entry &entry : entries) {
+    if (total <= target)
+      break;
+    if (fs::remove(entry.path, ec))
+      total -= entry.size;
+  }
+  return total;
+}
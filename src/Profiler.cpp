@@ -0,0 +1,203 @@
+#include <Logger.h>
+#include <Profiler.h>
+#include <algorithm>
+#include <asm_output.h>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+std::atomic<bool> Profiler::s_enabled = false;
+
+struct Span {
+  const char *name;
+  uint64_t begin;
+  uint64_t end;
+  size_t bytes;
+  size_t peakRss;
+  std::string detail;
+};
+
+// Spans of one thread, only that thread appends to it. finish() reads them
+// after the workers are done, the pool hands their results back under a lock.
+struct ThreadSpans {
+  unsigned id;
+  std::vector<Span> spans;
+};
+
+static std::chrono::steady_clock::time_point s_origin;
+static bool s_timeReport = false;
+static std::string s_tracePath;
+
+static std::mutex s_threadsLock;
+static std::vector<std::unique_ptr<ThreadSpans>> s_threads;
+static thread_local ThreadSpans *t_spans = nullptr;
+
+static size_t peakRss() {
+#ifdef _WIN32
+  PROCESS_MEMORY_COUNTERS counters;
+  if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+    return 0;
+  return counters.PeakWorkingSetSize;
+#else
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0)
+    return 0;
+#ifdef __APPLE__
+  return static_cast<size_t>(usage.ru_maxrss);
+#else
+  return static_cast<size_t>(usage.ru_maxrss) * 1024;
+#endif
+#endif
+}
+
+void Profiler::start(bool timeReport, const std::string &tracePath) {
+  s_timeReport = timeReport;
+  s_tracePath = tracePath;
+  s_origin = std::chrono::steady_clock::now();
+  s_enabled.store(timeReport || !tracePath.empty(),
+                  std::memory_order_relaxed);
+}
+
+uint64_t Profiler::now() {
+  return static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::microseconds>(
+          std::chrono::steady_clock::now() - s_origin)
+          .count());
+}
+
+void Profiler::record(const char *name, uint64_t begin, uint64_t end,
+                      size_t bytes, std::string_view detail) {
+  if (!t_spans) {
+    std::lock_guard<std::mutex> guard(s_threadsLock);
+    s_threads.push_back(std::make_unique<ThreadSpans>());
+    t_spans = s_threads.back().get();
+    t_spans->id = static_cast<unsigned>(s_threads.size() - 1);
+  }
+  t_spans->spans.push_back(
+      {name, begin, end, bytes, peakRss(), std::string(detail)});
+}
+
+static void appendJsonString(std::string &out, std::string_view text) {
+  out += '"';
+  for (char c : text) {
+    if (c == '"' || c == '\\') {
+      out += '\\';
+      out += c;
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      char escaped[8];
+      snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+      out += escaped;
+    } else {
+      out += c;
+    }
+  }
+  out += '"';
+}
+
+static bool writeTrace(const std::string &path) {
+  std::string json = "{\"traceEvents\":[\n";
+  char number[160];
+  bool first = true;
+  for (const auto &thread : s_threads) {
+    snprintf(number, sizeof(number),
+             "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,"
+             "\"args\":{\"name\":\"%s %u\"}}",
+             first ? "" : ",\n", thread->id,
+             thread->id ? "worker" : "main", thread->id);
+    json += number;
+    first = false;
+
+    for (const Span &span : thread->spans) {
+      json += ",\n{\"name\":";
+      appendJsonString(json, span.name);
+      snprintf(number, sizeof(number),
+               ",\"cat\":\"c85\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,"
+               "\"ts\":%llu,\"dur\":%llu,\"args\":{\"bytes\":%zu,"
+               "\"peakRss\":%zu",
+               thread->id, static_cast<unsigned long long>(span.begin),
+               static_cast<unsigned long long>(span.end - span.begin),
+               span.bytes, span.peakRss);
+      json += number;
+      if (!span.detail.empty()) {
+        json += ",\"file\":";
+        appendJsonString(json, span.detail);
+      }
+      json += "}}";
+    }
+  }
+  json += "\n]}\n";
+  return output::writeFile(path,
+                           std::vector<uint8_t>(json.begin(), json.end()));
+}
+
+static void printReport(uint64_t total) {
+  struct Phase {
+    const char *name;
+    uint64_t first;
+    size_t calls = 0;
+    uint64_t time = 0;
+    size_t bytes = 0;
+    size_t peakRss = 0;
+  };
+
+  // Summed over every thread and file, listed in the order phases first ran
+  std::vector<Phase> phases;
+  for (const auto &thread : s_threads)
+    for (const Span &span : thread->spans) {
+      auto phase = std::find_if(
+          phases.begin(), phases.end(), [&](const Phase &p) {
+            return std::string_view(p.name) == span.name;
+          });
+      if (phase == phases.end()) {
+        phases.push_back({span.name, span.begin});
+        phase = phases.end() - 1;
+      }
+      phase->first = std::min(phase->first, span.begin);
+      phase->calls++;
+      phase->time += span.end - span.begin;
+      phase->bytes += span.bytes;
+      phase->peakRss = std::max(phase->peakRss, span.peakRss);
+    }
+  std::sort(phases.begin(), phases.end(),
+            [](const Phase &a, const Phase &b) { return a.first < b.first; });
+
+  Logger::fmtLog(LogLevel::Info, "Time report:");
+  Logger::fmtLog("%-12s %7s %11s %11s %10s %12s", "phase", "calls", "wall ms",
+                 "MB", "MB/s", "peak RSS MB");
+  for (const Phase &phase : phases) {
+    // Phases without a size (one file of a batch) only get a time
+    char mb[16] = "-", rate[16] = "-";
+    if (phase.bytes) {
+      snprintf(mb, sizeof(mb), "%.3f", phase.bytes / 1e6);
+      if (phase.time)
+        snprintf(rate, sizeof(rate), "%.1f",
+                 phase.bytes / (phase.time / 1e6) / 1e6);
+    }
+    Logger::fmtLog("%-12s %7zu %11.3f %11s %10s %12.1f", phase.name,
+                   phase.calls, phase.time / 1e3, mb, rate,
+                   phase.peakRss / 1e6);
+  }
+  Logger::fmtLog("%-12s %7s %11.3f %11s %10s %12.1f", "total", "",
+                 total / 1e3, "", "", peakRss() / 1e6);
+}
+
+bool Profiler::finish() {
+  if (!enabled())
+    return true;
+  uint64_t total = now();
+  s_enabled.store(false, std::memory_order_relaxed);
+
+  std::lock_guard<std::mutex> guard(s_threadsLock);
+  if (s_timeReport)
+    printReport(total);
+  return s_tracePath.empty() || writeTrace(s_tracePath);
+}
@@ -0,0 +1,138 @@
+#include <Logger.h>
+#include <SourceFile.h>
+#include <fstream>
+#include <iterator>
+#include <utility>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Maps the whole file read-only, returns nullptr if mapping is not possible
+static const char *mapFile(const std::string &path, size_t &size) {
+#ifdef _WIN32
+  HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ,
+                            nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL,
+                            nullptr);
+  if (file == INVALID_HANDLE_VALUE)
+    return nullptr;
+
+  LARGE_INTEGER fileSize;
+  if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+    CloseHandle(file);
+    return nullptr;
+  }
+
+  HANDLE mapping =
+      CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  CloseHandle(file);
+  if (!mapping)
+    return nullptr;
+
+  // The view keeps the mapping alive after the handle is closed
+  void *data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+  CloseHandle(mapping);
+  if (!data)
+    return nullptr;
+
+  size = static_cast<size_t>(fileSize.QuadPart);
+  return static_cast<const char *>(data);
+#else
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    return nullptr;
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0) {
+    ::close(fd);
+    return nullptr;
+  }
+
+  void *data = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ,
+                    MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (data == MAP_FAILED)
+    return nullptr;
+
+#ifdef MADV_SEQUENTIAL
+  // The lexer reads the file front to back exactly once
+  madvise(data, static_cast<size_t>(st.st_size), MADV_SEQUENTIAL);
+#endif
+
+  size = static_cast<size_t>(st.st_size);
+  return static_cast<const char *>(data);
+#endif
+}
+
+static void unmapFile(const char *data, size_t size) {
+#ifdef _WIN32
+  (void)size;
+  UnmapViewOfFile(data);
+#else
+  munmap(const_cast<char *>(data), size);
+#endif
+}
+
+SourceFile::~SourceFile() { close(); }
+
+SourceFile::SourceFile(SourceFile &&other) noexcept {
+  *this = std::move(other);
+}
+
+SourceFile &SourceFile::operator=(SourceFile &&other) noexcept {
+  if (this == &other)
+    return *this;
+
+  close();
+  m_mapped = other.m_mapped;
+  m_size = other.m_size;
+  m_fallback = std::move(other.m_fallback);
+  // The fallback buffer may have moved, so re-point into our own copy
+  m_data = m_mapped ? other.m_data : m_fallback.data();
+
+  other.m_data = nullptr;
+  other.m_size = 0;
+  other.m_mapped = false;
+  return *this;
+}
+
+bool SourceFile::open(const std::string &path) {
+  close();
+
+  size_t size = 0;
+  if (const char *data = mapFile(path, size)) {
+    m_data = data;
+    m_size = size;
+    m_mapped = true;
+    return true;
+  }
+
+  // Empty files, pipes and special files cannot be mapped, read them instead
+  std::ifstream srcFile(path, std::ios::binary);
+  if (srcFile.fail()) {
+    Logger::fmtLog(LogLevel::Error, "Failed to open source file: %s",
+                   path.c_str());
+    return false;
+  }
+  m_fallback.assign(std::istreambuf_iterator<char>(srcFile),
+                    std::istreambuf_iterator<char>());
+  m_data = m_fallback.data();
+  m_size = m_fallback.size();
+  return true;
+}
+
+void SourceFile::close() {
+  if (m_mapped)
+    unmapFile(m_data, m_size);
+
+  m_data = nullptr;
+  m_size = 0;
+  m_mapped = false;
+  m_fallback.clear();
+}
@@ -0,0 +1,88 @@
+#include <ThreadPool.h>
+#include <algorithm>
+
+ThreadPool::ThreadPool(unsigned threads) {
+  if (threads == 0)
+    threads = std::max(1u, std::thread::hardware_concurrency());
+
+  for (unsigned i = 0; i < threads; ++i)
+    m_queues.push_back(std::make_unique<Queue>());
+  for (unsigned i = 0; i < threads; ++i)
+    m_threads.emplace_back(&ThreadPool::run, this, i);
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> guard(m_lock);
+    m_stop = true;
+  }
+  m_wake.notify_all();
+  for (std::thread &thread : m_threads)
+    thread.join();
+}
+
+void ThreadPool::parallelFor(
+    size_t count, const std::function<void(size_t, unsigned)> &task) {
+  if (count == 0)
+    return;
+
+  // Neighbouring indices go to the same worker, stealing evens out the rest
+  size_t workers = m_queues.size();
+  for (size_t w = 0; w < workers; ++w) {
+    std::lock_guard<std::mutex> guard(m_queues[w]->lock);
+    for (size_t i = w * count / workers; i < (w + 1) * count / workers; ++i)
+      m_queues[w]->indices.push_back(i);
+  }
+
+  std::unique_lock<std::mutex> lock(m_lock);
+  m_task = &task;
+  m_busy = static_cast<unsigned>(workers);
+  m_round++;
+  m_wake.notify_all();
+  m_done.wait(lock, [this] { return m_busy == 0; });
+  m_task = nullptr;
+}
+
+void ThreadPool::run(unsigned worker) {
+  uint64_t seen = 0;
+  while (true) {
+    const std::function<void(size_t, unsigned)> *task;
+    {
+      std::unique_lock<std::mutex> lock(m_lock);
+      m_wake.wait(lock, [&] { return m_stop || m_round != seen; });
+      if (m_stop)
+        return;
+      seen = m_round;
+      task = m_task;
+    }
+
+    size_t index;
+    while (takeTask(worker, index))
+      (*task)(index, worker);
+
+    std::lock_guard<std::mutex> guard(m_lock);
+    if (--m_busy == 0)
+      m_done.notify_one();
+  }
+}
+
+bool ThreadPool::takeTask(unsigned worker, size_t &index) {
+  size_t workers = m_queues.size();
+  for (size_t k = 0; k < workers; ++k) {
+    Queue &queue = *m_queues[(worker + k) % workers];
+    std::lock_guard<std::mutex> guard(queue.lock);
+    if (queue.indices.empty())
+      continue;
+
+    // Own queue from the front, victims from the back
+    if (k == 0) {
+      index = queue.indices.front();
+      queue.indices.pop_front();
+    } else {
+      index = queue.indices.back();
+      queue.indices.pop_back();
+    }
+    return true;
+  }
+  return false;
+}
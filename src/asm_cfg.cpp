@@ -0,0 +1,286 @@
+#include <asm_cfg.h>
+#include <asm_codegen.h>
+#include <asm_timing.h>
+#include <cstdio>
+#include <unordered_map>
+
+namespace cfg {
+
+static constexpr uint32_t noRow = UINT32_MAX;
+
+Flow flowOf(TokenType op) {
+  switch (op) {
+  case TokenType::JMP:
+    return Flow::Jump;
+  case TokenType::JC:
+  case TokenType::JNC:
+  case TokenType::JZ:
+  case TokenType::JNZ:
+  case TokenType::JP:
+  case TokenType::JM:
+  case TokenType::JPE:
+  case TokenType::JPO:
+    return Flow::Branch;
+  case TokenType::CALL:
+    return Flow::Call;
+  case TokenType::CC:
+  case TokenType::CNC:
+  case TokenType::CZ:
+  case TokenType::CNZ:
+  case TokenType::CP:
+  case TokenType::CM:
+  case TokenType::CPE:
+  case TokenType::CPO:
+    return Flow::CondCall;
+  case TokenType::RET:
+    return Flow::Return;
+  case TokenType::RC:
+  case TokenType::RNC:
+  case TokenType::RZ:
+  case TokenType::RNZ:
+  case TokenType::RP:
+  case TokenType::RM:
+  case TokenType::RPE:
+  case TokenType::RPO:
+    return Flow::CondReturn;
+  case TokenType::RST:
+    return Flow::Restart;
+  case TokenType::PCHL:
+    return Flow::Indirect;
+  case TokenType::HLT:
+    return Flow::Halt;
+  default:
+    return Flow::Next;
+  }
+}
+
+static bool fallsThrough(Flow flow) {
+  return flow != Flow::Jump && flow != Flow::Return &&
+         flow != Flow::Indirect && flow != Flow::Halt;
+}
+
+static bool hasTarget(Flow flow) {
+  return flow == Flow::Jump || flow == Flow::Branch || flow == Flow::Call ||
+         flow == Flow::CondCall;
+}
+
+// Row defining every symbol, noRow for the undefined ones
+static vector<uint32_t> symbolRows(const ir::Program &program) {
+  vector<uint32_t> rows(program.symbols.size(), noRow);
+  for (size_t row = 0; row < program.size(); ++row) {
+    if (program.labelDef[row] != ir::noSymbol)
+      rows[program.labelDef[row]] = static_cast<uint32_t>(row);
+  }
+  return rows;
+}
+
+Graph build(const ir::Program &program, bool exported) {
+  Graph graph;
+  size_t rows = program.size();
+  graph.blockOf.assign(rows, noBlock);
+
+  for (size_t row = 0; row < rows; ++row) {
+    TokenType op = program.opcode[row];
+    bool leader = row == 0 || program.labelDef[row] != ir::noSymbol ||
+                  op == TokenType::ORG || op == TokenType::CYCLES ||
+                  op == TokenType::ENDCYC ||
+                  flowOf(program.opcode[row - 1]) != Flow::Next;
+    if (leader) {
+      if (!graph.blocks.empty())
+        graph.blocks.back().end = static_cast<uint32_t>(row);
+      graph.blocks.push_back({static_cast<uint32_t>(row), 0});
+    }
+    graph.blockOf[row] = static_cast<uint32_t>(graph.blocks.size() - 1);
+  }
+  if (!graph.blocks.empty())
+    graph.blocks.back().end = static_cast<uint32_t>(rows);
+
+  // Blocks that numeric targets can name
+  unordered_map<uint32_t, uint32_t> originBlock;
+  vector<bool> entry(graph.blocks.size(), false);
+  if (!graph.blocks.empty())
+    entry[0] = true;
+  for (size_t row = 0; row < rows; ++row) {
+    if (program.opcode[row] == TokenType::ORG) {
+      originBlock.try_emplace(program.operand(row, 0), graph.blockOf[row]);
+      entry[graph.blockOf[row]] = true;
+    } else if (program.opcode[row] == TokenType::DB ||
+               (exported && program.labelDef[row] != ir::noSymbol)) {
+      entry[graph.blockOf[row]] = true;
+    }
+  }
+
+  vector<uint32_t> symbolRow = symbolRows(program);
+  auto symbolBlock = [&](uint32_t symbol) {
+    return symbolRow[symbol] == noRow ? noBlock
+                                      : graph.blockOf[symbolRow[symbol]];
+  };
+  auto addressBlock = [&](uint32_t address) {
+    auto it = originBlock.find(address);
+    return it == originBlock.end() ? noBlock : it->second;
+  };
+
+  // Labels used as data may be jumped to through PCHL or a table
+  for (size_t row = 0; row < rows; ++row) {
+    if (hasTarget(flowOf(program.opcode[row])))
+      continue;
+    for (int slot = 0; slot < 2; ++slot) {
+      if (program.kind(row, slot) != ir::OperandKind::Label)
+        continue;
+      if (uint32_t block = symbolBlock(program.operand(row, slot));
+          block != noBlock)
+        entry[block] = true;
+    }
+  }
+
+  for (uint32_t index = 0; index < graph.blocks.size(); ++index) {
+    Block &block = graph.blocks[index];
+    uint32_t last = block.end - 1;
+    Flow flow = flowOf(program.opcode[last]);
+    if (fallsThrough(flow) && block.end < rows)
+      block.next = graph.blockOf[block.end];
+
+    if (hasTarget(flow)) {
+      uint32_t value = program.operand(last, 0);
+      block.target = program.kind(last, 0) == ir::OperandKind::Label
+                         ? symbolBlock(value)
+                         : addressBlock(value);
+    } else if (flow == Flow::Restart) {
+      block.target = addressBlock(program.operand(last, 0) * 8);
+    }
+    if ((hasTarget(flow) || flow == Flow::Restart) &&
+        block.target == noBlock) {
+      block.unknownTarget = true;
+      graph.complete = false;
+    }
+  }
+
+  for (uint32_t index = 0; index < entry.size(); ++index) {
+    if (entry[index])
+      graph.entries.push_back(index);
+  }
+  return graph;
+}
+
+vector<bool> Graph::reachable() const {
+  vector<bool> seen(blocks.size(), false);
+  vector<uint32_t> work;
+  for (uint32_t index : entries) {
+    seen[index] = true;
+    work.push_back(index);
+  }
+  while (!work.empty()) {
+    const Block &block = blocks[work.back()];
+    work.pop_back();
+    for (uint32_t successor : {block.next, block.target}) {
+      if (successor != noBlock && !seen[successor]) {
+        seen[successor] = true;
+        work.push_back(successor);
+      }
+    }
+  }
+  return seen;
+}
+
+void Graph::Print(const ir::Program &program) const {
+  printf("The control-flow graph is dumped below:\n");
+  vector<bool> isEntry(blocks.size(), false);
+  for (uint32_t index : entries)
+    isEntry[index] = true;
+  for (uint32_t index = 0; index < blocks.size(); ++index) {
+    const Block &block = blocks[index];
+    printf("  B%-5u rows %u-%u, line %d%s", index, block.first,
+           block.end - 1, program.line[block.first],
+           isEntry[index] ? ", entry" : "");
+    if (block.next != noBlock)
+      printf(", next B%u", block.next);
+    if (block.target != noBlock)
+      printf(", target B%u", block.target);
+    else if (block.unknownTarget)
+      printf(", target unknown");
+    printf("\n");
+  }
+  printf("\n");
+}
+
+void threadJumps(ir::Program &program, peephole::RuleStats &stats) {
+  vector<uint32_t> symbolRow = symbolRows(program);
+  uint8_t jumpTime =
+      timing::tStates[codegen::opcodeInfo(TokenType::JMP).opcode];
+
+  // Follow chains of labels that stand on a JMP. A chain longer than the
+  // number of symbols is a cycle of jumps and is left as it is.
+  for (size_t row = 0; row < program.size(); ++row) {
+    if (!hasTarget(flowOf(program.opcode[row])) ||
+        program.kind(row, 0) != ir::OperandKind::Label)
+      continue;
+
+    ir::OperandKind kind = ir::OperandKind::Label;
+    uint32_t value = program.operand(row, 0);
+    size_t hops = 0;
+    while (kind == ir::OperandKind::Label && symbolRow[value] != noRow &&
+           program.opcode[symbolRow[value]] == TokenType::JMP &&
+           hops <= program.symbols.size()) {
+      uint32_t at = symbolRow[value];
+      kind = program.kind(at, 0);
+      value = program.operand(at, 0);
+      ++hops;
+    }
+    if (hops == 0 || hops > program.symbols.size())
+      continue;
+
+    program.setOperand(row, 0, kind, value);
+    ++stats.rewrites;
+    stats.tStates += hops * jumpTime;
+  }
+
+  // A jump to the row right after it does nothing either way. A labeled
+  // jump stays, its label has nowhere to go.
+  vector<bool> removed(program.size(), false);
+  bool any = false;
+  for (size_t row = 0; row + 1 < program.size(); ++row) {
+    Flow flow = flowOf(program.opcode[row]);
+    if ((flow != Flow::Jump && flow != Flow::Branch) ||
+        program.kind(row, 0) != ir::OperandKind::Label ||
+        program.labelDef[row] != ir::noSymbol ||
+        symbolRow[program.operand(row, 0)] != row + 1)
+      continue;
+
+    removed[row] = any = true;
+    ++stats.rewrites;
+    stats.bytes += codegen::opcodeInfo(program.opcode[row]).size;
+    stats.tStates += timing::tStates[codegen::opcodeByte(program, row)];
+  }
+  if (any)
+    program.removeRows(removed);
+}
+
+void removeUnreachable(ir::Program &program, peephole::RuleStats &stats,
+                       bool exported) {
+  Graph graph = build(program, exported);
+  if (!graph.complete)
+    return;
+
+  vector<bool> live = graph.reachable();
+  vector<bool> removed(program.size(), false);
+  bool any = false;
+  for (uint32_t index = 0; index < graph.blocks.size(); ++index) {
+    if (live[index])
+      continue;
+    const Block &block = graph.blocks[index];
+    for (uint32_t row = block.first; row < block.end; ++row) {
+      // A CYCLES region keeps its bounds even when its code goes
+      if (program.opcode[row] == TokenType::CYCLES ||
+          program.opcode[row] == TokenType::ENDCYC)
+        continue;
+      removed[row] = true;
+      stats.bytes += codegen::opcodeInfo(program.opcode[row]).size;
+    }
+    ++stats.rewrites;
+    any = true;
+  }
+  if (any)
+    program.removeRows(removed);
+}
+
+} // namespace cfg
@@ -0,0 +1,184 @@
+#include <asm_codegen.h>
+#include <asm_include.h>
+#include <cstdarg>
+#include <cstdio>
+
+namespace codegen {
+
+static constexpr uint32_t addressSpace = 0x10000;
+
+// A 16-bit operand waiting for its label to be defined
+struct Fixup {
+  uint32_t position; // of the low byte in MachineCode::bytes
+  uint32_t next;     // previous fixup for the same symbol, or noFixup
+  uint32_t symbol;
+  uint32_t row; // of the operand
+};
+
+static constexpr uint32_t noFixup = UINT32_MAX;
+
+static void patchWord(vector<uint8_t> &bytes, uint32_t position,
+                      uint16_t value) {
+  bytes[position] = static_cast<uint8_t>(value & 0xFF);
+  bytes[position + 1] = static_cast<uint8_t>(value >> 8);
+}
+
+// Errors of a row from an included file are reported at the INCLUDE, naming
+// the place in the file, the same as the parser does
+static void rowError(Diagnostics &diagnostics, const ir::Program &program,
+                     const includes::Context *includes, size_t row,
+                     const char *message, ...) {
+  va_list args;
+  va_start(args, message);
+  if (uint16_t id = program.file[row]; id && includes) {
+    char text[512];
+    vsnprintf(text, sizeof(text), message, args);
+    const includes::File &file = includes->file(id);
+    int fileLine = file.lineOf(program.srcOffset[row]);
+    diagnostics.includedError(id, fileLine, program.line[row], "%s:%d: %s",
+                              file.path.c_str(), fileLine, text);
+  } else {
+    diagnostics.report(Severity::Error, program.line[row], -1, message, args);
+  }
+  va_end(args);
+}
+
+uint8_t opcodeByte(const ir::Program &program, size_t row) {
+  const OpcodeInfo &info = opcodeInfo(program.opcode[row]);
+  uint8_t opcode = info.opcode;
+  for (int slot = 0; slot < 2; ++slot) {
+    ir::OperandKind kind = program.kind(row, slot);
+    if (kind != ir::OperandKind::None && kind != ir::OperandKind::Label &&
+        info.field[slot] != noField)
+      opcode |= static_cast<uint8_t>(program.operand(row, slot)
+                                     << info.field[slot]);
+  }
+  return opcode;
+}
+
+bool generateCode(ir::Program &program, MachineCode &out,
+                  Diagnostics &diagnostics, bool relocatable,
+                  const includes::Context *includes) {
+  size_t symbolCount = program.symbols.size();
+  out.bytes.clear();
+  out.sections.clear();
+  out.relocations.clear();
+  out.symbolAddress.assign(symbolCount, 0);
+  out.symbolDefined.assign(symbolCount, false);
+  out.bytes.reserve(program.size() * 2);
+
+  // Head of the unresolved fixup chain of every symbol
+  vector<uint32_t> pending(symbolCount, noFixup);
+  vector<Fixup> fixups;
+
+  bool ok = true;
+  bool newSection = true;
+  uint32_t pc = 0;
+  for (size_t row = 0; row < program.size(); ++row) {
+    TokenType op = program.opcode[row];
+    const OpcodeInfo &info = opcodeInfo(op);
+
+    // ORG emits nothing, the next byte starts a section at the new address
+    if (op == TokenType::ORG) {
+      pc = program.operand(row, 0);
+      newSection = true;
+    }
+    program.address[row] = static_cast<uint16_t>(pc);
+
+    if (uint32_t symbol = program.labelDef[row]; symbol != ir::noSymbol) {
+      if (out.symbolDefined[symbol]) {
+        string_view name = program.symbols[symbol];
+        rowError(diagnostics, program, includes, row, "Label '%.*s' redefined",
+                 (int)name.size(), name.data());
+        ok = false;
+      }
+      out.symbolAddress[symbol] = static_cast<uint16_t>(pc);
+      out.symbolDefined[symbol] = true;
+
+      // Backpatch every earlier forward reference to this label
+      for (uint32_t f = pending[symbol]; f != noFixup; f = fixups[f].next)
+        patchWord(out.bytes, fixups[f].position, static_cast<uint16_t>(pc));
+      pending[symbol] = noFixup;
+    }
+
+    if (info.size == 0)
+      continue;
+
+    if (pc + info.size > addressSpace) {
+      rowError(diagnostics, program, includes, row,
+               "Code runs past the end of the 64KB address space");
+      return false;
+    }
+
+    if (newSection) {
+      out.sections.push_back(
+          {static_cast<uint16_t>(pc), static_cast<uint32_t>(out.bytes.size()),
+           0, program.line[row]});
+      newSection = false;
+    }
+
+    uint32_t position = static_cast<uint32_t>(out.bytes.size());
+    uint8_t opcode = info.opcode;
+    uint32_t immediate = 0;
+    for (int slot = 0; slot < 2; ++slot) {
+      ir::OperandKind kind = program.kind(row, slot);
+      if (kind == ir::OperandKind::None)
+        continue;
+
+      uint32_t value = program.operand(row, slot);
+      if (kind == ir::OperandKind::Label) {
+        // Labels are always a 16-bit immediate right after the opcode
+        if (relocatable)
+          out.relocations.push_back({position + 1, value});
+        if (!out.symbolDefined[value]) {
+          fixups.push_back({position + 1, pending[value], value,
+                            static_cast<uint32_t>(row)});
+          pending[value] = static_cast<uint32_t>(fixups.size() - 1);
+        }
+        value = out.symbolAddress[value];
+      }
+
+      if (info.field[slot] != noField)
+        opcode |= static_cast<uint8_t>(value << info.field[slot]);
+      else
+        immediate = value;
+    }
+
+    out.bytes.push_back(opcode);
+    if (info.size >= 2)
+      out.bytes.push_back(static_cast<uint8_t>(immediate & 0xFF));
+    if (info.size >= 3)
+      out.bytes.push_back(static_cast<uint8_t>(immediate >> 8));
+    out.sections.back().size += info.size;
+    pc += info.size;
+  }
+
+  // Whatever is still chained was never defined, report in source order.
+  // In an object these are imports.
+  if (relocatable)
+    return ok;
+  for (const Fixup &fixup : fixups) {
+    if (out.symbolDefined[fixup.symbol])
+      continue;
+    string_view name = program.symbols[fixup.symbol];
+    rowError(diagnostics, program, includes, fixup.row,
+             "Undefined label '%.*s'", (int)name.size(), name.data());
+    ok = false;
+  }
+  return ok;
+}
+
+void MachineCode::Print() const {
+  printf("The machine code is dumped below:\n");
+  for (const Section &section : sections) {
+    for (uint32_t i = 0; i < section.size; ++i) {
+      if (i % 16 == 0)
+        printf("%s%04X:", i ? "\n" : "", section.origin + i);
+      printf(" %02X", bytes[section.offset + i]);
+    }
+    printf("\n");
+  }
+  printf("\n");
+}
+
+} // namespace codegen
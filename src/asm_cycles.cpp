@@ -0,0 +1,511 @@
+#include <Logger.h>
+#include <algorithm>
+#include <array>
+#include <asm_codegen.h>
+#include <asm_cycles.h>
+#include <asm_keywords.h>
+#include <asm_timing.h>
+#include <unordered_map>
+
+namespace cycles {
+
+using cfg::Flow;
+using cfg::noBlock;
+
+// Worst case of a path that leaves the scope where it may not (a loop body
+// it exits); any other path is longer
+static constexpr uint64_t noPath = UINT64_MAX - 1;
+
+static constexpr uint8_t visitNew = 0;
+static constexpr uint8_t visitOpen = 1;
+static constexpr uint8_t visitDone = 2;
+
+static uint64_t add(uint64_t a, uint64_t b) {
+  if (a == unbounded || b == unbounded)
+    return unbounded;
+  if (a == noPath || b == noPath)
+    return noPath;
+  return a + b;
+}
+
+static uint64_t longer(uint64_t a, uint64_t b) {
+  if (a == unbounded || b == unbounded)
+    return unbounded;
+  if (a == noPath)
+    return b;
+  if (b == noPath)
+    return a;
+  return max(a, b);
+}
+
+static bool isDirective(TokenType op) { return op >= TokenType::ORG; }
+
+// Flows whose target is reached by a jump, not by a call
+static bool jumpsToTarget(Flow flow) {
+  return flow == Flow::Jump || flow == Flow::Branch;
+}
+
+static bool callsTarget(Flow flow) {
+  return flow == Flow::Call || flow == Flow::CondCall ||
+         flow == Flow::Restart;
+}
+
+// Where a path may go and where it stops: a subroutine runs to its RET, a
+// region until it leaves the rows between CYCLES and ENDCYC, and a loop
+// iteration until it jumps back to the header. Paths that leave a loop body
+// are not iterations and are dropped.
+struct Analysis::Scope {
+  enum class Kind : uint8_t { Subroutine, Region, Loop };
+  enum class Edge : uint8_t { Follow, End, Drop };
+
+  Kind kind;
+  uint32_t begin = 0; // rows of a region
+  uint32_t end = 0;
+  uint32_t header = noBlock;
+  const vector<bool> *body = nullptr;
+
+  bool returnsEnd() const { return kind != Kind::Loop; }
+
+  Edge classify(const cfg::Graph &graph, uint32_t block) const {
+    switch (kind) {
+    case Kind::Subroutine:
+      return Edge::Follow;
+    case Kind::Region: {
+      uint32_t first = graph.blocks[block].first;
+      return first >= begin && first < end ? Edge::Follow : Edge::End;
+    }
+    case Kind::Loop:
+      if (block == header)
+        return Edge::End;
+      return (*body)[block] ? Edge::Follow : Edge::Drop;
+    }
+    return Edge::Drop;
+  }
+};
+
+// Subroutines share one table indexed by block, regions and loops only see
+// a few blocks and keep theirs in a map
+struct Analysis::Memo {
+  vector<Visit> *dense = nullptr;
+  unordered_map<uint32_t, Visit> sparse;
+
+  Visit &at(uint32_t block) { return dense ? (*dense)[block] : sparse[block]; }
+};
+
+Analysis::Analysis(const ir::Program &program, const cfg::Graph &graph)
+    : m_program(program), m_graph(graph),
+      m_blockTime(graph.blocks.size(), 0),
+      m_subroutine(graph.blocks.size()) {
+  for (uint32_t index = 0; index < graph.blocks.size(); ++index) {
+    const cfg::Block &block = graph.blocks[index];
+    for (uint32_t row = block.first; row < block.end; ++row)
+      m_blockTime[index] += rowTime(row);
+  }
+}
+
+uint32_t Analysis::rowTime(size_t row) const {
+  // DB is data, it is not timed even if control runs into it
+  if (isDirective(m_program.opcode[row]))
+    return 0;
+  return timing::tStates[codegen::opcodeByte(m_program, row)];
+}
+
+uint32_t Analysis::takenTime(size_t row) const {
+  if (isDirective(m_program.opcode[row]))
+    return 0;
+  return timing::takenExtra[codegen::opcodeByte(m_program, row)];
+}
+
+uint64_t Analysis::blockTime(uint32_t block) const {
+  return m_blockTime[block];
+}
+
+uint64_t Analysis::subroutine(uint32_t block) {
+  Scope scope{Scope::Kind::Subroutine};
+  Memo memo;
+  memo.dense = &m_subroutine;
+  uint64_t worst = longestPath(block, scope, memo);
+  return worst == noPath ? 0 : worst;
+}
+
+// Depth-first over the blocks the scope follows, a block is finished once
+// everything after it is. Reaching a block that is still open closes a cycle.
+// An explicit stack, chains of blocks can be as long as the program.
+uint64_t Analysis::longestPath(uint32_t start, const Scope &scope,
+                               Memo &memo) {
+  // A subroutine that is still being walked calls itself again
+  if (memo.at(start).state == visitOpen)
+    return unbounded;
+  vector<uint32_t> stack{start};
+  while (!stack.empty()) {
+    uint32_t index = stack.back();
+    Visit &visit = memo.at(index);
+    if (visit.state == visitDone) {
+      stack.pop_back();
+    } else if (visit.state == visitOpen) {
+      visit.worst = finish(index, scope, memo);
+      visit.state = visitDone;
+      stack.pop_back();
+    } else {
+      visit.state = visitOpen;
+      const cfg::Block &block = m_graph.blocks[index];
+      Flow flow = cfg::flowOf(m_program.opcode[block.end - 1]);
+      for (uint32_t successor :
+           {block.next, jumpsToTarget(flow) ? block.target : noBlock}) {
+        if (successor != noBlock &&
+            scope.classify(m_graph, successor) == Scope::Edge::Follow &&
+            memo.at(successor).state == visitNew)
+          stack.push_back(successor);
+      }
+    }
+  }
+  return memo.at(start).worst;
+}
+
+// Worst case from the start of a block whose successors are all finished
+uint64_t Analysis::finish(uint32_t index, const Scope &scope, Memo &memo) {
+  const cfg::Block &block = m_graph.blocks[index];
+  uint32_t last = block.end - 1;
+  Flow flow = cfg::flowOf(m_program.opcode[last]);
+  uint64_t time = m_blockTime[index];
+  uint64_t taken = takenTime(last);
+
+  if (flow == Flow::Indirect || block.unknownTarget)
+    return unbounded;
+
+  // The rest of the path once control moves on to successor
+  auto via = [&](uint32_t successor, uint64_t extra) -> uint64_t {
+    // Running off the end of the program ends the path
+    if (successor == noBlock)
+      return extra;
+    switch (scope.classify(m_graph, successor)) {
+    case Scope::Edge::Follow: {
+      const Visit &visit = memo.at(successor);
+      return visit.state == visitOpen ? unbounded : add(extra, visit.worst);
+    }
+    case Scope::Edge::End:
+      return extra;
+    case Scope::Edge::Drop:
+      return noPath;
+    }
+    return noPath;
+  };
+  uint64_t returned = scope.returnsEnd() ? 0 : noPath;
+
+  uint64_t rest;
+  switch (flow) {
+  case Flow::Jump:
+    rest = via(block.target, 0);
+    break;
+  case Flow::Branch:
+    rest = longer(via(block.next, 0), via(block.target, taken));
+    break;
+  case Flow::Call:
+  case Flow::Restart:
+    rest = add(subroutine(block.target), via(block.next, 0));
+    break;
+  case Flow::CondCall: {
+    uint64_t call = add(subroutine(block.target), via(block.next, 0));
+    rest = longer(via(block.next, 0), add(taken, call));
+    break;
+  }
+  case Flow::Return:
+  case Flow::Halt:
+    rest = returned;
+    break;
+  case Flow::CondReturn:
+    rest = longer(via(block.next, 0), add(taken, returned));
+    break;
+  default:
+    rest = via(block.next, 0);
+    break;
+  }
+  return add(time, rest);
+}
+
+vector<Region> Analysis::regions(Diagnostics &diagnostics) {
+  vector<Region> found;
+  vector<size_t> open;
+  for (size_t row = 0; row < m_program.size(); ++row) {
+    if (m_program.opcode[row] == TokenType::CYCLES) {
+      open.push_back(found.size());
+      found.push_back({static_cast<uint32_t>(row), 0,
+                       m_program.operand(row, 0), 0});
+    } else if (m_program.opcode[row] == TokenType::ENDCYC) {
+      if (open.empty()) {
+        diagnostics.error(m_program.line[row], -1,
+                          "ENDCYC without a CYCLES before it");
+        continue;
+      }
+      found[open.back()].end = static_cast<uint32_t>(row);
+      open.pop_back();
+    }
+  }
+  for (size_t index : open) {
+    diagnostics.error(m_program.line[found[index].begin], -1,
+                      "CYCLES without an ENDCYC after it");
+  }
+
+  vector<Region> regions;
+  for (Region &region : found) {
+    if (region.end == 0)
+      continue;
+    Scope scope{Scope::Kind::Region, region.begin, region.end};
+    Memo memo;
+    region.worst =
+        longestPath(m_graph.blockOf[region.begin], scope, memo);
+    if (region.worst == noPath)
+      region.worst = 0;
+    regions.push_back(region);
+  }
+  return regions;
+}
+
+vector<Loop> Analysis::loops() {
+  size_t count = m_graph.blocks.size();
+  auto successors = [&](uint32_t index) {
+    const cfg::Block &block = m_graph.blocks[index];
+    return array<uint32_t, 2>{block.next, block.target};
+  };
+
+  // Reverse postorder from the entries, position 0 stands for a root above
+  // every entry
+  constexpr uint32_t unseen = UINT32_MAX;
+  vector<uint32_t> order;
+  vector<uint32_t> position(count, unseen);
+  {
+    vector<uint8_t> state(count, visitNew);
+    vector<uint32_t> stack;
+    for (auto it = m_graph.entries.rbegin(); it != m_graph.entries.rend(); ++it)
+      stack.push_back(*it);
+    while (!stack.empty()) {
+      uint32_t index = stack.back();
+      if (state[index] == visitNew) {
+        state[index] = visitOpen;
+        for (uint32_t successor : successors(index)) {
+          if (successor != noBlock && state[successor] == visitNew)
+            stack.push_back(successor);
+        }
+      } else {
+        if (state[index] == visitOpen) {
+          state[index] = visitDone;
+          order.push_back(index);
+        }
+        stack.pop_back();
+      }
+    }
+  }
+  reverse(order.begin(), order.end());
+  for (uint32_t at = 0; at < order.size(); ++at)
+    position[order[at]] = at + 1;
+
+  vector<vector<uint32_t>> predecessors(count);
+  for (uint32_t index : order) {
+    for (uint32_t successor : successors(index)) {
+      if (successor != noBlock)
+        predecessors[successor].push_back(index);
+    }
+  }
+
+  // Immediate dominators by position (Cooper, Harvey and Kennedy), the
+  // entries hang off the root
+  vector<uint32_t> dominator(order.size() + 1, unseen);
+  dominator[0] = 0;
+  for (uint32_t index : m_graph.entries)
+    dominator[position[index]] = 0;
+  auto intersect = [&](uint32_t a, uint32_t b) {
+    while (a != b) {
+      while (a > b)
+        a = dominator[a];
+      while (b > a)
+        b = dominator[b];
+    }
+    return a;
+  };
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (uint32_t index : order) {
+      uint32_t at = position[index];
+      if (dominator[at] == 0)
+        continue;
+      uint32_t idom = unseen;
+      for (uint32_t predecessor : predecessors[index]) {
+        uint32_t from = position[predecessor];
+        if (dominator[from] == unseen)
+          continue;
+        idom = idom == unseen ? from : intersect(from, idom);
+      }
+      if (idom != dominator[at]) {
+        dominator[at] = idom;
+        changed = true;
+      }
+    }
+  }
+
+  // A back edge goes to a block that dominates its source. Edges that go
+  // forward in the order never do, so only the others are checked.
+  unordered_map<uint32_t, size_t> loopOf;
+  vector<Loop> loops;
+  for (uint32_t index : order) {
+    for (uint32_t successor : successors(index)) {
+      if (successor == noBlock || position[successor] > position[index])
+        continue;
+      uint32_t at = position[index];
+      while (at > position[successor])
+        at = dominator[at];
+      if (at != position[successor])
+        continue;
+      auto [it, added] = loopOf.try_emplace(successor, loops.size());
+      if (added)
+        loops.push_back({successor, {}, 0, 0});
+      loops[it->second].latches.push_back(index);
+    }
+  }
+
+  // The body is everything that reaches a latch without passing the header
+  vector<bool> body(count, false);
+  for (Loop &loop : loops) {
+    vector<uint32_t> members{loop.header};
+    body[loop.header] = true;
+    vector<uint32_t> work;
+    for (uint32_t latch : loop.latches) {
+      if (!body[latch]) {
+        body[latch] = true;
+        members.push_back(latch);
+        work.push_back(latch);
+      }
+    }
+    while (!work.empty()) {
+      uint32_t index = work.back();
+      work.pop_back();
+      for (uint32_t predecessor : predecessors[index]) {
+        if (!body[predecessor]) {
+          body[predecessor] = true;
+          members.push_back(predecessor);
+          work.push_back(predecessor);
+        }
+      }
+    }
+    loop.blocks = members.size();
+
+    Scope scope{Scope::Kind::Loop};
+    scope.header = loop.header;
+    scope.body = &body;
+    Memo memo;
+    loop.worst = longestPath(loop.header, scope, memo);
+    if (loop.worst == noPath)
+      loop.worst = 0;
+
+    for (uint32_t index : members)
+      body[index] = false;
+  }
+  sort(loops.begin(), loops.end(), [](const Loop &a, const Loop &b) {
+    return a.header < b.header;
+  });
+  return loops;
+}
+
+bool hasRegions(const ir::Program &program) {
+  for (TokenType op : program.opcode) {
+    if (op == TokenType::CYCLES)
+      return true;
+  }
+  return false;
+}
+
+bool checkBudgets(const ir::Program &program, Diagnostics &diagnostics) {
+  cfg::Graph graph = cfg::build(program);
+  Analysis analysis(program, graph);
+  size_t errors = diagnostics.errorCount();
+  for (const Region &region : analysis.regions(diagnostics)) {
+    int line = program.line[region.begin];
+    if (region.worst == unbounded)
+      diagnostics.error(line, -1,
+                        "The time of this CYCLES region has no bound: it can "
+                        "loop, recurse or jump somewhere unknown");
+    else if (region.worst > region.budget)
+      diagnostics.error(line, -1,
+                        "CYCLES region takes up to %llu T-states, over its "
+                        "budget of %u",
+                        static_cast<unsigned long long>(region.worst),
+                        region.budget);
+  }
+  return diagnostics.errorCount() == errors;
+}
+
+// "n T-states", or "no bound"
+static string timeText(uint64_t worst) {
+  return worst == unbounded ? "no bound" : to_string(worst) + " T-states";
+}
+
+void printReport(const ir::Program &program) {
+  cfg::Graph graph = cfg::build(program);
+  Analysis analysis(program, graph);
+
+  Logger::fmtLog(LogLevel::Info, "Cycle report, T-states per block:");
+  for (uint32_t index = 0; index < graph.blocks.size(); ++index) {
+    const cfg::Block &block = graph.blocks[index];
+    string_view name = "";
+    if (uint32_t label = program.labelDef[block.first]; label != ir::noSymbol)
+      name = program.symbols[label];
+    Logger::fmtLog(LogLevel::Info, "  B%-5u %04XH %-16.*s %llu T-states",
+                   index, program.address[block.first], (int)name.size(),
+                   name.data(),
+                   static_cast<unsigned long long>(analysis.blockTime(index)));
+    for (uint32_t row = block.first; row < block.end; ++row) {
+      string_view mnemonic = keywordName(program.opcode[row]);
+      uint32_t time = analysis.rowTime(row);
+      if (uint32_t taken = analysis.takenTime(row))
+        Logger::fmtLog(LogLevel::Info, "    %04XH line %-6d %-6.*s %u/%u",
+                       program.address[row], program.line[row],
+                       (int)mnemonic.size(), mnemonic.data(), time,
+                       time + taken);
+      else
+        Logger::fmtLog(LogLevel::Info, "    %04XH line %-6d %-6.*s %u",
+                       program.address[row], program.line[row],
+                       (int)mnemonic.size(), mnemonic.data(), time);
+    }
+  }
+
+  // Every distinct call and RST target, in block order
+  vector<bool> called(graph.blocks.size(), false);
+  for (const cfg::Block &block : graph.blocks) {
+    if (callsTarget(cfg::flowOf(program.opcode[block.end - 1])) &&
+        block.target != noBlock)
+      called[block.target] = true;
+  }
+  bool header = false;
+  for (uint32_t index = 0; index < graph.blocks.size(); ++index) {
+    if (!called[index])
+      continue;
+    if (!header)
+      Logger::fmtLog(LogLevel::Info, "Subroutines, worst case to RET:");
+    header = true;
+    C85_LOG(LogLevel::Info, "  B%-5u %04XH %s", index,
+            program.address[graph.blocks[index].first],
+            timeText(analysis.subroutine(index)).c_str());
+  }
+
+  vector<Loop> loops = analysis.loops();
+  if (!loops.empty())
+    Logger::fmtLog(LogLevel::Info, "Loops, worst case per iteration:");
+  for (const Loop &loop : loops) {
+    C85_LOG(LogLevel::Info, "  B%-5u %04XH %s, %zu block%s", loop.header,
+            program.address[graph.blocks[loop.header].first],
+            timeText(loop.worst).c_str(), loop.blocks,
+            loop.blocks == 1 ? "" : "s");
+  }
+
+  // Unpaired directives were already reported by checkBudgets()
+  Diagnostics ignored;
+  vector<Region> regions = analysis.regions(ignored);
+  if (!regions.empty())
+    Logger::fmtLog(LogLevel::Info, "CYCLES regions:");
+  for (const Region &region : regions) {
+    C85_LOG(LogLevel::Info, "  line %-6d %s of %u", program.line[region.begin],
+            timeText(region.worst).c_str(), region.budget);
+  }
+}
+
+} // namespace cycles
@@ -0,0 +1,467 @@
+#include <Logger.h>
+#include <OutputCache.h>
+#include <Profiler.h>
+#include <SourceFile.h>
+#include <ThreadPool.h>
+#include <asm_cfg.h>
+#include <asm_cycles.h>
+#include <asm_driver.h>
+#include <asm_incremental.h>
+#include <asm_lexer.h>
+#include <asm_parallel.h>
+#include <asm_parser.h>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+void writeResult(ByteWriter &out, const CompileResult &result) {
+  out.u8(result.success);
+  out.u32(static_cast<uint32_t>(result.diagnostics.all().size()));
+  for (const Diagnostic &diagnostic : result.diagnostics.all()) {
+    out.u8(static_cast<uint8_t>(diagnostic.severity));
+    out.i32(diagnostic.line);
+    out.i32(diagnostic.column);
+    out.text(diagnostic.message);
+    out.u32(diagnostic.file);
+    out.i32(diagnostic.fileLine);
+  }
+  out.text(string_view(reinterpret_cast<const char *>(result.output.data()),
+                       result.output.size()));
+  out.u8(result.optimization.enabled);
+  for (const peephole::RuleStats &stats : result.optimization.rules) {
+    out.u32(stats.rewrites);
+    out.u32(stats.bytes);
+    out.u64(stats.tStates);
+  }
+  out.u32(static_cast<uint32_t>(result.dependencies.size()));
+  for (const includes::Dependency &dependency : result.dependencies) {
+    out.text(dependency.path);
+    out.u64(dependency.hash);
+  }
+}
+
+bool readResult(ByteReader &in, CompileResult &result, size_t errorLimit) {
+  result.success = in.u8() != 0;
+  result.diagnostics.clear();
+  result.diagnostics.setErrorLimit(errorLimit);
+  uint32_t count = in.u32();
+  for (uint32_t i = 0; i < count && in.ok(); ++i) {
+    auto severity = static_cast<Severity>(in.u8());
+    int line = in.i32();
+    int column = in.i32();
+    string message(in.text());
+    uint32_t file = in.u32();
+    int fileLine = in.i32();
+    if (severity == Severity::Error && file)
+      result.diagnostics.includedError(static_cast<uint16_t>(file), fileLine,
+                                       line, "%s", message.c_str());
+    else if (severity == Severity::Error)
+      result.diagnostics.error(line, column, "%s", message.c_str());
+    else
+      result.diagnostics.warning(line, column, "%s", message.c_str());
+  }
+  string_view bytes = in.text();
+  result.output.assign(bytes.begin(), bytes.end());
+  result.optimization.enabled = in.u8() != 0;
+  for (peephole::RuleStats &stats : result.optimization.rules) {
+    stats.rewrites = in.u32();
+    stats.bytes = in.u32();
+    stats.tStates = in.u64();
+  }
+  uint32_t dependencies = in.u32();
+  result.dependencies.clear();
+  for (uint32_t i = 0; i < dependencies && in.ok(); ++i) {
+    string path(in.text());
+    result.dependencies.push_back({move(path), in.u64()});
+  }
+  return in.ok();
+}
+
+// Everything after lowering: optimization, addresses, fixups, encoding, CYCLES
+// budgets and formatting
+static void generate(CompileWorkspace &ws, const CompileOptions &options,
+                     CompileResult &result) {
+  // An object exports its labels and leaves undefined ones to the linker
+  bool relocatable = options.format == output::Format::Object;
+  if (options.optimize) {
+    ProfileScope scope("peephole");
+    result.optimization = peephole::optimize(ws.code, relocatable);
+  }
+
+  // Machine code generation
+  bool generated;
+  {
+    ProfileScope scope("codegen");
+    generated = codegen::generateCode(ws.code, ws.machineCode,
+                                      result.diagnostics, relocatable,
+                                      &ws.includes);
+    scope.setBytes(ws.machineCode.bytes.size());
+  }
+  if (options.dump) {
+    Logger::Flush();
+    ws.code.Print();
+    cfg::build(ws.code).Print(ws.code);
+    ws.machineCode.Print();
+  }
+  if (!generated)
+    return;
+
+  // Budgets hold for the code that is encoded, after -O
+  if (cycles::hasRegions(ws.code)) {
+    ProfileScope scope("cycles");
+    if (!cycles::checkBudgets(ws.code, result.diagnostics))
+      return;
+  }
+  if (options.cycleReport)
+    cycles::printReport(ws.code);
+
+  ProfileScope scope("format");
+  if (relocatable) {
+    // Sections of an object only overlap once they are linked
+    result.output = object::write(ws.code, ws.machineCode);
+  } else {
+    // ORG may put code where earlier code already is, the later bytes win
+    image::Image image(ws.machineCode, options.fill);
+    for (const image::Overlap &overlap : image.overlaps()) {
+      const codegen::Section &section =
+          ws.machineCode.sections[overlap.section];
+      result.diagnostics.warning(section.line, -1,
+                                 "Code at %04XH-%04XH overwrites %u bytes of "
+                                 "earlier code",
+                                 section.origin,
+                                 section.origin + section.size - 1,
+                                 overlap.bytes);
+    }
+    result.output =
+        output::formatOutput(ws.machineCode, image, options.format);
+  }
+  scope.setBytes(result.output.size());
+  result.success = true;
+}
+
+CompileResult compileSource(string_view source, const CompileOptions &options,
+                            CompileWorkspace *workspace) {
+  CompileWorkspace local;
+  CompileWorkspace &ws = workspace ? *workspace : local;
+
+  CompileResult result;
+  result.diagnostics.setErrorLimit(options.errorLimit);
+  ws.includes.reset(options.includeDir);
+
+  if (options.threads != 1 && source.size() >= parallelMinSize) {
+    // Chunks are lexed and parsed in one go, the two cannot be told apart
+    ProfileScope scope("lex+parse", source.size());
+    ThreadPool pool(options.threads);
+    ws.program = parseParallel(source, pool, result.diagnostics,
+                               move(ws.program), &ws.includes);
+  } else if (Profiler::enabled()) {
+    // Separate passes, so lexing and parsing are timed on their own. The
+    // lexer's errors are merged back the way streaming would report them.
+    Diagnostics lexed;
+    vector<Token> tokens;
+    {
+      ProfileScope scope("lex", source.size());
+      Lexer lexer(source, &lexed);
+      do
+        tokens.push_back(lexer.next());
+      while (tokens.back().type != TokenType::EndOfFile);
+    }
+    {
+      ProfileScope scope("parse", source.size());
+      Parser parser(tokens, move(ws.program), &result.diagnostics);
+      parser.setIncludes(&ws.includes);
+      ws.program = move(parser.parseProgram());
+    }
+    result.diagnostics.merge(lexed);
+  } else {
+    // Lexical analysis and parsing are streamed, the parser pulls tokens
+    // from the lexer as it goes instead of lexing the whole file up front
+    Lexer lexer(source, &result.diagnostics);
+    Parser parser(lexer, move(ws.program), &result.diagnostics);
+    parser.setIncludes(&ws.includes);
+    ws.program = move(parser.parseProgram());
+  }
+  result.dependencies = ws.includes.dependencies();
+  if (options.dump) {
+    Logger::Flush();
+    ws.program->Print();
+  }
+
+  // Statements dropped by error recovery would only cause follow-on errors
+  // (undefined labels) in the later passes
+  if (result.diagnostics.hasErrors())
+    return result;
+
+  // Lower the tree into the flat IR used by every later pass
+  {
+    ProfileScope scope("lower", source.size());
+    ir::lowerProgram(*ws.program, ws.code);
+  }
+  generate(ws, options, result);
+  return result;
+}
+
+CompileResult compileIncremental(string_view source,
+                                 const CompileOptions &options,
+                                 const string &cacheFile,
+                                 CompileWorkspace *workspace) {
+  CompileWorkspace local;
+  CompileWorkspace &ws = workspace ? *workspace : local;
+
+  CompileResult result;
+  result.diagnostics.setErrorLimit(options.errorLimit);
+  ws.includes.reset(options.includeDir);
+
+  // The IR comes straight from the line cache, only changed lines are parsed
+  {
+    ProfileScope scope("incremental", source.size());
+    incremental::LineCache previous, next;
+    previous.load(cacheFile);
+    incremental::lowerSource(source, previous, next, ws.code, ws.program,
+                             result.diagnostics, &ws.includes);
+    // A cache that cannot be written only costs time on the next run
+    next.save(cacheFile);
+  }
+  result.dependencies = ws.includes.dependencies();
+
+  if (result.diagnostics.hasErrors())
+    return result;
+  generate(ws, options, result);
+  return result;
+}
+
+// Options for compiling sourceFile, with includes found next to it
+static CompileOptions fileOptions(const string &sourceFile,
+                                  const CompileOptions &options) {
+  CompileOptions local = options;
+  local.includeDir = filesystem::path(sourceFile).parent_path().string();
+  return local;
+}
+
+CompileResult compileFromFile(const string &sourceFile,
+                              const string &outputFile,
+                              const CompileOptions &sharedOptions,
+                              CompileWorkspace *workspace) {
+  CompileOptions options = fileOptions(sourceFile, sharedOptions);
+
+  // Map source file, tokens point straight into the mapping
+  SourceFile src;
+  {
+    ProfileScope scope("read");
+    if (!src.open(sourceFile))
+      return CompileResult();
+    scope.setBytes(src.size());
+  }
+
+  // Dumps and reports only happen when something is actually compiled
+  bool cached =
+      !options.cacheDir.empty() && !options.dump && !options.cycleReport;
+  optional<OutputCache> cache;
+  uint64_t key = 0;
+  if (cached) {
+    ProfileScope scope("cache", src.size());
+    cache.emplace(options.cacheDir, options.cacheMaxBytes);
+    key = OutputCache::key(src.view(), options);
+    CompileResult result;
+    if (cache->load(key, result, options.errorLimit))
+      return result;
+  }
+
+  CompileResult result =
+      options.incremental
+          ? compileIncremental(src.view(), options, outputFile + ".c85cache",
+                               workspace)
+          : compileSource(src.view(), options, workspace);
+  if (cached) {
+    ProfileScope scope("cache", src.size());
+    cache->store(key, result);
+  }
+  return result;
+}
+
+bool finishFile(const CompileResult &result, const string &sourceFile,
+                const string &outputFile) {
+  result.diagnostics.print(sourceFile);
+  if (!result.success)
+    return false;
+  result.optimization.print(sourceFile);
+
+  // Write the machine code to the output file
+  ProfileScope scope("write", result.output.size());
+  return output::writeFile(outputFile, result.output);
+}
+
+bool compileFile(const string &sourceFile, const string &outputFile,
+                 const CompileOptions &options, CompileWorkspace *workspace) {
+  return finishFile(
+      compileFromFile(sourceFile, outputFile, options, workspace), sourceFile,
+      outputFile);
+}
+
+// Nearest label at or before address, as LABEL or LABEL+n
+static string addressName(const ir::Program &code,
+                          const codegen::MachineCode &machineCode,
+                          uint16_t address) {
+  uint32_t best = ir::noSymbol;
+  for (uint32_t symbol = 0; symbol < code.symbols.size(); ++symbol) {
+    if (!machineCode.symbolDefined[symbol] ||
+        machineCode.symbolAddress[symbol] > address)
+      continue;
+    if (best == ir::noSymbol ||
+        machineCode.symbolAddress[symbol] > machineCode.symbolAddress[best])
+      best = symbol;
+  }
+  if (best == ir::noSymbol)
+    return {};
+
+  string name(code.symbols[best]);
+  if (uint16_t offset = address - machineCode.symbolAddress[best]) {
+    name += '+';
+    name += to_string(offset);
+  }
+  return name;
+}
+
+bool runFile(const string &sourceFile, const string &outputFile,
+             const CompileOptions &options, const RunOptions &run) {
+  // Label names point into the source, it stays open for the report
+  SourceFile src;
+  if (!src.open(sourceFile))
+    return false;
+
+  CompileWorkspace ws;
+  CompileResult result =
+      compileSource(src.view(), fileOptions(sourceFile, options), &ws);
+  if (outputFile.empty()) {
+    result.diagnostics.print(sourceFile);
+    if (!result.success)
+      return false;
+    result.optimization.print(sourceFile);
+  } else if (!finishFile(result, sourceFile, outputFile)) {
+    return false;
+  }
+
+  emulator::Cpu cpu;
+  cpu.load(ws.machineCode);
+  cpu.setOutHandler([](uint8_t port, uint8_t value) {
+    Logger::fmtLog(LogLevel::Info, "OUT %02XH: %02XH (%u)", port, value,
+                   value);
+  });
+
+  emulator::ExecutionProfile profile;
+  emulator::StopReason reason;
+  auto begin = chrono::steady_clock::now();
+  {
+    ProfileScope scope("run");
+    reason = cpu.run(run.instructionLimit, run.hotLoops ? &profile : nullptr);
+  }
+  double seconds =
+      chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+
+  static constexpr const char *stopped[] = {
+      "Halted", "Instruction limit reached", "Undocumented opcode"};
+  uint16_t pc = cpu.registers().pc;
+  Logger::fmtLog(reason == emulator::StopReason::IllegalOpcode
+                     ? LogLevel::Error
+                     : LogLevel::Info,
+                 "%s at %04XH after %llu instructions, %llu T-states "
+                 "(%.3f ms, %.1f MIPS)",
+                 stopped[static_cast<int>(reason)], pc,
+                 static_cast<unsigned long long>(cpu.instructions()),
+                 static_cast<unsigned long long>(cpu.tStates()), seconds * 1e3,
+                 seconds > 0 ? cpu.instructions() / seconds / 1e6 : 0.0);
+  cpu.Print();
+
+  vector<emulator::HotLoop> loops =
+      run.hotLoops ? emulator::findHotLoops(profile, run.hotLoops)
+                   : vector<emulator::HotLoop>();
+  if (!loops.empty())
+    Logger::fmtLog(LogLevel::Info, "Hot loops:");
+  for (const emulator::HotLoop &loop : loops) {
+    string name = addressName(ws.code, ws.machineCode, loop.head);
+    Logger::fmtLog(LogLevel::Info,
+                   "  %04XH-%04XH %-16s %llu iterations, %llu T-states "
+                   "(%.1f%%)",
+                   loop.head, loop.tail, name.c_str(),
+                   static_cast<unsigned long long>(loop.iterations),
+                   static_cast<unsigned long long>(loop.tStates),
+                   cpu.tStates() ? 100.0 * loop.tStates / cpu.tStates() : 0.0);
+  }
+  return reason != emulator::StopReason::IllegalOpcode;
+}
+
+bool readManifest(const string &path, vector<BatchJob> &jobs) {
+  ifstream manifest(path);
+  if (!manifest) {
+    Logger::fmtLog(LogLevel::Error, "Failed to open manifest: %s",
+                   path.c_str());
+    return false;
+  }
+
+  string line;
+  int lineNumber = 0;
+  while (getline(manifest, line)) {
+    lineNumber++;
+    istringstream fields(line);
+    BatchJob job;
+    if (!(fields >> job.sourceFile) || job.sourceFile[0] == '#')
+      continue;
+
+    string extra;
+    if (!(fields >> job.outputFile) || (fields >> extra)) {
+      Logger::fmtLog(LogLevel::Error,
+                     "%s:%d: expected '<sourceFile> <outputFile>'",
+                     path.c_str(), lineNumber);
+      return false;
+    }
+    jobs.push_back(move(job));
+  }
+  return true;
+}
+
+size_t compileBatch(const vector<BatchJob> &jobs, const CompileOptions &options,
+                    unsigned threads) {
+  // The files are the unit of parallelism here
+  CompileOptions jobOptions = options;
+  jobOptions.threads = 1;
+
+  ThreadPool pool(threads);
+  vector<CompileWorkspace> workspaces(pool.size());
+  vector<string> logs(jobs.size());
+  vector<char> failed(jobs.size(), 0);
+
+  pool.parallelFor(jobs.size(), [&](size_t index, unsigned worker) {
+    const BatchJob &job = jobs[index];
+    ProfileScope scope("file", 0, job.sourceFile);
+    Logger::BeginCapture();
+    failed[index] = !compileFile(job.sourceFile, job.outputFile, jobOptions,
+                                 &workspaces[worker]);
+    logs[index] = Logger::EndCapture();
+  });
+
+  size_t failures = 0;
+  for (size_t i = 0; i < jobs.size(); ++i) {
+    Logger::Raw(logs[i]);
+    failures += failed[i];
+  }
+  return failures;
+}
+
+bool linkFiles(const vector<string> &objectFiles, const string &outputFile,
+               output::Format format, uint8_t fill,
+               const object::LinkOptions &options) {
+  codegen::MachineCode code;
+  image::Image image(fill);
+  if (!object::link(objectFiles, options, code, image))
+    return false;
+
+  vector<uint8_t> data;
+  {
+    ProfileScope scope("format");
+    data = output::formatOutput(code, image, format);
+    scope.setBytes(data.size());
+  }
+  ProfileScope scope("write", data.size());
+  return output::writeFile(outputFile, data);
+}
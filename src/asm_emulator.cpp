@@ -0,0 +1,660 @@
+#include <Logger.h>
+#include <algorithm>
+#include <asm_emulator.h>
+#include <asm_timing.h>
+#include <cstring>
+#include <limits>
+
+// Label addresses (&&label, goto *p) are a GCC and Clang extension
+#if (defined(__GNUC__) || defined(__clang__)) && !defined(C85_NO_COMPUTED_GOTO)
+#define C85_THREADED_DISPATCH 1
+#endif
+
+namespace emulator {
+
+// Sign, zero and parity flags of every result byte
+static constexpr array<uint8_t, 256> buildSzpTable() {
+  array<uint8_t, 256> table{};
+  for (int value = 0; value < 256; ++value) {
+    int bits = 0;
+    for (int bit = 0; bit < 8; ++bit)
+      bits += (value >> bit) & 1;
+    table[value] = static_cast<uint8_t>((value & 0x80 ? flagS : 0) |
+                                        (value == 0 ? flagZ : 0) |
+                                        (bits % 2 == 0 ? flagP : 0));
+  }
+  return table;
+}
+
+static constexpr array<uint8_t, 256> szp = buildSzpTable();
+
+// One handler per kind of instruction, register fields are decoded from the
+// opcode inside the handler. Register pair SP and the M forms have handlers of
+// their own, so no handler has to test for them.
+enum class Kind : uint8_t {
+  Nop, Lxi, LxiSp, Stax, Ldax, Shld, Lhld, Sta, Lda,
+  Inx, InxSp, Dcx, DcxSp, Dad, DadSp,
+  InrR, InrM, DcrR, DcrM, MviR, MviM,
+  Rlc, Rrc, Ral, Rar, Daa, Cma, Stc, Cmc, Rim, Sim,
+  MovRR, MovRM, MovMR, Hlt,
+  AddR, AddM, Adi, AdcR, AdcM, Aci, SubR, SubM, Sui, SbbR, SbbM, Sbi,
+  AnaR, AnaM, Ani, XraR, XraM, Xri, OraR, OraM, Ori, CmpR, CmpM, Cpi,
+  Jmp, Jcc, Call, Ccc, Ret, Rcc, Rst, Pchl, Sphl, Xthl, Xchg,
+  Push, PushPsw, Pop, PopPsw, In, Out, Di, Ei,
+  Illegal,
+};
+
+constexpr size_t kindCount = static_cast<size_t>(Kind::Illegal) + 1;
+
+static constexpr Kind kindOf(uint8_t op) {
+  if (!timing::isDocumented(op))
+    return Kind::Illegal;
+
+  uint8_t dst = (op >> 3) & 0x07;
+  uint8_t src = op & 0x07;
+  if (op == 0x76)
+    return Kind::Hlt;
+  if (op >= 0x40 && op < 0x80)
+    return dst == 6 ? Kind::MovMR : src == 6 ? Kind::MovRM : Kind::MovRR;
+  if (op >= 0x80 && op < 0xC0) {
+    constexpr Kind alu[8][2] = {
+        {Kind::AddR, Kind::AddM}, {Kind::AdcR, Kind::AdcM},
+        {Kind::SubR, Kind::SubM}, {Kind::SbbR, Kind::SbbM},
+        {Kind::AnaR, Kind::AnaM}, {Kind::XraR, Kind::XraM},
+        {Kind::OraR, Kind::OraM}, {Kind::CmpR, Kind::CmpM}};
+    return alu[dst][src == 6];
+  }
+
+  if (op < 0x40) {
+    bool sp = (op >> 4) == 3;
+    switch (src) {
+    case 0:
+      return op == 0x20 ? Kind::Rim : op == 0x30 ? Kind::Sim : Kind::Nop;
+    case 1:
+      if (op & 0x08)
+        return sp ? Kind::DadSp : Kind::Dad;
+      return sp ? Kind::LxiSp : Kind::Lxi;
+    case 2:
+      switch (op) {
+      case 0x22:
+        return Kind::Shld;
+      case 0x2A:
+        return Kind::Lhld;
+      case 0x32:
+        return Kind::Sta;
+      case 0x3A:
+        return Kind::Lda;
+      default:
+        return op & 0x08 ? Kind::Ldax : Kind::Stax;
+      }
+    case 3:
+      if (op & 0x08)
+        return sp ? Kind::DcxSp : Kind::Dcx;
+      return sp ? Kind::InxSp : Kind::Inx;
+    case 4:
+      return dst == 6 ? Kind::InrM : Kind::InrR;
+    case 5:
+      return dst == 6 ? Kind::DcrM : Kind::DcrR;
+    case 6:
+      return dst == 6 ? Kind::MviM : Kind::MviR;
+    default: {
+      constexpr Kind misc[8] = {Kind::Rlc, Kind::Rrc, Kind::Ral, Kind::Rar,
+                                Kind::Daa, Kind::Cma, Kind::Stc, Kind::Cmc};
+      return misc[dst];
+    }
+    }
+  }
+
+  switch (src) {
+  case 0:
+    return Kind::Rcc;
+  case 1:
+    switch (op) {
+    case 0xC9:
+      return Kind::Ret;
+    case 0xE9:
+      return Kind::Pchl;
+    case 0xF9:
+      return Kind::Sphl;
+    case 0xF1:
+      return Kind::PopPsw;
+    default:
+      return Kind::Pop;
+    }
+  case 2:
+    return Kind::Jcc;
+  case 3:
+    switch (op) {
+    case 0xC3:
+      return Kind::Jmp;
+    case 0xD3:
+      return Kind::Out;
+    case 0xDB:
+      return Kind::In;
+    case 0xE3:
+      return Kind::Xthl;
+    case 0xEB:
+      return Kind::Xchg;
+    case 0xF3:
+      return Kind::Di;
+    default:
+      return Kind::Ei;
+    }
+  case 4:
+    return Kind::Ccc;
+  case 5:
+    return op == 0xCD ? Kind::Call : op == 0xF5 ? Kind::PushPsw : Kind::Push;
+  case 6: {
+    constexpr Kind immediate[8] = {Kind::Adi, Kind::Aci, Kind::Sui, Kind::Sbi,
+                                   Kind::Ani, Kind::Xri, Kind::Ori, Kind::Cpi};
+    return immediate[dst];
+  }
+  default:
+    return Kind::Rst;
+  }
+}
+
+static constexpr array<Kind, 256> buildKindTable() {
+  array<Kind, 256> table{};
+  for (int op = 0; op < 256; ++op)
+    table[op] = kindOf(static_cast<uint8_t>(op));
+  return table;
+}
+
+static constexpr array<Kind, 256> kindTable = buildKindTable();
+
+// Flag masks of the condition field of Jcc, Ccc and Rcc: NZ Z NC C PO PE P M.
+// Odd conditions are taken when the flag is set, even ones when it is clear.
+static constexpr uint8_t conditionFlag[8] = {flagZ,  flagZ, flagCY, flagCY,
+                                             flagP,  flagP, flagS,  flagS};
+
+static inline bool condition(uint8_t op, uint8_t f) {
+  uint8_t field = (op >> 3) & 0x07;
+  return ((f & conditionFlag[field]) != 0) == ((field & 1) != 0);
+}
+
+// ADD, ADC, ADI and ACI
+static inline void add(uint8_t &a, uint8_t &f, uint8_t value, uint8_t carry) {
+  unsigned result = a + value + carry;
+  f = static_cast<uint8_t>(szp[result & 0xFF] | (result >> 8) |
+                           ((a ^ value ^ result) & flagAC));
+  a = static_cast<uint8_t>(result);
+}
+
+// SUB, SBB, CMP and the immediate forms. The 8085 adds the complement, so
+// AC is the carry out of bit 3 of a + ~value + !borrow.
+static inline uint8_t subtract(uint8_t a, uint8_t &f, uint8_t value,
+                               uint8_t borrow) {
+  unsigned result = a - value - borrow;
+  f = static_cast<uint8_t>(szp[result & 0xFF] | ((result >> 8) & flagCY) |
+                           ((a ^ ~value ^ result) & flagAC));
+  return static_cast<uint8_t>(result);
+}
+
+void ExecutionProfile::reset() {
+  counts.assign(0x10000, 0);
+  tStates.assign(0x10000, 0);
+  backEdges.assign(0x10000, 0);
+  backTarget.assign(0x10000, 0);
+}
+
+vector<HotLoop> findHotLoops(const ExecutionProfile &profile, size_t count) {
+  vector<HotLoop> loops;
+  for (uint32_t tail = 0; tail < profile.backEdges.size(); ++tail) {
+    if (!profile.backEdges[tail])
+      continue;
+    HotLoop loop{profile.backTarget[tail], static_cast<uint16_t>(tail),
+                 profile.backEdges[tail], 0};
+    for (uint32_t address = loop.head; address <= tail; ++address)
+      loop.tStates += profile.tStates[address];
+    loops.push_back(loop);
+  }
+
+  auto hotter = [](const HotLoop &a, const HotLoop &b) {
+    return a.tStates != b.tStates ? a.tStates > b.tStates : a.head < b.head;
+  };
+  if (loops.size() > count) {
+    partial_sort(loops.begin(), loops.begin() + count, loops.end(), hotter);
+    loops.resize(count);
+  } else {
+    sort(loops.begin(), loops.end(), hotter);
+  }
+  return loops;
+}
+
+Cpu::Cpu() { reset(); }
+
+void Cpu::reset() {
+  m_regs = Registers();
+  m_memory.fill(0);
+  m_instructions = 0;
+  m_tStates = 0;
+}
+
+void Cpu::load(const codegen::MachineCode &code) {
+  reset();
+  for (const codegen::Section &section : code.sections) {
+    // Sections reaching past 0xFFFF wrap around like the address bus does
+    for (uint32_t i = 0; i < section.size; ++i)
+      m_memory[static_cast<uint16_t>(section.origin + i)] =
+          code.bytes[section.offset + i];
+  }
+  if (!code.sections.empty())
+    m_regs.pc = code.sections.front().origin;
+}
+
+StopReason Cpu::run(uint64_t limit, ExecutionProfile *profile) {
+  if (profile) {
+    if (profile->counts.size() != 0x10000)
+      profile->reset();
+    return execute<true>(limit, profile);
+  }
+  return execute<false>(limit, nullptr);
+}
+
+// Starts the instruction at pc: checks the limit, fetches the opcode and
+// charges its T-states (conditional ones as not taken)
+#define FETCH()                                                                \
+  if (count == end) {                                                          \
+    reason = StopReason::Limit;                                                \
+    goto stop;                                                                 \
+  }                                                                            \
+  start = pc;                                                                  \
+  op = mem[pc++];                                                              \
+  ++count;                                                                     \
+  cycles += timing::tStates[op];                                               \
+  if constexpr (Profile) {                                                     \
+    ++counts[start];                                                           \
+    spent[start] += timing::tStates[op];                                       \
+  }
+
+#ifdef C85_THREADED_DISPATCH
+// Every handler ends in its own copy of the dispatch, so the indirect jumps
+// are predicted per handler instead of through one shared branch
+#define HANDLER(kind) op_##kind:
+#define NEXT()                                                                 \
+  do {                                                                         \
+    FETCH();                                                                   \
+    goto *dispatch[op];                                                        \
+  } while (0)
+#else
+#define HANDLER(kind) case Kind::kind:
+#define NEXT() continue
+#endif
+
+// Extra T-states of a taken conditional branch
+#define TAKEN()                                                                \
+  do {                                                                         \
+    cycles += timing::takenExtra[op];                                          \
+    if constexpr (Profile)                                                     \
+      spent[start] += timing::takenExtra[op];                                  \
+  } while (0)
+
+// Registers live in locals while running, memory is indexed by uint16_t so
+// every address wraps at 64K by itself
+template <bool Profile>
+StopReason Cpu::execute(uint64_t limit, ExecutionProfile *profile) {
+  uint8_t *mem = m_memory.data();
+  uint8_t r[8];
+  memcpy(r, m_regs.r, sizeof(r));
+  uint8_t &a = r[7];
+  uint8_t f = m_regs.f;
+  uint16_t sp = m_regs.sp;
+  uint16_t pc = m_regs.pc;
+
+  uint64_t count = m_instructions;
+  uint64_t cycles = m_tStates;
+  uint64_t end = limit > numeric_limits<uint64_t>::max() - count
+                     ? numeric_limits<uint64_t>::max()
+                     : count + limit;
+
+  uint64_t *counts = Profile ? profile->counts.data() : nullptr;
+  uint64_t *spent = Profile ? profile->tStates.data() : nullptr;
+  uint64_t *backEdges = Profile ? profile->backEdges.data() : nullptr;
+  uint16_t *backTarget = Profile ? profile->backTarget.data() : nullptr;
+
+  uint16_t start = pc;
+  uint8_t op = 0;
+  StopReason reason = StopReason::Halted;
+
+  auto imm8 = [&]() { return mem[pc++]; };
+  auto imm16 = [&]() {
+    uint16_t value = static_cast<uint16_t>(
+        mem[pc] | mem[static_cast<uint16_t>(pc + 1)] << 8);
+    pc += 2;
+    return value;
+  };
+  auto read16 = [&](uint16_t address) {
+    return static_cast<uint16_t>(
+        mem[address] | mem[static_cast<uint16_t>(address + 1)] << 8);
+  };
+  auto write16 = [&](uint16_t address, uint16_t value) {
+    mem[address] = static_cast<uint8_t>(value);
+    mem[static_cast<uint16_t>(address + 1)] = static_cast<uint8_t>(value >> 8);
+  };
+  auto push = [&](uint16_t value) {
+    mem[--sp] = static_cast<uint8_t>(value >> 8);
+    mem[--sp] = static_cast<uint8_t>(value);
+  };
+  auto pop = [&]() {
+    uint16_t value = read16(sp);
+    sp += 2;
+    return value;
+  };
+  auto hl = [&]() { return static_cast<uint16_t>(r[4] << 8 | r[5]); };
+  // Register pair field 0-2 (BC DE HL) as indices into r
+  auto pair = [&](uint8_t opcode) { return ((opcode >> 4) & 0x03) * 2; };
+  auto getPair = [&](int hi) {
+    return static_cast<uint16_t>(r[hi] << 8 | r[hi + 1]);
+  };
+  auto setPair = [&](int hi, uint16_t value) {
+    r[hi] = static_cast<uint8_t>(value >> 8);
+    r[hi + 1] = static_cast<uint8_t>(value);
+  };
+  auto jump = [&](uint16_t target) {
+    if constexpr (Profile) {
+      if (target <= start) {
+        ++backEdges[start];
+        backTarget[start] = target;
+      }
+    }
+    pc = target;
+  };
+
+#ifdef C85_THREADED_DISPATCH
+  // clang-format off
+  static const void *const handlers[kindCount] = {
+      &&op_Nop, &&op_Lxi, &&op_LxiSp, &&op_Stax, &&op_Ldax, &&op_Shld,
+      &&op_Lhld, &&op_Sta, &&op_Lda,
+      &&op_Inx, &&op_InxSp, &&op_Dcx, &&op_DcxSp, &&op_Dad, &&op_DadSp,
+      &&op_InrR, &&op_InrM, &&op_DcrR, &&op_DcrM, &&op_MviR, &&op_MviM,
+      &&op_Rlc, &&op_Rrc, &&op_Ral, &&op_Rar, &&op_Daa, &&op_Cma, &&op_Stc,
+      &&op_Cmc, &&op_Rim, &&op_Sim,
+      &&op_MovRR, &&op_MovRM, &&op_MovMR, &&op_Hlt,
+      &&op_AddR, &&op_AddM, &&op_Adi, &&op_AdcR, &&op_AdcM, &&op_Aci,
+      &&op_SubR, &&op_SubM, &&op_Sui, &&op_SbbR, &&op_SbbM, &&op_Sbi,
+      &&op_AnaR, &&op_AnaM, &&op_Ani, &&op_XraR, &&op_XraM, &&op_Xri,
+      &&op_OraR, &&op_OraM, &&op_Ori, &&op_CmpR, &&op_CmpM, &&op_Cpi,
+      &&op_Jmp, &&op_Jcc, &&op_Call, &&op_Ccc, &&op_Ret, &&op_Rcc, &&op_Rst,
+      &&op_Pchl, &&op_Sphl, &&op_Xthl, &&op_Xchg,
+      &&op_Push, &&op_PushPsw, &&op_Pop, &&op_PopPsw, &&op_In, &&op_Out,
+      &&op_Di, &&op_Ei,
+      &&op_Illegal,
+  };
+  // clang-format on
+  const void *dispatch[256];
+  for (int i = 0; i < 256; ++i)
+    dispatch[i] = handlers[static_cast<size_t>(kindTable[i])];
+
+  NEXT();
+#else
+  for (;;) {
+    FETCH();
+    switch (kindTable[op]) {
+#endif
+
+  // clang-format off
+  // Data transfer
+  HANDLER(Nop) NEXT();
+  HANDLER(Lxi) setPair(pair(op), imm16()); NEXT();
+  HANDLER(LxiSp) sp = imm16(); NEXT();
+  HANDLER(Stax) mem[getPair(pair(op))] = a; NEXT();
+  HANDLER(Ldax) a = mem[getPair(pair(op))]; NEXT();
+  HANDLER(Shld) write16(imm16(), hl()); NEXT();
+  HANDLER(Lhld) setPair(4, read16(imm16())); NEXT();
+  HANDLER(Sta) mem[imm16()] = a; NEXT();
+  HANDLER(Lda) a = mem[imm16()]; NEXT();
+  HANDLER(MovRR) r[(op >> 3) & 0x07] = r[op & 0x07]; NEXT();
+  HANDLER(MovRM) r[(op >> 3) & 0x07] = mem[hl()]; NEXT();
+  HANDLER(MovMR) mem[hl()] = r[op & 0x07]; NEXT();
+  HANDLER(MviR) r[(op >> 3) & 0x07] = imm8(); NEXT();
+  HANDLER(MviM) mem[hl()] = imm8(); NEXT();
+  HANDLER(Xchg) {
+    swap(r[2], r[4]);
+    swap(r[3], r[5]);
+  }
+  NEXT();
+
+  // Increment and decrement, INR and DCR leave CY alone
+  HANDLER(Inx) setPair(pair(op), getPair(pair(op)) + 1); NEXT();
+  HANDLER(InxSp) ++sp; NEXT();
+  HANDLER(Dcx) setPair(pair(op), getPair(pair(op)) - 1); NEXT();
+  HANDLER(DcxSp) --sp; NEXT();
+  HANDLER(InrR) {
+    uint8_t &reg = r[(op >> 3) & 0x07];
+    ++reg;
+    f = (f & flagCY) | szp[reg] | ((reg & 0x0F) == 0 ? flagAC : 0);
+  }
+  NEXT();
+  HANDLER(InrM) {
+    uint8_t &cell = mem[hl()];
+    ++cell;
+    f = (f & flagCY) | szp[cell] | ((cell & 0x0F) == 0 ? flagAC : 0);
+  }
+  NEXT();
+  HANDLER(DcrR) {
+    uint8_t &reg = r[(op >> 3) & 0x07];
+    f = (f & flagCY) | ((reg & 0x0F) != 0 ? flagAC : 0);
+    --reg;
+    f |= szp[reg];
+  }
+  NEXT();
+  HANDLER(DcrM) {
+    uint8_t &cell = mem[hl()];
+    f = (f & flagCY) | ((cell & 0x0F) != 0 ? flagAC : 0);
+    --cell;
+    f |= szp[cell];
+  }
+  NEXT();
+  HANDLER(Dad) {
+    uint32_t sum = uint32_t(hl()) + getPair(pair(op));
+    setPair(4, static_cast<uint16_t>(sum));
+    f = (f & ~flagCY) | static_cast<uint8_t>(sum >> 16);
+  }
+  NEXT();
+  HANDLER(DadSp) {
+    uint32_t sum = uint32_t(hl()) + sp;
+    setPair(4, static_cast<uint16_t>(sum));
+    f = (f & ~flagCY) | static_cast<uint8_t>(sum >> 16);
+  }
+  NEXT();
+
+  // Arithmetic and logic
+#define ALU(name, expression)                                                  \
+  HANDLER(name##R) {                                                           \
+    uint8_t value = r[op & 0x07];                                              \
+    expression;                                                                \
+  }                                                                            \
+  NEXT();                                                                      \
+  HANDLER(name##M) {                                                           \
+    uint8_t value = mem[hl()];                                                 \
+    expression;                                                                \
+  }                                                                            \
+  NEXT();
+
+#define ALU_IMMEDIATE(name, expression)                                        \
+  HANDLER(name) {                                                              \
+    uint8_t value = imm8();                                                    \
+    expression;                                                                \
+  }                                                                            \
+  NEXT();
+
+  ALU(Add, add(a, f, value, 0))
+  ALU(Adc, add(a, f, value, f & flagCY))
+  ALU(Sub, a = subtract(a, f, value, 0))
+  ALU(Sbb, a = subtract(a, f, value, f & flagCY))
+  ALU(Ana, f = szp[a &= value] | flagAC)
+  ALU(Xra, f = szp[a ^= value])
+  ALU(Ora, f = szp[a |= value])
+  ALU(Cmp, subtract(a, f, value, 0))
+  ALU_IMMEDIATE(Adi, add(a, f, value, 0))
+  ALU_IMMEDIATE(Aci, add(a, f, value, f & flagCY))
+  ALU_IMMEDIATE(Sui, a = subtract(a, f, value, 0))
+  ALU_IMMEDIATE(Sbi, a = subtract(a, f, value, f & flagCY))
+  ALU_IMMEDIATE(Ani, f = szp[a &= value] | flagAC)
+  ALU_IMMEDIATE(Xri, f = szp[a ^= value])
+  ALU_IMMEDIATE(Ori, f = szp[a |= value])
+  ALU_IMMEDIATE(Cpi, subtract(a, f, value, 0))
+#undef ALU
+#undef ALU_IMMEDIATE
+
+  HANDLER(Daa) {
+    uint8_t correction = 0;
+    uint8_t carry = f & flagCY;
+    if ((a & 0x0F) > 9 || (f & flagAC))
+      correction |= 0x06;
+    if (a > 0x99 || carry) {
+      correction |= 0x60;
+      carry = flagCY;
+    }
+    uint8_t result = a + correction;
+    f = szp[result] | ((a ^ correction ^ result) & flagAC) | carry;
+    a = result;
+  }
+  NEXT();
+  HANDLER(Rlc) {
+    uint8_t carry = a >> 7;
+    a = static_cast<uint8_t>(a << 1 | carry);
+    f = (f & ~flagCY) | carry;
+  }
+  NEXT();
+  HANDLER(Rrc) {
+    uint8_t carry = a & 1;
+    a = static_cast<uint8_t>(a >> 1 | carry << 7);
+    f = (f & ~flagCY) | carry;
+  }
+  NEXT();
+  HANDLER(Ral) {
+    uint8_t carry = a >> 7;
+    a = static_cast<uint8_t>(a << 1 | (f & flagCY));
+    f = (f & ~flagCY) | carry;
+  }
+  NEXT();
+  HANDLER(Rar) {
+    uint8_t carry = a & 1;
+    a = static_cast<uint8_t>(a >> 1 | (f & flagCY) << 7);
+    f = (f & ~flagCY) | carry;
+  }
+  NEXT();
+  HANDLER(Cma) a = ~a; NEXT();
+  HANDLER(Stc) f |= flagCY; NEXT();
+  HANDLER(Cmc) f ^= flagCY; NEXT();
+
+  // Branches, only taken conditional ones cost their extra T-states
+  HANDLER(Jmp) jump(imm16()); NEXT();
+  HANDLER(Jcc) {
+    uint16_t target = imm16();
+    if (condition(op, f)) {
+      TAKEN();
+      jump(target);
+    }
+  }
+  NEXT();
+  HANDLER(Call) {
+    uint16_t target = imm16();
+    push(pc);
+    pc = target;
+  }
+  NEXT();
+  HANDLER(Ccc) {
+    uint16_t target = imm16();
+    if (condition(op, f)) {
+      TAKEN();
+      push(pc);
+      pc = target;
+    }
+  }
+  NEXT();
+  HANDLER(Ret) pc = pop(); NEXT();
+  HANDLER(Rcc) {
+    if (condition(op, f)) {
+      TAKEN();
+      pc = pop();
+    }
+  }
+  NEXT();
+  HANDLER(Rst) {
+    push(pc);
+    pc = op & 0x38;
+  }
+  NEXT();
+  HANDLER(Pchl) pc = hl(); NEXT();
+
+  // Stack, I/O and machine control
+  HANDLER(Push) push(getPair(pair(op))); NEXT();
+  HANDLER(PushPsw) push(static_cast<uint16_t>(a << 8 | f)); NEXT();
+  HANDLER(Pop) setPair(pair(op), pop()); NEXT();
+  HANDLER(PopPsw) {
+    uint16_t value = pop();
+    f = static_cast<uint8_t>(value) &
+        (flagS | flagZ | flagAC | flagP | flagCY);
+    a = static_cast<uint8_t>(value >> 8);
+  }
+  NEXT();
+  HANDLER(Xthl) {
+    uint16_t value = read16(sp);
+    write16(sp, hl());
+    setPair(4, value);
+  }
+  NEXT();
+  HANDLER(Sphl) sp = hl(); NEXT();
+  HANDLER(In) {
+    uint8_t port = imm8();
+    a = m_in ? m_in(port) : 0xFF;
+  }
+  NEXT();
+  HANDLER(Out) {
+    uint8_t port = imm8();
+    if (m_out)
+      m_out(port, a);
+  }
+  NEXT();
+  HANDLER(Di) NEXT();
+  HANDLER(Ei) NEXT();
+  HANDLER(Rim) a = 0; NEXT();
+  HANDLER(Sim) NEXT();
+  HANDLER(Hlt) reason = StopReason::Halted; goto stop;
+  HANDLER(Illegal) {
+    // Not executed after all: nothing is counted and pc stays on it
+    reason = StopReason::IllegalOpcode;
+    pc = start;
+    --count;
+    if constexpr (Profile)
+      --counts[start];
+    goto stop;
+  }
+  // clang-format on
+
+#ifndef C85_THREADED_DISPATCH
+    }
+  }
+#endif
+
+stop:
+  memcpy(m_regs.r, r, sizeof(r));
+  m_regs.f = f;
+  m_regs.sp = sp;
+  m_regs.pc = pc;
+  m_instructions = count;
+  m_tStates = cycles;
+  return reason;
+}
+
+#undef FETCH
+#undef HANDLER
+#undef NEXT
+#undef TAKEN
+
+void Cpu::Print() const {
+  const uint8_t *r = m_regs.r;
+  uint8_t f = m_regs.f;
+  Logger::fmtLog(LogLevel::Info,
+                 "A=%02X B=%02X C=%02X D=%02X E=%02X H=%02X L=%02X "
+                 "SP=%04X PC=%04X Flags: %c%c%c%c%c",
+                 r[7], r[0], r[1], r[2], r[3], r[4], r[5], m_regs.sp,
+                 m_regs.pc, f & flagS ? 'S' : '-', f & flagZ ? 'Z' : '-',
+                 f & flagAC ? 'A' : '-', f & flagP ? 'P' : '-',
+                 f & flagCY ? 'C' : '-');
+}
+
+} // namespace emulator
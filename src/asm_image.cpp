@@ -0,0 +1,112 @@
+#include <asm_image.h>
+#include <bit>
+#include <cstring>
+
+namespace image {
+
+// Bits [from, to) of the 64-bit word that starts at bit base
+static uint64_t rangeMask(uint32_t base, uint32_t from, uint32_t to) {
+  if (to <= base || from >= base + 64 || from >= to)
+    return 0;
+  uint32_t lo = max(from, base) - base;
+  uint32_t hi = min(to, base + 64) - base;
+  uint64_t upTo = hi == 64 ? ~0ull : (1ull << hi) - 1;
+  return upTo & ~((1ull << lo) - 1);
+}
+
+Image::Image(const codegen::MachineCode &code, uint8_t fill) : m_fill(fill) {
+  for (uint32_t index = 0; index < code.sections.size(); ++index) {
+    const codegen::Section &section = code.sections[index];
+    if (uint32_t bytes = write(section.origin,
+                               code.bytes.data() + section.offset,
+                               section.size))
+      m_overlaps.push_back({index, bytes});
+  }
+}
+
+Image::Page &Image::allocate(uint32_t index) {
+  if (!m_pages[index]) {
+    m_pages[index] = make_unique<Page>();
+    m_pages[index]->bytes.fill(m_fill);
+    m_pages[index]->written.fill(0);
+    m_allocated[index / 64] |= 1ull << (index % 64);
+  }
+  return *m_pages[index];
+}
+
+uint32_t Image::write(uint16_t address, const uint8_t *data, uint32_t size) {
+  uint32_t overlapped = 0;
+  uint32_t end = address + size;
+  for (uint32_t at = address; at < end;) {
+    uint32_t offset = at % pageSize;
+    uint32_t count = min(end - at, pageSize - offset);
+    Page &page = allocate(at / pageSize);
+    for (uint32_t word = 0; word < page.written.size(); ++word) {
+      uint64_t mask = rangeMask(word * 64, offset, offset + count);
+      overlapped += popcount(page.written[word] & mask);
+      page.written[word] |= mask;
+    }
+    memcpy(page.bytes.data() + offset, data, count);
+    data += count;
+    at += count;
+  }
+  return overlapped;
+}
+
+bool Image::empty() const {
+  for (uint64_t bits : m_allocated) {
+    if (bits)
+      return false;
+  }
+  return true;
+}
+
+uint32_t Image::low() const {
+  for (uint32_t word = 0; word < m_allocated.size(); ++word) {
+    if (uint64_t bits = m_allocated[word]) {
+      uint32_t index = word * 64 + countr_zero(bits);
+      return index * pageSize + find(*m_pages[index], 0, true);
+    }
+  }
+  return 0;
+}
+
+uint32_t Image::high() const {
+  for (uint32_t word = m_allocated.size(); word-- > 0;) {
+    if (uint64_t bits = m_allocated[word]) {
+      uint32_t index = word * 64 + 63 - countl_zero(bits);
+      const Page &page = *m_pages[index];
+      for (uint32_t bit = page.written.size(); bit-- > 0;) {
+        if (page.written[bit])
+          return index * pageSize + bit * 64 + 64 -
+                 countl_zero(page.written[bit]);
+      }
+    }
+  }
+  return 0;
+}
+
+void Image::copy(uint32_t from, uint32_t to, uint8_t *out) const {
+  for (uint32_t at = from; at < to;) {
+    uint32_t offset = at % pageSize;
+    uint32_t count = min(to - at, pageSize - offset);
+    if (const Page *page = m_pages[at / pageSize].get())
+      memcpy(out, page->bytes.data() + offset, count);
+    else
+      memset(out, m_fill, count);
+    out += count;
+    at += count;
+  }
+}
+
+uint32_t Image::find(const Page &page, uint32_t from, bool written) {
+  for (uint32_t word = from / 64; word < page.written.size(); ++word) {
+    uint64_t bits = written ? page.written[word] : ~page.written[word];
+    bits &= rangeMask(word * 64, from, pageSize);
+    if (bits)
+      return word * 64 + countr_zero(bits);
+  }
+  return pageSize;
+}
+
+} // namespace image
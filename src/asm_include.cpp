@@ -0,0 +1,170 @@
+#include <Hash.h>
+#include <algorithm>
+#include <asm_include.h>
+#include <fstream>
+#include <iterator>
+
+namespace fs = std::filesystem;
+
+namespace includes {
+
+int File::lineOf(uint32_t offset) const {
+  return 1 + static_cast<int>(count(text.begin(), text.begin() + offset, '\n'));
+}
+
+static bool readFile(const string &path, string &text) {
+  ifstream in(path, ios::binary);
+  if (!in)
+    return false;
+  text.assign(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+  return !in.bad();
+}
+
+bool isCurrent(const Dependency &dependency) {
+  string text;
+  return readFile(dependency.path, text) &&
+         hashBytes(text.data(), text.size()) == dependency.hash;
+}
+
+Cache &Cache::shared() {
+  static Cache cache;
+  return cache;
+}
+
+// Memory a cached file takes, roughly
+static uint64_t footprint(const File &file) {
+  return file.path.size() + file.text.size() +
+         file.tokens.size() * sizeof(Token) +
+         file.diagnostics.all().size() * sizeof(Diagnostic);
+}
+
+shared_ptr<const File> Cache::load(const string &path) {
+  error_code error;
+  fs::file_time_type modified = fs::last_write_time(path, error);
+  uintmax_t size = error ? 0 : fs::file_size(path, error);
+
+  {
+    lock_guard<mutex> lock(m_mutex);
+    auto it = m_files.find(path);
+    if (it != m_files.end()) {
+      Entry &entry = it->second;
+      if (!error && entry.file->modified == modified &&
+          entry.file->size == size) {
+        entry.lastUse = ++m_clock;
+        return entry.file;
+      }
+      // Changed or gone, the copy is of no use any more
+      m_bytes -= entry.bytes;
+      m_files.erase(it);
+    }
+  }
+  if (error)
+    return nullptr;
+
+  // Read and lexed outside the lock, other files stay available meanwhile.
+  // The text is in its final place before the tokens point into it.
+  auto file = make_shared<File>();
+  file->path = path;
+  file->modified = modified;
+  if (!readFile(path, file->text))
+    return nullptr;
+  file->size = file->text.size();
+  file->hash = hashBytes(file->text.data(), file->text.size());
+  Lexer lexer(file->text, &file->diagnostics);
+  do
+    file->tokens.push_back(lexer.next());
+  while (file->tokens.back().type != TokenType::EndOfFile);
+
+  uint64_t bytes = footprint(*file);
+  lock_guard<mutex> lock(m_mutex);
+  if (bytes > maxBytes)
+    return file;
+  // Another thread may have loaded the file meanwhile
+  if (auto it = m_files.find(path); it != m_files.end()) {
+    m_bytes -= it->second.bytes;
+    m_files.erase(it);
+  }
+  m_files.emplace(path, Entry{file, bytes, ++m_clock});
+  m_bytes += bytes;
+  evict();
+  return file;
+}
+
+void Cache::evict() {
+  if (m_bytes <= maxBytes)
+    return;
+  vector<pair<uint64_t, const string *>> byUse;
+  byUse.reserve(m_files.size());
+  for (const auto &[path, entry] : m_files)
+    byUse.emplace_back(entry.lastUse, &path);
+  sort(byUse.begin(), byUse.end());
+  for (const auto &[lastUse, path] : byUse) {
+    if (m_bytes <= maxBytes)
+      break;
+    auto it = m_files.find(*path);
+    m_bytes -= it->second.bytes;
+    m_files.erase(it);
+  }
+}
+
+void Context::reset(string directory) {
+  lock_guard<mutex> lock(m_mutex);
+  m_directory = move(directory);
+  m_files.clear();
+  m_ids.clear();
+}
+
+uint16_t Context::open(string_view name, uint16_t from, string &error) {
+  fs::path target(name);
+  if (target.is_relative()) {
+    lock_guard<mutex> lock(m_mutex);
+    fs::path base = from ? fs::path(m_files[from - 1]->path).parent_path()
+                         : fs::path(m_directory);
+    target = base / target;
+  }
+  string path = fs::absolute(target).lexically_normal().string();
+
+  {
+    lock_guard<mutex> lock(m_mutex);
+    if (auto it = m_ids.find(path); it != m_ids.end())
+      return it->second;
+  }
+
+  shared_ptr<const File> file = Cache::shared().load(path);
+  if (!file) {
+    error = "Cannot read the included file '" + path + "'";
+    return 0;
+  }
+
+  lock_guard<mutex> lock(m_mutex);
+  // Another thread may have opened it meanwhile
+  if (auto it = m_ids.find(path); it != m_ids.end())
+    return it->second;
+  if (m_files.size() == UINT16_MAX) {
+    error = "Too many included files";
+    return 0;
+  }
+  m_files.push_back(move(file));
+  uint16_t id = static_cast<uint16_t>(m_files.size());
+  m_ids.emplace(path, id);
+  return id;
+}
+
+const File &Context::file(uint16_t id) const {
+  lock_guard<mutex> lock(m_mutex);
+  return *m_files[id - 1];
+}
+
+vector<Dependency> Context::dependencies() const {
+  lock_guard<mutex> lock(m_mutex);
+  vector<Dependency> dependencies;
+  for (const shared_ptr<const File> &file : m_files)
+    dependencies.push_back({file->path, file->hash});
+  sort(dependencies.begin(), dependencies.end(),
+       [](const Dependency &a, const Dependency &b) {
+         return a.path < b.path;
+       });
+  return dependencies;
+}
+
+} // namespace includes
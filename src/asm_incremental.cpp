@@ -0,0 +1,264 @@
+#include <Hash.h>
+#include <asm_incremental.h>
+#include <asm_lexer.h>
+#include <asm_output.h>
+#include <asm_parser.h>
+#include <asm_scan.h>
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+namespace incremental {
+
+struct CacheHeader {
+  char magic[4];
+  uint32_t version;
+  uint64_t count;
+};
+
+static constexpr char cacheMagic[4] = {'C', '8', '5', 'L'};
+
+// Positions are stored in 16 bits, longer lines are simply never cached
+static constexpr size_t maxLineLength = 0xFFFF;
+
+void LineCache::load(const std::string &path) {
+  clear();
+  ifstream file(path, ios::binary);
+  if (!file)
+    return;
+
+  CacheHeader header;
+  if (!file.read(reinterpret_cast<char *>(&header), sizeof(header)) ||
+      memcmp(header.magic, cacheMagic, sizeof(cacheMagic)) != 0 ||
+      header.version != cacheVersion)
+    return;
+
+  // The records must fill the rest of the file exactly, a damaged count must
+  // not turn into a huge allocation
+  file.seekg(0, ios::end);
+  streamoff available = file.tellg() - static_cast<streamoff>(sizeof(header));
+  if (available < 0 || available % sizeof(LineRecord) != 0 ||
+      static_cast<uint64_t>(available) / sizeof(LineRecord) != header.count)
+    return;
+  file.seekg(sizeof(header));
+
+  vector<LineRecord> records(header.count);
+  if (!file.read(reinterpret_cast<char *>(records.data()),
+                 records.size() * sizeof(LineRecord)))
+    return;
+
+  for (const LineRecord &record : records)
+    add(record);
+}
+
+bool LineCache::save(const std::string &path) const {
+  CacheHeader header;
+  memcpy(header.magic, cacheMagic, sizeof(cacheMagic));
+  header.version = cacheVersion;
+  header.count = m_count;
+
+  vector<uint8_t> data(sizeof(header) + m_count * sizeof(LineRecord));
+  memcpy(data.data(), &header, sizeof(header));
+  uint8_t *out = data.data() + sizeof(header);
+  for (const LineRecord &record : m_slots) {
+    if (!record.hash)
+      continue;
+    memcpy(out, &record, sizeof(record));
+    out += sizeof(record);
+  }
+  return output::writeFile(path, data);
+}
+
+const LineRecord *LineCache::find(uint64_t hash) const {
+  if (m_slots.empty())
+    return nullptr;
+
+  size_t mask = m_slots.size() - 1;
+  for (size_t i = hash & mask;; i = (i + 1) & mask) {
+    if (m_slots[i].hash == hash)
+      return &m_slots[i];
+    if (!m_slots[i].hash)
+      return nullptr;
+  }
+}
+
+void LineCache::add(const LineRecord &record) {
+  // Stay at most half full so probe runs stay short
+  if ((m_count + 1) * 2 > m_slots.size()) {
+    vector<LineRecord> old(max<size_t>(m_slots.size() * 2, 1024));
+    old.swap(m_slots);
+    m_count = 0;
+    for (const LineRecord &moved : old) {
+      if (moved.hash)
+        add(moved);
+    }
+  }
+
+  size_t mask = m_slots.size() - 1;
+  size_t i = record.hash & mask;
+  for (; m_slots[i].hash; i = (i + 1) & mask) {
+    if (m_slots[i].hash == record.hash)
+      return;
+  }
+  m_slots[i] = record;
+  m_count++;
+}
+
+void LineCache::clear() {
+  m_slots.clear();
+  m_count = 0;
+}
+
+// True if every position of record lies inside text and its opcode and
+// operand kinds exist, so a damaged cache file cannot build a bad row
+static bool fits(const LineRecord &record, string_view text) {
+  if (record.opcode == noStatement)
+    return true;
+  auto inside = [&](uint32_t offset, uint32_t length) {
+    return offset <= text.size() && length <= text.size() - offset;
+  };
+  if (record.opcode >= codegen::opcodeCount ||
+      record.statement > text.size() ||
+      !inside(record.labelOffset, record.labelLength))
+    return false;
+  for (int slot = 0; slot < 2; ++slot) {
+    auto kind = static_cast<ir::OperandKind>(
+        (record.operandKinds >> (4 * slot)) & 0xF);
+    uint32_t value = record.operands[slot];
+    if (kind > ir::OperandKind::Label ||
+        (kind == ir::OperandKind::Label &&
+         !inside(value & 0xFFFF, value >> 16)))
+      return false;
+  }
+  return true;
+}
+
+// Rebuilds the row of a cached line starting at source offset begin, the
+// record must fit the line
+static void applyRecord(const LineRecord &record, string_view text,
+                        size_t begin, int line, ir::Program &code) {
+  if (record.opcode == noStatement)
+    return;
+
+  size_t row = code.append(static_cast<TokenType>(record.opcode), line,
+                           static_cast<uint32_t>(begin + record.statement));
+  for (int slot = 0; slot < 2; ++slot) {
+    auto kind = static_cast<ir::OperandKind>(
+        (record.operandKinds >> (4 * slot)) & 0xF);
+    if (kind == ir::OperandKind::None)
+      continue;
+
+    uint32_t value = record.operands[slot];
+    if (kind == ir::OperandKind::Label)
+      value = code.internSymbol(text.substr(value & 0xFFFF, value >> 16));
+    code.setOperand(row, slot, kind, value);
+  }
+  if (record.labelLength)
+    code.labelDef[row] =
+        code.internSymbol(text.substr(record.labelOffset, record.labelLength));
+}
+
+// Inverse of applyRecord for a row that was just lowered from the AST
+static LineRecord makeRecord(uint64_t hash, string_view text, size_t begin,
+                             const ir::Program &code, size_t row) {
+  // Symbol names point at their first use, which may be on another line, but
+  // any copy of the same text in this line will do
+  auto offsetIn = [&](string_view name) {
+    return static_cast<uint32_t>(text.find(name));
+  };
+
+  LineRecord record{};
+  record.hash = hash;
+  record.opcode = static_cast<uint16_t>(code.opcode[row]);
+  record.statement = static_cast<uint16_t>(code.srcOffset[row] - begin);
+  record.operandKinds = code.operandKinds[row];
+  for (int slot = 0; slot < 2; ++slot) {
+    uint32_t value = code.operand(row, slot);
+    if (code.kind(row, slot) == ir::OperandKind::Label) {
+      string_view name = code.symbols[value];
+      value = offsetIn(name) | static_cast<uint32_t>(name.size()) << 16;
+    }
+    record.operands[slot] = value;
+  }
+  if (uint32_t symbol = code.labelDef[row]; symbol != ir::noSymbol) {
+    string_view name = code.symbols[symbol];
+    record.labelOffset = static_cast<uint16_t>(offsetIn(name));
+    record.labelLength = static_cast<uint16_t>(name.size());
+  }
+  return record;
+}
+
+Stats lowerSource(string_view source, const LineCache &previous,
+                  LineCache &next, ir::Program &code,
+                  unique_ptr<ASTProgram> &scratch, Diagnostics &diagnostics,
+                  includes::Context *includes) {
+  Stats stats;
+  code.clear();
+  next.clear();
+
+  // Line of the first definition of every label, by symbol id
+  vector<int> definedOn;
+
+  const char *src = source.data();
+  size_t size = source.size();
+  int line = 1;
+  for (size_t begin = 0; begin < size && !diagnostics.limitReached();
+       ++line) {
+    size_t newline = scan::findNewline(src, begin, size);
+    size_t end = newline < size ? newline + 1 : size;
+    string_view text = source.substr(begin, newline - begin);
+    // 0 marks an empty cache slot
+    uint64_t hash = max<uint64_t>(hashBytes(text.data(), text.size()), 1);
+    size_t rows = code.size();
+    stats.lines++;
+
+    if (const LineRecord *record = previous.find(hash);
+        record && fits(*record, text)) {
+      applyRecord(*record, text, begin, line, code);
+      next.add(*record);
+      stats.reused++;
+    } else {
+      // Only this line is lexed and parsed, the AST is dropped once lowered.
+      // An INCLUDE line lowers to every statement of the included file.
+      size_t errors = diagnostics.errorCount();
+      Lexer lexer(source, begin, end, line, &diagnostics);
+      Parser parser(lexer, move(scratch), &diagnostics);
+      parser.setIncludes(includes);
+      while (optional<ASTStatement> statement = parser.nextStatement())
+        ir::lowerStatement(*statement, code);
+      // Nothing is left to parse, this only hands the program back
+      scratch = move(parser.parseProgram());
+
+      if (diagnostics.errorCount() == errors && !parser.included() &&
+          text.size() <= maxLineLength) {
+        LineRecord record{};
+        record.hash = hash;
+        record.opcode = noStatement;
+        if (code.size() > rows)
+          record = makeRecord(hash, text, begin, code, rows);
+        next.add(record);
+      }
+    }
+
+    // Same check as the parser's symbol table, cached lines never reach it
+    for (size_t row = rows; row < code.size(); ++row) {
+      uint32_t symbol = code.labelDef[row];
+      if (symbol == ir::noSymbol)
+        continue;
+      if (symbol >= definedOn.size())
+        definedOn.resize(symbol + 1, 0);
+      if (definedOn[symbol]) {
+        string_view name = code.symbols[symbol];
+        diagnostics.error(line, static_cast<int>(text.find(name)),
+                          "Label '%.*s' was already defined on line: %d",
+                          (int)name.size(), name.data(), definedOn[symbol]);
+      } else {
+        definedOn[symbol] = line;
+      }
+    }
+    begin = end;
+  }
+  return stats;
+}
+
+} // namespace incremental
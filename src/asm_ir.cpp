@@ -0,0 +1,242 @@
+#include <asm_ir.h>
+#include <asm_keywords.h>
+#include <cstdio>
+
+namespace ir {
+
+void Program::reserve(size_t rows) {
+  opcode.reserve(rows);
+  operandKinds.reserve(rows);
+  operands.reserve(rows);
+  srcOffset.reserve(rows);
+  line.reserve(rows);
+  file.reserve(rows);
+  address.reserve(rows);
+  labelDef.reserve(rows);
+}
+
+void Program::clear() {
+  opcode.clear();
+  operandKinds.clear();
+  operands.clear();
+  srcOffset.clear();
+  line.clear();
+  file.clear();
+  address.clear();
+  labelDef.clear();
+  symbols.clear();
+  m_symbolIds.clear();
+}
+
+size_t Program::append(TokenType op, int srcLine, uint32_t offset,
+                       uint16_t srcFile) {
+  opcode.push_back(op);
+  operandKinds.push_back(0);
+  operands.push_back(0);
+  srcOffset.push_back(offset);
+  line.push_back(srcLine);
+  file.push_back(srcFile);
+  address.push_back(0);
+  labelDef.push_back(noSymbol);
+  return opcode.size() - 1;
+}
+
+void Program::removeRows(const vector<bool> &removed) {
+  size_t kept = 0;
+  for (size_t row = 0; row < size(); ++row) {
+    if (removed[row])
+      continue;
+    opcode[kept] = opcode[row];
+    operandKinds[kept] = operandKinds[row];
+    operands[kept] = operands[row];
+    srcOffset[kept] = srcOffset[row];
+    line[kept] = line[row];
+    file[kept] = file[row];
+    address[kept] = address[row];
+    labelDef[kept] = labelDef[row];
+    ++kept;
+  }
+  opcode.resize(kept);
+  operandKinds.resize(kept);
+  operands.resize(kept);
+  srcOffset.resize(kept);
+  line.resize(kept);
+  file.resize(kept);
+  address.resize(kept);
+  labelDef.resize(kept);
+}
+
+void Program::setOperand(size_t row, int slot, OperandKind kind,
+                         uint32_t value) {
+  int kindShift = 4 * slot;
+  int valueShift = 32 * slot;
+  operandKinds[row] = static_cast<uint8_t>(
+      (operandKinds[row] & ~(0xF << kindShift)) |
+      (static_cast<uint8_t>(kind) << kindShift));
+  operands[row] = (operands[row] & ~(uint64_t(0xFFFFFFFF) << valueShift)) |
+                  (uint64_t(value) << valueShift);
+}
+
+uint32_t Program::internSymbol(string_view name) {
+  auto [it, inserted] =
+      m_symbolIds.try_emplace(name, static_cast<uint32_t>(symbols.size()));
+  if (inserted)
+    symbols.push_back(name);
+  return it->second;
+}
+
+uint32_t Program::findSymbol(string_view name) const {
+  auto it = m_symbolIds.find(name);
+  return it == m_symbolIds.end() ? noSymbol : it->second;
+}
+
+void Program::Print() const {
+  printf("The IR contents are dumped below:\n");
+  for (size_t row = 0; row < size(); ++row) {
+    string_view name = keywordName(opcode[row]);
+    printf("  %5zu  %04X  line %-5d ", row, address[row], line[row]);
+    if (labelDef[row] != noSymbol)
+      printf("%.*s: ", (int)symbols[labelDef[row]].size(),
+             symbols[labelDef[row]].data());
+    printf("%.*s", (int)name.size(), name.data());
+
+    for (int slot = 0; slot < 2; ++slot) {
+      uint32_t value = operand(row, slot);
+      const char *sep = slot == 0 ? " " : ", ";
+      switch (kind(row, slot)) {
+      case OperandKind::None:
+        break;
+      case OperandKind::Reg:
+        printf("%s%c", sep, "BCDEHLMA"[value]);
+        break;
+      case OperandKind::RegPair:
+        printf("%srp%u", sep, value);
+        break;
+      case OperandKind::Imm8:
+        printf("%s%02XH", sep, value);
+        break;
+      case OperandKind::Imm16:
+        printf("%s%04XH", sep, value);
+        break;
+      case OperandKind::Label:
+        printf("%s%.*s", sep, (int)symbols[value].size(),
+               symbols[value].data());
+        break;
+      }
+    }
+    printf("\n");
+  }
+  printf("\n");
+}
+
+uint8_t registerCode(ast::Register reg) {
+  switch (reg) {
+  case ast::Register::B:
+    return 0;
+  case ast::Register::C:
+    return 1;
+  case ast::Register::D:
+    return 2;
+  case ast::Register::E:
+    return 3;
+  case ast::Register::H:
+    return 4;
+  case ast::Register::L:
+    return 5;
+  case ast::Register::M:
+    return 6;
+  case ast::Register::A:
+    return 7;
+  }
+  return 0;
+}
+
+uint8_t registerPairCode(ast::ExtendedRegister reg) {
+  switch (reg) {
+  case ast::ExtendedRegister::B:
+    return 0;
+  case ast::ExtendedRegister::D:
+    return 1;
+  case ast::ExtendedRegister::H:
+    return 2;
+  case ast::ExtendedRegister::SP:
+  case ast::ExtendedRegister::PSW:
+    return 3;
+  }
+  return 0;
+}
+
+static void lowerOperand(Program &out, size_t row, int slot,
+                         const ASTOperand &operand) {
+  if (auto *reg = get_if<ast::Ptr<ASTRegister>>(&operand.val)) {
+    out.setOperand(row, slot, OperandKind::Reg, registerCode((*reg)->reg));
+  } else if (auto *pair = get_if<ast::Ptr<ASTExtendedRegister>>(&operand.val)) {
+    out.setOperand(row, slot, OperandKind::RegPair,
+                   registerPairCode((*pair)->exReg));
+  } else if (auto *data = get_if<ast::Ptr<ASTImmData>>(&operand.val)) {
+    out.setOperand(row, slot, OperandKind::Imm8, (*data)->value);
+  } else if (auto *addr = get_if<ast::Ptr<ASTImmAddr>>(&operand.val)) {
+    out.setOperand(row, slot, OperandKind::Imm16, (*addr)->value);
+  } else if (auto *label = get_if<ast::Ptr<ASTLabelRef>>(&operand.val)) {
+    out.setOperand(row, slot, OperandKind::Label,
+                   out.internSymbol((*label)->label.rawText));
+  }
+}
+
+static size_t lowerMnemonic(Program &out, const ASTMnemonics &mnemonic) {
+  const Token &token = mnemonic.tokenMnemonic;
+  size_t row =
+      out.append(mnemonic.instruction, token.line, token.offset, token.file);
+
+  if (const ASTOperandList *list = mnemonic.operandList) {
+    if (list->first)
+      lowerOperand(out, row, 0, *list->first);
+    if (list->second)
+      lowerOperand(out, row, 1, *list->second);
+  }
+  return row;
+}
+
+Program lowerProgram(const ASTProgram &program) {
+  Program out;
+  lowerProgram(program, out);
+  return out;
+}
+
+void lowerProgram(const ASTProgram &program, Program &out) {
+  out.clear();
+  out.reserve(program.statements.size());
+
+  for (const ASTStatement &statement : program.statements)
+    lowerStatement(statement, out);
+}
+
+size_t lowerStatement(const ASTStatement &statement, Program &out) {
+  if (auto *mnemonic = get_if<ast::Ptr<ASTMnemonics>>(&statement.sval))
+    return lowerMnemonic(out, **mnemonic);
+
+  if (auto *label = get_if<ast::Ptr<ASTLabelDef>>(&statement.sval)) {
+    size_t row = lowerMnemonic(out, *(*label)->mnemonic);
+    // The statement starts at the label, not at its instruction
+    out.srcOffset[row] = (*label)->tokenLabel.offset;
+    out.labelDef[row] = out.internSymbol((*label)->tokenLabel.rawText);
+    return row;
+  }
+
+  const ASTDirective &directive =
+      *get<ast::Ptr<ASTDirective>>(statement.sval);
+  const Token &token = directive.tokenDirective;
+  size_t row =
+      out.append(directive.type, token.line, token.offset, token.file);
+
+  if (auto *addr = get_if<ast::Ptr<ASTImmAddr>>(&directive.param)) {
+    if (*addr)
+      out.setOperand(row, 0, OperandKind::Imm16, (*addr)->value);
+  } else if (auto *data = get_if<ast::Ptr<ASTImmData>>(&directive.param)) {
+    if (*data)
+      out.setOperand(row, 0, OperandKind::Imm8, (*data)->value);
+  }
+  return row;
+}
+
+} // namespace ir
@@ -1,159 +1,101 @@
+#include <asm_keywords.h>
 #include <asm_lexer.h>
+#include <asm_scan.h>
+#include <cstring>
 
-const static unordered_map<string, TokenType> keywordToToken = {
-    // Data Transfer
-    {"MOV", TokenType::MOV},
-    {"MVI", TokenType::MVI},
-    {"LXI", TokenType::LXI},
-    {"LDA", TokenType::LDA},
-    {"STA", TokenType::STA},
-    {"LHLD", TokenType::LHLD},
-    {"SHLD", TokenType::SHLD},
-    {"LDAX", TokenType::LDAX},
-    {"STAX", TokenType::STAX},
-    {"XCHG", TokenType::XCHG},
-
-    // Arithmetic
-    {"ADD", TokenType::ADD},
-    {"ADI", TokenType::ADI},
-    {"ADC", TokenType::ADC},
-    {"ACI", TokenType::ACI},
-    {"SUB", TokenType::SUB},
-    {"SUI", TokenType::SUI},
-    {"SBB", TokenType::SBB},
-    {"SBI", TokenType::SBI},
-    {"INR", TokenType::INR},
-    {"DCR", TokenType::DCR},
-    {"INX", TokenType::INX},
-    {"DCX", TokenType::DCX},
-    {"DAD", TokenType::DAD},
-    {"DAA", TokenType::DAA},
-
-    // Logical
-    {"ANA", TokenType::ANA},
-    {"ANI", TokenType::ANI},
-    {"XRA", TokenType::XRA},
-    {"XRI", TokenType::XRI},
-    {"ORA", TokenType::ORA},
-    {"ORI", TokenType::ORI},
-    {"CMP", TokenType::CMP},
-    {"CPI", TokenType::CPI},
-    {"RLC", TokenType::RLC},
-    {"RRC", TokenType::RRC},
-    {"RAL", TokenType::RAL},
-    {"RAR", TokenType::RAR},
-    {"CMA", TokenType::CMA},
-    {"CMC", TokenType::CMC},
-    {"STC", TokenType::STC},
-
-    // Branch
-    {"JMP", TokenType::JMP},
-    {"JC", TokenType::JC},
-    {"JNC", TokenType::JNC},
-    {"JZ", TokenType::JZ},
-    {"JNZ", TokenType::JNZ},
-    {"JP", TokenType::JP},
-    {"JM", TokenType::JM},
-    {"JPE", TokenType::JPE},
-    {"JPO", TokenType::JPO},
-    {"CALL", TokenType::CALL},
-    {"CC", TokenType::CC},
-    {"CNC", TokenType::CNC},
-    {"CZ", TokenType::CZ},
-    {"CNZ", TokenType::CNZ},
-    {"CP", TokenType::CP},
-    {"CM", TokenType::CM},
-    {"CPE", TokenType::CPE},
-    {"CPO", TokenType::CPO},
-    {"RET", TokenType::RET},
-    {"RC", TokenType::RC},
-    {"RNC", TokenType::RNC},
-    {"RZ", TokenType::RZ},
-    {"RNZ", TokenType::RNZ},
-    {"RP", TokenType::RP},
-    {"RM", TokenType::RM},
-    {"RPE", TokenType::RPE},
-    {"RPO", TokenType::RPO},
-    {"RST", TokenType::RST},
-    {"PCHL", TokenType::PCHL},
-
-    // Stack & Machine Control
-    {"PUSH", TokenType::PUSH},
-    {"POP", TokenType::POP},
-    {"XTHL", TokenType::XTHL},
-    {"SPHL", TokenType::SPHL},
-    {"IN", TokenType::IN},
-    {"OUT", TokenType::OUT},
-    {"HLT", TokenType::HLT},
-    {"NOP", TokenType::NOP},
-    {"DI", TokenType::DI},
-    {"EI", TokenType::EI},
-    {"RIM", TokenType::RIM},
-    {"SIM", TokenType::SIM},
-
-    // Directives
-    {"ORG", TokenType::ORG},
-    {"DB", TokenType::DB}};
-
-Lexer::Lexer(string &src)
-    : m_source(std::move(src)), m_pos(0), m_line(1), m_col(0) {}
+Lexer::Lexer(string_view src, Diagnostics *diagnostics)
+    : m_diagnostics(diagnostics ? diagnostics : &m_ownDiagnostics),
+      m_source(src), m_pos(0), m_line(1), m_col(0) {}
+
+Lexer::Lexer(string_view src, size_t begin, size_t end, int firstLine,
+             Diagnostics *diagnostics)
+    : m_diagnostics(diagnostics ? diagnostics : &m_ownDiagnostics),
+      m_source(src.substr(0, end)), m_pos(begin), m_line(firstLine),
+      m_col(0) {}
 
 vector<Token> Lexer::tokenize() {
   vector<Token> tokens;
 
-  while (peek().has_value()) {
-    char curr = consume();
-    if (isspace(curr)) {
-      if (curr == '\n') {
-        tokens.emplace_back(createToken(TokenType::EndOfLine, "\\n"));
-        m_line++;
-        m_col = 0;
-      }
-      continue;
-    } else if (isalpha(curr)) {
-      string curr_str(1, curr);
-      while (peek().has_value() &&
-             (isalpha(peek().value()) || peek().value() == '_'))
-        curr_str += consume();
-
-      if (keywordToToken.find(curr_str) != keywordToToken.end())
-        tokens.emplace_back(createToken(keywordToToken.at(curr_str), curr_str));
-      else
-        tokens.emplace_back(createToken(TokenType::Identifier, curr_str));
-    } else if (isdigit(curr)) {
-      string num(1, curr);
-      while (peek().has_value() &&
-             (isdigit(peek().value()) || peek().value() == 'H' ||
-              peek().value() == 'h'))
-        num += consume();
-      tokens.emplace_back(createToken(TokenType::Number, num));
+  while (true) {
+    tokens.emplace_back(next());
+    if (tokens.back().type == TokenType::EndOfFile)
+      break;
+  }
+
+  if (m_error)
+    return {}; // Empty vector
+  return tokens;
+}
+
+Token Lexer::next() {
+  const char *src = m_source.data();
+  size_t end = m_source.size();
+
+  while (m_pos < end) {
+    size_t start = m_pos;
+    char curr = src[m_pos];
+    uint8_t cls = scan::classOf(curr);
+
+    if (cls & scan::Space) {
+      advanceTo(scan::skipSpaces(src, m_pos + 1, end));
+    } else if (cls & scan::Newline) {
+      consume();
+      Token eol = createToken(TokenType::EndOfLine, "\\n");
+      m_line++;
+      m_col = 0;
+      return eol;
+    } else if (cls & scan::Alpha) {
+      advanceTo(scan::skipIdentifier(src, m_pos + 1, end));
+
+      string_view word = m_source.substr(start, m_pos - start);
+      TokenType type = lookupKeyword(word).value_or(TokenType::Identifier);
+      return createToken(type, start);
+    } else if (cls & scan::Digit) {
+      consume();
+      while (m_pos < end && (scan::classOf(src[m_pos]) & scan::NumberTail))
+        consume();
+      return createToken(TokenType::Number, start);
     } else if (curr == ',') {
-      tokens.emplace_back(createToken(TokenType::Comma, string(1, curr)));
+      consume();
+      return createToken(TokenType::Comma, start);
     } else if (curr == ':') {
-      tokens.emplace_back(createToken(TokenType::Colon, string(1, curr)));
+      consume();
+      return createToken(TokenType::Colon, start);
+    } else if (curr == '"') {
+      // A string ends on the same line, there are no escapes
+      size_t newline = scan::findNewline(src, m_pos + 1, end);
+      const void *quote = memchr(src + m_pos + 1, '"', newline - m_pos - 1);
+      if (!quote) {
+        m_diagnostics->error(m_line, m_col,
+                             "Missing the '\"' that ends the string");
+        m_error = true;
+        advanceTo(newline);
+        continue;
+      }
+      advanceTo(static_cast<const char *>(quote) - src + 1);
+      return createToken(TokenType::String, start);
     } else if (curr == ';') {
       // Start of comment, skip until end of line
-      while (peek().has_value() && peek().value() != '\n')
-        consume();
+      advanceTo(scan::findNewline(src, m_pos + 1, end));
     } else {
-      Logger::fmtLog(LogLevel::Error,
-                     "Unexpected character '%c' at line %d, column %d", curr,
-                     m_line + 1, m_col);
-      return {}; // Empty vector
+      // Report and keep going, the parser decides whether the line survives
+      m_diagnostics->error(m_line, m_col, "Unexpected character '%c'", curr);
+      m_error = true;
+      consume();
     }
   }
 
-  // Emplace back eof
-  tokens.emplace_back(createToken(TokenType::EndOfLine, ""));
-  tokens.emplace_back(createToken(TokenType::EndOfFile, ""));
-  return tokens;
+  // Close the last line once, then report eof
+  if (!m_finalEol) {
+    m_finalEol = true;
+    return createToken(TokenType::EndOfLine, "");
+  }
+  return createToken(TokenType::EndOfFile, "");
 }
 
-optional<char> Lexer::peek() {
-  if (m_pos < m_source.size()) {
-    return m_source[m_pos];
-  }
-  return {};
+void Lexer::advanceTo(size_t pos) {
+  m_col += static_cast<int>(pos - m_pos);
+  m_pos = pos;
 }
 
 char Lexer::consume() {
@@ -161,7 +103,97 @@ char Lexer::consume() {
   return m_source[m_pos++];
 }
 
-Token Lexer::createToken(TokenType ttype, const string &rawText) {
-  return Token{ttype, rawText, m_line,
-               m_col - static_cast<int>(rawText.size())};
+Token Lexer::createToken(TokenType ttype, size_t start) {
+  size_t length = m_pos - start;
+  return Token{ttype, 0, static_cast<uint32_t>(start),
+               m_source.substr(start, length), m_line,
+               m_col - static_cast<int>(length)};
+}
+
+Token Lexer::createToken(TokenType ttype, string_view text) {
+  return Token{ttype, 0, static_cast<uint32_t>(m_pos), text, m_line,
+               m_col - static_cast<int>(text.size())};
+}
+
+TokenStream::TokenStream(vector<Token> tokens)
+    : m_tokens(std::move(tokens)), m_streaming(false) {}
+
+TokenStream::TokenStream(Lexer &lexer) : m_streaming(true), m_lexer(&lexer) {}
+
+bool TokenStream::pull(Token &token) {
+  while (!m_includes.empty()) {
+    Include &include = m_includes.back();
+    token = (*include.tokens)[include.next++];
+    if (token.type != TokenType::EndOfFile) {
+      token.file = include.file;
+      token.line = include.line;
+      return true;
+    }
+    m_includes.pop_back();
+  }
+
+  if (m_lexer) {
+    token = m_lexer->next();
+    return true;
+  }
+  if (m_nextToken == m_tokens.size())
+    return false;
+  token = m_tokens[m_nextToken++];
+  return true;
+}
+
+optional<Token> TokenStream::peek(int next) {
+  // Defaults next = 0
+  if (next < 0 && m_current < static_cast<size_t>(-next))
+    return {};
+  size_t index = m_current + next;
+
+  if (!m_streaming) {
+    if (index < m_tokens.size())
+      return m_tokens[index];
+    return {};
+  }
+
+  // Pull until the requested token is in the ring, stopping after eof
+  while (m_pulled <= index && !m_done) {
+    Token &token = m_ring[m_pulled % ringSize];
+    if (!pull(token)) {
+      m_done = true;
+      break;
+    }
+    m_done = token.type == TokenType::EndOfFile;
+    m_pulled++;
+  }
+  if (index >= m_pulled || m_pulled - index > ringSize)
+    return {};
+  return m_ring[index % ringSize];
+}
+
+Token TokenStream::consume() {
+  if (!m_streaming)
+    return m_tokens[m_current++];
+
+  peek();
+  return m_ring[m_current++ % ringSize];
+}
+
+void TokenStream::include(const vector<Token> &tokens, uint16_t file,
+                          int line) {
+  if (!m_streaming) {
+    // Continue from the ring, keeping the tokens peek(-n) can still reach
+    for (size_t index = m_current > ringSize ? m_current - ringSize : 0;
+         index < m_current; ++index)
+      m_ring[index % ringSize] = m_tokens[index];
+    m_nextToken = m_pulled = m_current;
+    m_streaming = true;
+  }
+  m_includes.push_back({&tokens, 0, file, line});
+}
+
+bool TokenStream::including(uint16_t file) const {
+  for (const Include &include : m_includes) {
+    if (include.file == file)
+      return true;
+  }
+  return false;
 }
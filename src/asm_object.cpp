@@ -0,0 +1,336 @@
+#include <ByteStream.h>
+#include <Logger.h>
+#include <Profiler.h>
+#include <ThreadPool.h>
+#include <algorithm>
+#include <asm_object.h>
+#include <fstream>
+#include <iterator>
+#include <unordered_map>
+
+namespace object {
+
+// "C85O" in the byte order ByteWriter uses
+static constexpr uint32_t objectMagic = 0x4F353843;
+static constexpr uint32_t objectVersion = 1;
+static constexpr uint32_t addressSpace = 0x10000;
+
+uint32_t Module::relocatableSize() const {
+  return !sections.empty() && sections[0].relocatable
+             ? static_cast<uint32_t>(sections[0].bytes.size())
+             : 0;
+}
+
+vector<uint8_t> write(const ir::Program &program,
+                      const codegen::MachineCode &code) {
+  // Rows before the first ORG were assembled from address 0 and are the
+  // relocatable section, if any of them emits bytes
+  size_t firstOrg = 0;
+  bool leading = false;
+  for (; firstOrg < program.size() &&
+         program.opcode[firstOrg] != TokenType::ORG;
+       ++firstOrg)
+    leading |= codegen::opcodeInfo(program.opcode[firstOrg]).size != 0;
+
+  vector<Binding> bindings(program.symbols.size(), Binding::Import);
+  for (size_t row = 0; row < program.size(); ++row) {
+    if (uint32_t symbol = program.labelDef[row]; symbol != ir::noSymbol)
+      bindings[symbol] = row < firstOrg ? Binding::Relative : Binding::Absolute;
+  }
+
+  ByteWriter out;
+  out.u32(objectMagic);
+  out.u32(objectVersion);
+
+  out.u32(static_cast<uint32_t>(code.sections.size()));
+  for (size_t index = 0; index < code.sections.size(); ++index) {
+    const codegen::Section &section = code.sections[index];
+    out.u8(leading && index == 0);
+    out.u32(section.origin);
+    out.text(string_view(
+        reinterpret_cast<const char *>(code.bytes.data()) + section.offset,
+        section.size));
+  }
+
+  out.u32(static_cast<uint32_t>(program.symbols.size()));
+  for (uint32_t symbol = 0; symbol < program.symbols.size(); ++symbol) {
+    out.text(program.symbols[symbol]);
+    out.u8(static_cast<uint8_t>(bindings[symbol]));
+    out.u32(bindings[symbol] == Binding::Import ? 0
+                                                : code.symbolAddress[symbol]);
+  }
+
+  // Relocations come in byte order, so do the sections
+  out.u32(static_cast<uint32_t>(code.relocations.size()));
+  uint32_t index = 0;
+  for (const codegen::Relocation &relocation : code.relocations) {
+    while (relocation.position >=
+           code.sections[index].offset + code.sections[index].size)
+      ++index;
+    out.u32(index);
+    out.u32(relocation.position - code.sections[index].offset);
+    out.u32(relocation.symbol);
+  }
+  return out.data();
+}
+
+bool read(const vector<uint8_t> &data, Module &module) {
+  ByteReader in(data);
+  if (in.u32() != objectMagic || in.u32() != objectVersion)
+    return false;
+
+  // Every entry takes bytes of its own, a larger count is damage and must
+  // not turn into a huge allocation
+  uint32_t sections = in.u32();
+  if (sections > data.size())
+    return false;
+  module.sections.resize(sections);
+  for (size_t index = 0; index < module.sections.size() && in.ok(); ++index) {
+    Section &section = module.sections[index];
+    section.relocatable = in.u8() != 0;
+    uint32_t origin = in.u32();
+    string_view bytes = in.text();
+    if ((section.relocatable && index != 0) ||
+        origin + bytes.size() > addressSpace)
+      return false;
+    section.origin = static_cast<uint16_t>(origin);
+    section.bytes.assign(bytes.begin(), bytes.end());
+  }
+
+  uint32_t symbols = in.u32();
+  if (symbols > data.size())
+    return false;
+  module.symbols.resize(symbols);
+  for (Symbol &symbol : module.symbols) {
+    if (!in.ok())
+      return false;
+    symbol.name = in.text();
+    uint8_t binding = in.u8();
+    uint32_t value = in.u32();
+    if (binding > static_cast<uint8_t>(Binding::Absolute) ||
+        value >= addressSpace)
+      return false;
+    symbol.binding = static_cast<Binding>(binding);
+    symbol.value = static_cast<uint16_t>(value);
+  }
+
+  uint32_t relocations = in.u32();
+  if (relocations > data.size())
+    return false;
+  module.relocations.resize(relocations);
+  for (Relocation &relocation : module.relocations) {
+    if (!in.ok())
+      return false;
+    relocation.section = in.u32();
+    relocation.offset = in.u32();
+    relocation.symbol = in.u32();
+    if (relocation.section >= module.sections.size() ||
+        relocation.symbol >= module.symbols.size() ||
+        module.sections[relocation.section].bytes.size() < 2 ||
+        relocation.offset >
+            module.sections[relocation.section].bytes.size() - 2)
+      return false;
+  }
+  return in.ok();
+}
+
+static bool readFile(const string &path, vector<uint8_t> &data) {
+  ifstream in(path, ios::binary);
+  if (!in)
+    return false;
+  data.assign(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+  return !in.bad();
+}
+
+// Logs the errors of every module in order, true if there were none
+static bool logErrors(const vector<vector<string>> &errors) {
+  bool ok = true;
+  for (const vector<string> &moduleErrors : errors) {
+    for (const string &error : moduleErrors) {
+      Logger::fmtLog(LogLevel::Error, "%s", error.c_str());
+      ok = false;
+    }
+  }
+  return ok;
+}
+
+static constexpr uint32_t noModule = UINT32_MAX;
+
+// Where an exported label ended up
+struct Export {
+  uint32_t module;
+  uint32_t other = noModule; // a second module defining the same name
+  uint16_t address;
+};
+
+bool link(const vector<string> &objectFiles, const LinkOptions &options,
+          codegen::MachineCode &out, image::Image &image) {
+  size_t count = objectFiles.size();
+  ThreadPool pool(options.threads);
+  vector<Module> modules(count);
+  vector<vector<string>> errors(count);
+
+  {
+    ProfileScope scope("read");
+    pool.parallelFor(count, [&](size_t index, unsigned) {
+      const string &path = objectFiles[index];
+      vector<uint8_t> data;
+      if (!readFile(path, data))
+        errors[index].push_back("Failed to open object file: " + path);
+      else if (!read(data, modules[index]))
+        errors[index].push_back(path + ": not a c85 object or damaged");
+      modules[index].path = path;
+    });
+  }
+  if (!logErrors(errors))
+    return false;
+
+  // Relocatable sections go one after the other, past absolute sections
+  // in their way. Ranges sorted by start are passed in one sweep: once a
+  // section moved past a range, no earlier range can reach it.
+  vector<uint16_t> base(count, 0);
+  {
+    ProfileScope scope("layout");
+    vector<pair<uint32_t, uint32_t>> fixed; // [begin, end)
+    for (const Module &module : modules) {
+      for (const Section &section : module.sections) {
+        if (!section.relocatable)
+          fixed.push_back({section.origin, section.origin +
+                                               static_cast<uint32_t>(
+                                                   section.bytes.size())});
+      }
+    }
+    sort(fixed.begin(), fixed.end());
+
+    uint32_t cursor = options.base;
+    for (size_t index = 0; index < count; ++index) {
+      uint32_t size = modules[index].relocatableSize();
+      if (!size)
+        continue;
+      uint32_t at = cursor;
+      for (const auto &[begin, end] : fixed) {
+        if (begin < at + size && at < end)
+          at = end;
+      }
+      if (at + size > addressSpace) {
+        Logger::fmtLog(LogLevel::Error,
+                       "%s: %u bytes of relocatable code do not fit below "
+                       "10000H",
+                       modules[index].path.c_str(), size);
+        return false;
+      }
+      base[index] = static_cast<uint16_t>(at);
+      cursor = at + size;
+    }
+  }
+
+  // Every module exports all of its labels
+  unordered_map<string_view, Export> exports;
+  {
+    ProfileScope scope("symbols");
+    for (uint32_t index = 0; index < count; ++index) {
+      for (const Symbol &symbol : modules[index].symbols) {
+        if (symbol.binding == Binding::Import)
+          continue;
+        uint16_t address = symbol.binding == Binding::Relative
+                               ? static_cast<uint16_t>(base[index] +
+                                                       symbol.value)
+                               : symbol.value;
+        auto [it, added] = exports.try_emplace(symbol.name,
+                                               Export{index, noModule,
+                                                      address});
+        if (!added && it->second.other == noModule)
+          it->second.other = index;
+      }
+    }
+  }
+
+  // Sections keep the order of the objects, each module copies and patches
+  // its own bytes
+  out.bytes.clear();
+  out.sections.clear();
+  out.symbolAddress.clear();
+  out.symbolDefined.clear();
+  out.relocations.clear();
+  vector<size_t> firstSection(count);
+  uint32_t total = 0;
+  for (size_t index = 0; index < count; ++index) {
+    firstSection[index] = out.sections.size();
+    for (const Section &section : modules[index].sections) {
+      uint32_t size = static_cast<uint32_t>(section.bytes.size());
+      out.sections.push_back(
+          {section.relocatable ? base[index] : section.origin, total, size});
+      total += size;
+    }
+  }
+  out.bytes.resize(total);
+
+  ProfileScope scope("relocate", total);
+  pool.parallelFor(count, [&](size_t index, unsigned) {
+    const Module &module = modules[index];
+    for (size_t s = 0; s < module.sections.size(); ++s) {
+      const vector<uint8_t> &bytes = module.sections[s].bytes;
+      copy(bytes.begin(), bytes.end(),
+           out.bytes.begin() + out.sections[firstSection[index] + s].offset);
+    }
+
+    // Every symbol is looked up once, and reported once if it fails
+    static constexpr uint32_t unresolved = UINT32_MAX;
+    static constexpr uint32_t failed = UINT32_MAX - 1;
+    vector<uint32_t> resolved(module.symbols.size(), unresolved);
+    auto resolve = [&](uint32_t id) {
+      const Symbol &symbol = module.symbols[id];
+      if (symbol.binding == Binding::Relative)
+        return static_cast<uint32_t>(
+            static_cast<uint16_t>(base[index] + symbol.value));
+      if (symbol.binding == Binding::Absolute)
+        return static_cast<uint32_t>(symbol.value);
+
+      auto it = exports.find(symbol.name);
+      if (it == exports.end()) {
+        errors[index].push_back(module.path + ": Undefined label '" +
+                                symbol.name + "'");
+        return failed;
+      }
+      if (it->second.other != noModule) {
+        errors[index].push_back(
+            module.path + ": Label '" + symbol.name + "' is defined in " +
+            modules[it->second.module].path + " and " +
+            modules[it->second.other].path);
+        return failed;
+      }
+      return static_cast<uint32_t>(it->second.address);
+    };
+
+    for (const Relocation &relocation : module.relocations) {
+      uint32_t &address = resolved[relocation.symbol];
+      if (address == unresolved)
+        address = resolve(relocation.symbol);
+      if (address == failed)
+        continue;
+      uint32_t position =
+          out.sections[firstSection[index] + relocation.section].offset +
+          relocation.offset;
+      out.bytes[position] = static_cast<uint8_t>(address & 0xFF);
+      out.bytes[position + 1] = static_cast<uint8_t>(address >> 8);
+    }
+  });
+  if (!logErrors(errors))
+    return false;
+
+  for (size_t index = 0; index < count; ++index) {
+    for (size_t s = 0; s < modules[index].sections.size(); ++s) {
+      const codegen::Section &section = out.sections[firstSection[index] + s];
+      if (uint32_t bytes = image.write(
+              section.origin, out.bytes.data() + section.offset, section.size))
+        Logger::fmtLog(LogLevel::Warning,
+                       "%s: code at %04XH-%04XH overwrites %u bytes of "
+                       "earlier code",
+                       modules[index].path.c_str(), section.origin,
+                       section.origin + section.size - 1, bytes);
+    }
+  }
+  return true;
+}
+
+} // namespace object
@@ -0,0 +1,165 @@
+#include <Logger.h>
+#include <array>
+#include <asm_output.h>
+#include <cstring>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace output {
+
+// Two upper-case hex digits for every byte value
+static constexpr array<array<char, 2>, 256> buildHexTable() {
+  constexpr char digits[] = "0123456789ABCDEF";
+  array<array<char, 2>, 256> table{};
+  for (int i = 0; i < 256; ++i)
+    table[i] = {digits[i >> 4], digits[i & 0xF]};
+  return table;
+}
+
+static constexpr array<array<char, 2>, 256> hexTable = buildHexTable();
+
+static inline uint8_t *putHex8(uint8_t *out, uint8_t value) {
+  memcpy(out, hexTable[value].data(), 2);
+  return out + 2;
+}
+
+static inline uint8_t *putHex16(uint8_t *out, uint16_t value) {
+  out = putHex8(out, static_cast<uint8_t>(value >> 8));
+  return putHex8(out, static_cast<uint8_t>(value & 0xFF));
+}
+
+vector<uint8_t> formatRaw(const image::Image &image) {
+  vector<uint8_t> bytes(image.high() - image.low());
+  image.copy(image.low(), image.high(), bytes.data());
+  return bytes;
+}
+
+vector<uint8_t> formatHexDump(const codegen::MachineCode &code) {
+  // "AAAA:" + " XX" per byte + '\n' per line of up to 16 bytes
+  size_t total = 0;
+  for (const codegen::Section &section : code.sections) {
+    size_t lines = (section.size + 15) / 16;
+    total += lines * 6 + section.size * 3;
+  }
+
+  vector<uint8_t> buffer(total);
+  uint8_t *out = buffer.data();
+  for (const codegen::Section &section : code.sections) {
+    const uint8_t *bytes = code.bytes.data() + section.offset;
+    for (uint32_t i = 0; i < section.size; i += 16) {
+      uint32_t count = min<uint32_t>(16, section.size - i);
+      out = putHex16(out, static_cast<uint16_t>(section.origin + i));
+      *out++ = ':';
+      for (uint32_t j = 0; j < count; ++j) {
+        *out++ = ' ';
+        out = putHex8(out, bytes[i + j]);
+      }
+      *out++ = '\n';
+    }
+  }
+  return buffer;
+}
+
+vector<uint8_t> formatIntelHex(const image::Image &image) {
+  // ":LLAAAATT" + data + "CC\n", records never cross the 64KB boundary
+  static constexpr char eofRecord[] = ":00000001FF\n";
+  static constexpr uint32_t recordBytes = 16;
+
+  size_t total = sizeof(eofRecord) - 1;
+  image.forEachRun([&](uint16_t, const uint8_t *, uint32_t size) {
+    size_t records = (size + recordBytes - 1) / recordBytes;
+    total += records * 12 + size * 2;
+  });
+
+  vector<uint8_t> buffer(total);
+  uint8_t *out = buffer.data();
+  image.forEachRun([&](uint16_t origin, const uint8_t *bytes, uint32_t size) {
+    for (uint32_t i = 0; i < size; i += recordBytes) {
+      uint8_t count = static_cast<uint8_t>(min(recordBytes, size - i));
+      uint16_t address = static_cast<uint16_t>(origin + i);
+
+      // Checksum is the two's complement of the sum of all record bytes
+      uint8_t sum = count + (address >> 8) + (address & 0xFF);
+      *out++ = ':';
+      out = putHex8(out, count);
+      out = putHex16(out, address);
+      out = putHex8(out, 0x00); // data record
+      for (uint8_t j = 0; j < count; ++j) {
+        sum += bytes[i + j];
+        out = putHex8(out, bytes[i + j]);
+      }
+      out = putHex8(out, static_cast<uint8_t>(-sum));
+      *out++ = '\n';
+    }
+  });
+  memcpy(out, eofRecord, sizeof(eofRecord) - 1);
+  return buffer;
+}
+
+vector<uint8_t> formatOutput(const codegen::MachineCode &code,
+                             const image::Image &image, Format format) {
+  switch (format) {
+  case Format::Raw:
+    return formatRaw(image);
+  case Format::IntelHex:
+    return formatIntelHex(image);
+  case Format::HexDump:
+  default:
+    return formatHexDump(code);
+  }
+}
+
+bool writeFile(const string &path, const vector<uint8_t> &data) {
+#ifdef _WIN32
+  HANDLE file = CreateFileA(path.c_str(), GENERIC_WRITE, 0, nullptr,
+                            CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (file == INVALID_HANDLE_VALUE) {
+    Logger::fmtLog(LogLevel::Error, "Failed to open output file: %s",
+                   path.c_str());
+    return false;
+  }
+
+  DWORD written = 0;
+  bool ok = data.empty() ||
+            (WriteFile(file, data.data(), static_cast<DWORD>(data.size()),
+                       &written, nullptr) &&
+             written == data.size());
+  CloseHandle(file);
+#else
+  int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    Logger::fmtLog(LogLevel::Error, "Failed to open output file: %s (%s)",
+                   path.c_str(), strerror(errno));
+    return false;
+  }
+
+  // One call in practice, the loop only covers short writes
+  bool ok = true;
+  size_t done = 0;
+  while (done < data.size()) {
+    ssize_t n = ::write(fd, data.data() + done, data.size() - done);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0) {
+      ok = false;
+      break;
+    }
+    done += static_cast<size_t>(n);
+  }
+  ok = (::close(fd) == 0) && ok;
+#endif
+
+  if (!ok)
+    Logger::fmtLog(LogLevel::Error, "Failed to write output file: %s",
+                   path.c_str());
+  return ok;
+}
+
+} // namespace output
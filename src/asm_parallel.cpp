@@ -0,0 +1,116 @@
+#include <algorithm>
+#include <asm_lexer.h>
+#include <asm_parallel.h>
+#include <asm_parser.h>
+#include <asm_scan.h>
+#include <iterator>
+
+// Small enough to give every worker a few chunks to balance the load with
+static constexpr size_t minChunkSize = 64 * 1024;
+
+struct Chunk {
+  size_t begin;
+  size_t end;
+  int firstLine = 1;
+  unique_ptr<ASTProgram> program;
+  Diagnostics diagnostics;
+  unordered_map<string, ast::symbolDebugInfo> symbols;
+};
+
+// Cuts right after the first newline at or past every ideal boundary
+static vector<Chunk> splitSource(string_view source, size_t count) {
+  vector<Chunk> chunks;
+  size_t size = source.size();
+  size_t begin = 0;
+  for (size_t i = 1; i <= count && begin < size; ++i) {
+    size_t end = size;
+    if (i < count) {
+      end = scan::findNewline(source.data(), max(begin, i * size / count),
+                              size);
+      end = min(end + 1, size);
+    }
+    Chunk chunk;
+    chunk.begin = begin;
+    chunk.end = end;
+    chunks.push_back(move(chunk));
+    begin = end;
+  }
+  return chunks;
+}
+
+unique_ptr<ASTProgram> parseParallel(string_view source, ThreadPool &pool,
+                                     Diagnostics &diagnostics,
+                                     unique_ptr<ASTProgram> program,
+                                     includes::Context *includes) {
+  if (!program)
+    program = std::make_unique<ASTProgram>();
+  program->reset();
+
+  size_t count =
+      clamp<size_t>(source.size() / minChunkSize, 1, pool.size() * 4);
+  vector<Chunk> chunks = splitSource(source, count);
+
+  // Line numbers: every chunk starts after the newlines of the ones before
+  vector<size_t> newlines(chunks.size());
+  pool.parallelFor(chunks.size(), [&](size_t i, unsigned) {
+    newlines[i] =
+        scan::countNewlines(source.data(), chunks[i].begin, chunks[i].end);
+  });
+  int line = 1;
+  for (size_t i = 0; i < chunks.size(); ++i) {
+    chunks[i].firstLine = line;
+    line += static_cast<int>(newlines[i]);
+  }
+
+  if (program->chunkArenas.size() < chunks.size())
+    program->chunkArenas.resize(chunks.size());
+
+  pool.parallelFor(chunks.size(), [&](size_t i, unsigned) {
+    Chunk &chunk = chunks[i];
+    chunk.diagnostics.setErrorLimit(diagnostics.errorLimit());
+
+    // Reuses the arena this chunk had in the previous compilation
+    unique_ptr<ASTProgram> chunkProgram = std::make_unique<ASTProgram>();
+    chunkProgram->arena = move(program->chunkArenas[i]);
+
+    Lexer lexer(source, chunk.begin, chunk.end, chunk.firstLine,
+                &chunk.diagnostics);
+    Parser parser(lexer, move(chunkProgram), &chunk.diagnostics);
+    parser.setIncludes(includes);
+    chunk.program = move(parser.parseProgram());
+    chunk.symbols = move(parser.getSymbolTable());
+  });
+
+  // Merge in source order. Errors are collected without a limit first so the
+  // limit keeps the earliest ones once everything is sorted by line.
+  Diagnostics found;
+  unordered_map<string, ast::symbolDebugInfo> symbols;
+  size_t statements = 0;
+  for (const Chunk &chunk : chunks)
+    statements += chunk.program->statements.size();
+  program->statements.reserve(statements);
+
+  for (size_t i = 0; i < chunks.size(); ++i) {
+    Chunk &chunk = chunks[i];
+    found.append(chunk.diagnostics);
+
+    for (auto &[name, info] : chunk.symbols) {
+      auto [symbol, inserted] = symbols.try_emplace(name, info);
+      if (!inserted)
+        found.error(info.lineNumber, info.column,
+                    "Label '%s' was already defined on line: %d",
+                    name.c_str(), symbol->second.lineNumber);
+    }
+
+    vector<ASTStatement> &from = chunk.program->statements;
+    program->statements.insert(program->statements.end(),
+                               make_move_iterator(from.begin()),
+                               make_move_iterator(from.end()));
+    // The nodes stay where they are, the arena now belongs to program
+    program->chunkArenas[i] = move(chunk.program->arena);
+  }
+
+  found.sortByLine();
+  diagnostics.append(found);
+  return program;
+}
@@ -1,25 +1,51 @@
 #include <asm_parser.h>
+#include <charconv>
+#include <cstdio>
+#include <limits>
+
+// Thrown once an error on the current line has been reported, caught by
+// parseLine which resumes at the next line
+struct ParseError {};
 
 static bool isDirective(TokenType tt) {
-  return tt == TokenType::ORG || tt == TokenType::DB;
+  return tt >= TokenType::ORG && tt <= TokenType::ENDCYC;
 }
 
-static bool isMnemonic(TokenType tt) {
-  uint16_t t = static_cast<uint16_t>(tt);
+static bool isMnemonic(TokenType type) { return type <= TokenType::SIM; }
 
-  return (0 <= t && t < 79U);
+// Register names are case-insensitive, like mnemonics
+static bool equalsUpper(string_view ident, string_view upper) {
+  if (ident.size() != upper.size())
+    return false;
+  for (size_t i = 0; i < ident.size(); ++i) {
+    if (toupper(static_cast<unsigned char>(ident[i])) != upper[i])
+      return false;
+  }
+  return true;
 }
 
-static optional<ast::Register> identToRegister(const string &ident) {
+static optional<ast::Register> identToRegister(string_view ident) {
   if (ident.size() > 1)
     return {};
 
-  return static_cast<ast::Register>(ident[0]);
+  switch (toupper(static_cast<unsigned char>(ident[0]))) {
+  case 'A':
+  case 'B':
+  case 'C':
+  case 'D':
+  case 'E':
+  case 'H':
+  case 'L':
+  case 'M':
+    return static_cast<ast::Register>(
+        toupper(static_cast<unsigned char>(ident[0])));
+  }
+  return {};
 }
 
-static optional<ast::ExtendedRegister> identToSpRegister(const string &ident) {
+static optional<ast::ExtendedRegister> identToSpRegister(string_view ident) {
   if (ident.size() == 1) {
-    switch (ident[0]) {
+    switch (toupper(static_cast<unsigned char>(ident[0]))) {
     case 'B':
       return ast::ExtendedRegister::B;
     case 'D':
@@ -28,23 +54,49 @@ static optional<ast::ExtendedRegister> identToSpRegister(const string &ident) {
       return ast::ExtendedRegister::H;
     }
   }
-  if (ident == "PSW")
+  if (equalsUpper(ident, "PSW"))
     return ast::ExtendedRegister::PSW;
-  if (ident == "SP")
+  if (equalsUpper(ident, "SP"))
     return ast::ExtendedRegister::SP;
   return {};
 }
 
-Parser::Parser(vector<Token> &tokens)
-    : m_tokens(move(tokens)), m_program(std::make_unique<ASTProgram>()) {}
+// Reuses a program (and its arena) from an earlier run when one is given
+static unique_ptr<ASTProgram> recycleProgram(unique_ptr<ASTProgram> program) {
+  if (!program)
+    return std::make_unique<ASTProgram>();
+  program->reset();
+  return program;
+}
+
+Parser::Parser(vector<Token> &tokens, unique_ptr<ASTProgram> program,
+               Diagnostics *diagnostics)
+    : m_program(recycleProgram(move(program))), m_tokens(move(tokens)),
+      m_diagnostics(diagnostics ? diagnostics : &m_ownDiagnostics) {}
 
-ast::Ptr<ASTProgram> &Parser::parseProgram() {
+Parser::Parser(Lexer &lexer, unique_ptr<ASTProgram> program,
+               Diagnostics *diagnostics)
+    : m_program(recycleProgram(move(program))), m_tokens(lexer),
+      m_diagnostics(diagnostics ? diagnostics : &lexer.diagnostics()) {}
+
+unique_ptr<ASTProgram> &Parser::parseProgram() {
+  while (optional<ASTStatement> statement = nextStatement())
+    m_program->statements.emplace_back(move(statement.value()));
+  return m_program;
+}
+
+optional<ASTStatement> Parser::nextStatement() {
   while (peek().has_value()) {
     if (peek().value().type == TokenType::EndOfFile)
       break;
-    parseLine();
+    // Past the error limit the rest of the input is not worth parsing
+    if (m_diagnostics->limitReached())
+      break;
+    // Blank and comment-only lines produce no statement
+    if (optional<ASTStatement> statement = parseLine())
+      return statement;
   }
-  return m_program;
+  return {};
 }
 
 unordered_map<string, ast::symbolDebugInfo> &Parser::getSymbolTable() {
@@ -52,62 +104,109 @@ unordered_map<string, ast::symbolDebugInfo> &Parser::getSymbolTable() {
   return m_symbolTable;
 }
 
+bool Parser::hasError() const { return m_diagnostics->hasErrors(); }
+
+void Parser::error(int line, int column, const char *message, ...) {
+  va_list args;
+  va_start(args, message);
+  if (m_lineStart.file) {
+    // Reported at the INCLUDE, naming the place in the included file
+    char text[512];
+    vsnprintf(text, sizeof(text), message, args);
+    const includes::File &file = m_includes->file(m_lineStart.file);
+    int fileLine = file.lineOf(m_lineStart.offset);
+    m_diagnostics->includedError(m_lineStart.file, fileLine, line,
+                                 "%s:%d:%d: %s", file.path.c_str(), fileLine,
+                                 column + 1, text);
+  } else {
+    m_diagnostics->report(Severity::Error, line, column, message, args);
+  }
+  va_end(args);
+  throw ParseError{};
+}
+
 // Private: Parsing Functions
-void Parser::parseLine() {
+optional<ASTStatement> Parser::parseLine() {
   Token currToken = peek().value();
+  optional<ASTStatement> statement;
+  m_lineStart = currToken;
+
+  try {
+    uint16_t include = 0;
+    if (currToken.type == TokenType::Identifier) {
+      statement.emplace(parseLabelDef());
+    } else if (isMnemonic(currToken.type)) {
+      statement.emplace(parseMnemonic());
+    } else if (isDirective(currToken.type)) {
+      statement.emplace(parseDirective());
+    } else if (currToken.type == TokenType::INCLUDE) {
+      include = parseInclude();
+    }
 
-  if (currToken.type == TokenType::Identifier) {
-    m_program->statements.emplace_back(parseLabelDef());
-  } else if (isMnemonic(currToken.type)) {
-    m_program->statements.emplace_back(parseMnemonic());
-  } else if (isDirective(currToken.type)) {
-    m_program->statements.emplace_back(parseDirective());
-  }
+    if (peek().has_value() && peek().value().type == TokenType::EndOfLine) {
+      consume();
+    } else {
+      Token extra = peek().value_or(currToken);
+      error(extra.line, extra.column,
+            "Expected the end of the line, found '%.*s'. A single line can "
+            "only have 1 instruction!",
+            (int)extra.rawText.size(), extra.rawText.data());
+    }
 
-  if (peek().has_value() && peek().value().type == TokenType::EndOfLine) {
-    consume();
-  } else {
-    Logger::fmtLog(LogLevel::Error,
-                   "Expected a EOL character on line: %d, a single line can "
-                   "only have 1 instruction!",
-                   currToken.line);
-    exit(1);
+    // The included tokens follow the INCLUDE line, as if pasted in its place
+    if (include) {
+      m_tokens.include(m_includes->file(include).tokens, include,
+                       currToken.line);
+      m_included = true;
+    }
+  } catch (const ParseError &) {
+    // Drop the rest of the line, nodes already made stay unused in the arena
+    while (peek().has_value() && peek().value().type != TokenType::EndOfLine &&
+           peek().value().type != TokenType::EndOfFile)
+      consume();
+    if (peek().has_value() && peek().value().type == TokenType::EndOfLine)
+      consume();
+    return {};
   }
+  return statement;
 }
 
 ast::Ptr<ASTLabelDef> Parser::parseLabelDef() {
-  ast::Ptr<ASTLabelDef> labelDef = std::make_unique<ASTLabelDef>();
+  ast::Ptr<ASTLabelDef> labelDef = makeNode<ASTLabelDef>();
   Token label = consume();
 
   labelDef->tokenLabel = label;
-  labelDef->labelDbgInfo = {.lineNumber = label.line, .address = 0x0000};
+  // A column in an included file means nothing on the line of the INCLUDE
+  labelDef->labelDbgInfo = {.lineNumber = label.line,
+                            .column = label.file ? -1 : label.column,
+                            .address = 0x0000};
 
   if (peek().has_value() && peek().value().type == TokenType::Colon)
     consume();
-  else {
-    Logger::fmtLog(LogLevel::Error,
-                   "Expected a ':' after label '%s', on line: %d, column = %d",
-                   label.rawText.c_str(), label.line, label.column);
-    exit(1);
-  }
+  else
+    error(label.line, label.column, "Expected a ':' after label '%.*s'",
+          (int)label.rawText.size(), label.rawText.data());
 
   if (peek().has_value() && isMnemonic(peek().value().type))
     labelDef->mnemonic = parseMnemonic();
-  else {
-    Logger::fmtLog(
-        LogLevel::Error,
-        "Expected a instruction after label '%s', on line: %d, column = %d",
-        label.rawText.c_str(), label.line, peek(-1).value().column);
-    exit(1);
-  }
+  else
+    error(label.line, peek(-1).value().column,
+          "Expected a instruction after label '%.*s'",
+          (int)label.rawText.size(), label.rawText.data());
 
   // On successful parsing, add labelDef to symbol table
-  m_symbolTable[label.rawText] = labelDef->labelDbgInfo;
+  auto [symbol, inserted] =
+      m_symbolTable.try_emplace(string(label.rawText), labelDef->labelDbgInfo);
+  if (!inserted)
+    error(label.line, label.column,
+          "Label '%.*s' was already defined on line: %d",
+          (int)label.rawText.size(), label.rawText.data(),
+          symbol->second.lineNumber);
   return labelDef;
 }
 
 ast::Ptr<ASTMnemonics> Parser::parseMnemonic() {
-  ast::Ptr<ASTMnemonics> mnemonic = std::make_unique<ASTMnemonics>();
+  ast::Ptr<ASTMnemonics> mnemonic = makeNode<ASTMnemonics>();
   Token opcode = consume();
   mnemonic->instruction = opcode.type;
   mnemonic->tokenMnemonic = opcode;
@@ -151,32 +250,32 @@ ast::Ptr<ASTMnemonics> Parser::parseMnemonic() {
   case ast::InstuctionType::RST: {
     mnemonic->operandList = parseOpList({ast::OperandType::ImmData});
     uint8_t val = getImmValue();
-    if (val < 0 || val > 7) {
+    if (val > 7) {
       auto &token = mnemonic->tokenMnemonic;
-      Logger::fmtLog(LogLevel::Error,
-                     "Invalid value: '%d' for the instruction: 'RST' on "
-                     "line: %d, column: %d",
-                     val, token.line, token.column);
-      exit(1);
+      error(token.line, token.column,
+            "Invalid value: '%d' for the instruction: 'RST'", val);
     }
   } break;
 
   // Parse 'instruction <ex_reg>' ,
   // i.e, register pair + SP register (but not psw)
+  // LXI also takes the 16-bit value to load
   case ast::InstuctionType::DAD:
   case ast::InstuctionType::DCX:
   case ast::InstuctionType::INX:
   case ast::InstuctionType::LXI: {
     // Main logic of the opcode
-    mnemonic->operandList = parseOpList({ast::OperandType::exRegister});
+    if (mnemonic->instruction == ast::InstuctionType::LXI)
+      mnemonic->operandList = parseOpList(
+          {ast::OperandType::exRegister, ast::OperandType::ImmAddr});
+    else
+      mnemonic->operandList = parseOpList({ast::OperandType::exRegister});
     // Error handling for invalid operand type PSW
     if (getExRegType() == ast::ExtendedRegister::PSW) {
       auto &token = mnemonic->tokenMnemonic;
-      Logger::fmtLog(LogLevel::Error,
-                     "Invalid Operand: 'PSW' for the instruction: '%s'"
-                     " on line: %d, column: %d",
-                     token.rawText.c_str(), token.line, token.column);
-      exit(1);
+      error(token.line, token.column,
+            "Invalid Operand: 'PSW' for the instruction: '%.*s'",
+            (int)token.rawText.size(), token.rawText.data());
     }
   } break;
 
@@ -188,12 +287,9 @@ ast::Ptr<ASTMnemonics> Parser::parseMnemonic() {
 
     if (type != ast::ExtendedRegister::B && type != ast::ExtendedRegister::D) {
       auto &token = mnemonic->tokenMnemonic;
-      Logger::fmtLog(LogLevel::Error,
-                     "Expected Register Pair: 'B' OR 'D' for the instruction: "
-                     "'%s' on line: "
-                     "%d, column: %d",
-                     token.rawText.c_str(), token.line, token.column);
-      exit(1);
+      error(token.line, token.column,
+            "Expected Register Pair: 'B' OR 'D' for the instruction: '%.*s'",
+            (int)token.rawText.size(), token.rawText.data());
     }
   } break;
   case ast::InstuctionType::POP:
@@ -203,11 +299,9 @@ ast::Ptr<ASTMnemonics> Parser::parseMnemonic() {
 
     if (type == ast::ExtendedRegister::SP) {
       auto &token = mnemonic->tokenMnemonic;
-      Logger::fmtLog(LogLevel::Error,
-                     "Invalid Operand: 'SP' for the instruction: '%s' on line: "
-                     "%d, column: %d",
-                     token.rawText.c_str(), token.line, token.column);
-      exit(1);
+      error(token.line, token.column,
+            "Invalid Operand: 'SP' for the instruction: '%.*s'",
+            (int)token.rawText.size(), token.rawText.data());
     }
   } break;
 
@@ -252,6 +346,15 @@ ast::Ptr<ASTMnemonics> Parser::parseMnemonic() {
     // MOV r, r | MOV M, r
     mnemonic->operandList =
         parseOpList({ast::OperandType::_Register, ast::OperandType::_Register});
+    // MOV M, M would encode as HLT
+    if (std::get<ast::Ptr<ASTRegister>>(mnemonic->operandList->first->val)
+                ->reg == ast::Register::M &&
+        std::get<ast::Ptr<ASTRegister>>(mnemonic->operandList->second->val)
+                ->reg == ast::Register::M) {
+      auto &token = mnemonic->tokenMnemonic;
+      error(token.line, token.column,
+            "Invalid Operands: 'M, M' for the instruction: 'MOV'");
+    }
     break;
   case ast::InstuctionType::MVI:
     mnemonic->operandList =
@@ -259,7 +362,7 @@ ast::Ptr<ASTMnemonics> Parser::parseMnemonic() {
     break;
   default:
     // No instructions with no operand, don't need to be processed here
-    mnemonic->operandList.reset();
+    mnemonic->operandList = nullptr;
     break;
   }
 
@@ -267,48 +370,89 @@ ast::Ptr<ASTMnemonics> Parser::parseMnemonic() {
 }
 
 ast::Ptr<ASTDirective> Parser::parseDirective() {
-  ast::Ptr<ASTDirective> directive = std::make_unique<ASTDirective>();
+  ast::Ptr<ASTDirective> directive = makeNode<ASTDirective>();
   Token token = consume();
   directive->tokenDirective = token;
 
   if (token.type == TokenType::ORG) {
     directive->type = ast::DirectiveType::ORG;
-    ast::Ptr<ASTImmAddr> addr = std::make_unique<ASTImmAddr>();
+    ast::Ptr<ASTImmAddr> addr = makeNode<ASTImmAddr>();
 
     if (peek().has_value() && peek().value().type == TokenType::Number) {
       addr->tokenAddr = peek().value();
       addr->value = parseNumber<uint16_t>();
     } else {
-      Logger::fmtLog(LogLevel::Error,
-                     "Expected a address after '%s' on line: %d, column: %d",
-                     token.rawText.c_str(), token.line, token.column);
-      exit(1);
+      error(token.line, token.column, "Expected a address after '%.*s'",
+            (int)token.rawText.size(), token.rawText.data());
     }
 
     directive->param = move(addr);
   } else if (token.type == TokenType::DB) {
     directive->type = ast::DirectiveType::DB;
-    ast::Ptr<ASTImmData> data = std::make_unique<ASTImmData>();
+    ast::Ptr<ASTImmData> data = makeNode<ASTImmData>();
 
     if (peek().has_value() && peek().value().type == TokenType::Number) {
       data->tokenData = peek().value();
       data->value = parseNumber<uint8_t>();
     } else {
-      Logger::fmtLog(LogLevel::Error,
-                     "Expected number after '%s' on line: %d, column: %d",
-                     token.rawText.c_str(), token.line, token.column);
-      exit(1);
+      error(token.line, token.column, "Expected number after '%.*s'",
+            (int)token.rawText.size(), token.rawText.data());
     }
 
     directive->param = move(data);
+  } else if (token.type == TokenType::CYCLES) {
+    directive->type = ast::DirectiveType::CYCLES;
+    ast::Ptr<ASTImmAddr> budget = makeNode<ASTImmAddr>();
+
+    if (peek().has_value() && peek().value().type == TokenType::Number) {
+      budget->tokenAddr = peek().value();
+      budget->value = parseNumber<uint16_t>();
+    } else {
+      error(token.line, token.column, "Expected a T-state budget after '%.*s'",
+            (int)token.rawText.size(), token.rawText.data());
+    }
+
+    directive->param = move(budget);
+  } else if (token.type == TokenType::ENDCYC) {
+    // Closes the innermost CYCLES region, takes no operand
+    directive->type = ast::DirectiveType::ENDCYC;
+    directive->param = ast::Ptr<ASTImmData>();
   }
 
   return directive;
 }
 
+uint16_t Parser::parseInclude() {
+  Token token = consume();
+  if (!peek().has_value() || peek().value().type != TokenType::String)
+    error(token.line, token.column, "Expected a \"file\" after '%.*s'",
+          (int)token.rawText.size(), token.rawText.data());
+  Token name = consume();
+  if (!m_includes)
+    error(token.line, token.column, "INCLUDE is not available here");
+
+  string message;
+  string_view path = name.rawText.substr(1, name.rawText.size() - 2);
+  uint16_t id = m_includes->open(path, token.file, message);
+  if (!id)
+    error(name.line, name.column, "%s", message.c_str());
+  if (m_tokens.including(id))
+    error(name.line, name.column, "'%.*s' includes itself",
+          (int)path.size(), path.data());
+
+  // What the lexer found in the file is reported at every INCLUDE of it
+  const includes::File &file = m_includes->file(id);
+  for (const Diagnostic &diagnostic : file.diagnostics.all())
+    m_diagnostics->includedError(id, diagnostic.line, token.line,
+                                 "%s:%d:%d: %s", file.path.c_str(),
+                                 diagnostic.line, diagnostic.column + 1,
+                                 diagnostic.message.c_str());
+  return id;
+}
+
 ast::Ptr<ASTOperandList>
 Parser::parseOpList(const vector<ast::OperandType> &expectTypes) {
-  ast::Ptr<ASTOperandList> operandList = std::make_unique<ASTOperandList>();
+  ast::Ptr<ASTOperandList> operandList = makeNode<ASTOperandList>();
 
   int size = expectTypes.size();
   // size is always >= 1
@@ -318,12 +462,10 @@ Parser::parseOpList(const vector<ast::OperandType> &expectTypes) {
   if (peek().has_value())
     operandList->first = parseOperand(expectTypes[0]);
   else {
-    Logger::fmtLog(
-        LogLevel::Error,
-        "Expected a first operand, instead found '%s' at line: %d, column: %d",
-        peek(-1).value().rawText.c_str(), peek(-1).value().line,
-        peek(-1).value().column);
-    exit(1);
+    Token prev = peek(-1).value();
+    error(prev.line, prev.column,
+          "Expected a first operand, instead found '%.*s'",
+          (int)prev.rawText.size(), prev.rawText.data());
   }
 
   if (size == 1)
@@ -333,23 +475,19 @@ Parser::parseOpList(const vector<ast::OperandType> &expectTypes) {
   if (peek().has_value() && peek().value().type == TokenType::Comma)
     consume();
   else {
-    Logger::fmtLog(LogLevel::Error,
-                   "Expected a comma ',' after '%s' at line: %d, column: %d",
-                   peek(-1).value().rawText.c_str(), peek(-1).value().line,
-                   peek(-1).value().column);
-    exit(1);
+    Token prev = peek(-1).value();
+    error(prev.line, prev.column, "Expected a comma ',' after '%.*s'",
+          (int)prev.rawText.size(), prev.rawText.data());
   }
 
   // else parse second operand
   if (peek().has_value())
     operandList->second = parseOperand(expectTypes[1]);
   else {
-    Logger::fmtLog(LogLevel::Error,
-                   "Expected a second operand, instead found '%s' at line: "
-                   "%d, column: %d",
-                   peek(-1).value().rawText.c_str(), peek(-1).value().line,
-                   peek(-1).value().column);
-    exit(1);
+    Token prev = peek(-1).value();
+    error(prev.line, prev.column,
+          "Expected a second operand, instead found '%.*s'",
+          (int)prev.rawText.size(), prev.rawText.data());
   }
   return operandList;
 }
@@ -357,92 +495,82 @@ Parser::parseOpList(const vector<ast::OperandType> &expectTypes) {
 ast::Ptr<ASTOperand> Parser::parseOperand(const ast::OperandType &expectType) {
   // Assume the callee check if we can consume the token
   Token operandToken = peek().value();
-  ast::Ptr<ASTOperand> astOperand = std::make_unique<ASTOperand>();
+  ast::Ptr<ASTOperand> astOperand = makeNode<ASTOperand>();
 
   switch (expectType) {
   case ast::OperandType::ImmData:
     if (operandToken.type == TokenType::Number) {
-      ast::Ptr<ASTImmData> immData = std::make_unique<ASTImmData>();
+      ast::Ptr<ASTImmData> immData = makeNode<ASTImmData>();
       immData->tokenData = operandToken;
       immData->value = parseNumber<uint8_t>();
 
       astOperand->val = move(immData);
     } else {
-      Logger::fmtLog(
-          LogLevel::Error,
-          "Expected a number, but found '%s' on line: %d, column: %d",
-          operandToken.rawText.c_str(), operandToken.line, operandToken.column);
-      exit(1);
+      error(operandToken.line, operandToken.column,
+            "Expected a number, but found '%.*s'",
+            (int)operandToken.rawText.size(), operandToken.rawText.data());
     }
     break;
   case ast::OperandType::ImmAddr:
     if (operandToken.type == TokenType::Number) {
-      ast::Ptr<ASTImmAddr> immAddr = std::make_unique<ASTImmAddr>();
+      ast::Ptr<ASTImmAddr> immAddr = makeNode<ASTImmAddr>();
       immAddr->tokenAddr = operandToken;
       immAddr->value = parseNumber<uint16_t>();
 
       astOperand->val = move(immAddr);
     } else {
-      Logger::fmtLog(
-          LogLevel::Error,
-          "Expected a number, but found '%s' on line: %d, column: %d",
-          operandToken.rawText.c_str(), operandToken.line, operandToken.column);
-      exit(1);
+      error(operandToken.line, operandToken.column,
+            "Expected a number, but found '%.*s'",
+            (int)operandToken.rawText.size(), operandToken.rawText.data());
     }
     break;
   case ast::OperandType::_Register:
     if (operandToken.type == TokenType::Identifier &&
         identToRegister(operandToken.rawText).has_value()) {
-      ast::Ptr<ASTRegister> reg = std::make_unique<ASTRegister>();
+      ast::Ptr<ASTRegister> reg = makeNode<ASTRegister>();
       reg->tokenRegister = operandToken;
       reg->reg = identToRegister(operandToken.rawText).value();
       consume(); // Manually consume this token
 
       astOperand->val = move(reg);
     } else {
-      Logger::fmtLog(
-          LogLevel::Error,
-          "Expected a register, but found '%s' on line: %d, column: %d",
-          operandToken.rawText.c_str(), operandToken.line, operandToken.column);
-      exit(1);
+      error(operandToken.line, operandToken.column,
+            "Expected a register, but found '%.*s'",
+            (int)operandToken.rawText.size(), operandToken.rawText.data());
     }
     break;
   case ast::OperandType::exRegister:
     if (operandToken.type == TokenType::Identifier &&
         identToSpRegister(operandToken.rawText).has_value()) {
-      ast::Ptr<ASTExtendedRegister> spReg =
-          std::make_unique<ASTExtendedRegister>();
+      ast::Ptr<ASTExtendedRegister> spReg = makeNode<ASTExtendedRegister>();
       spReg->tokenSpRegister = operandToken;
       spReg->exReg = identToSpRegister(operandToken.rawText).value();
       consume(); // Manually consume this token
 
       astOperand->val = move(spReg);
     } else {
-      Logger::fmtLog(
-          LogLevel::Error,
-          "Expected a register, but found '%s' on line: %d, column: %d",
-          operandToken.rawText.c_str(), operandToken.line, operandToken.column);
-      exit(1);
+      error(operandToken.line, operandToken.column,
+            "Expected a register, but found '%.*s'",
+            (int)operandToken.rawText.size(), operandToken.rawText.data());
     }
     break;
   case ast::OperandType::LabelRef:
     // TODO: Verify the Label isn't part of recognized words
     if (peek().has_value() && peek().value().type == TokenType::Identifier) {
-      ast::Ptr<ASTLabelRef> labelRef = std::make_unique<ASTLabelRef>();
+      ast::Ptr<ASTLabelRef> labelRef = makeNode<ASTLabelRef>();
       labelRef->label = operandToken;
       consume(); // Manually consume this token
 
       astOperand->val = move(labelRef);
     } else {
-      Logger::fmtLog(LogLevel::Error,
-                     "Expected a label, but found '%s' on line: %d, column: %d",
-                     operandToken);
-      exit(1);
+      error(operandToken.line, operandToken.column,
+            "Expected a label, but found '%.*s'",
+            (int)operandToken.rawText.size(), operandToken.rawText.data());
     }
     break;
   default:
-    Logger::fmtLog(LogLevel::Error, "Unexpected operand type found!");
-    exit(1);
+    error(operandToken.line, operandToken.column,
+          "Unexpected operand type found!");
     break;
   }
 
@@ -450,43 +578,29 @@ ast::Ptr<ASTOperand> Parser::parseOperand(const ast::OperandType &expectType) {
 }
 
 template <typename T> T Parser::parseNumber() {
-  Token &numToken = consume();
-  string &num = numToken.rawText;
+  Token numToken = consume();
+  string_view num = numToken.rawText;
 
   int numBits = sizeof(T) * 8;
-  unsigned int maxValue = pow(2, numBits) - 1;
+  unsigned int maxValue = numeric_limits<T>::max();
 
+  // Address in hex format when suffixed with 'H', base 10 otherwise
+  int base = 10;
   if (toupper(num.back()) == 'H') {
-    // Address in hex format
-    num.pop_back();
-    unsigned int value = stoi(num, nullptr, 16);
-    if (value > maxValue) {
-      Logger::fmtLog(LogLevel::Error,
-                     "Invalid number '%s' at line %d, column %d: value must "
-                     "fit within %d-bit range (0%d).",
-                     num, numToken.line, numToken.column, numBits, maxValue);
-      exit(1);
-    }
-    return (T)value;
-  }
-  // Base 10
-  unsigned value = stoi(num, nullptr, 10);
-
-  if (value > maxValue) {
-    Logger::fmtLog(LogLevel::Error,
-                   "Invalid number '%s' at line %d, column %d: value must fit "
-                   "within %d-bit range (0%d).",
-                   num, numToken.line, numToken.column, numBits, maxValue);
-    exit(1);
+    num.remove_suffix(1);
+    base = 16;
   }
+
+  unsigned int value = 0;
+  auto [end, ec] = from_chars(num.data(), num.data() + num.size(), value, base);
+  if (ec != errc() || end != num.data() + num.size() || value > maxValue)
+    error(numToken.line, numToken.column,
+          "Invalid number '%.*s': value must fit within %d-bit range (0-%u).",
+          (int)numToken.rawText.size(), numToken.rawText.data(), numBits,
+          maxValue);
   return (T)value;
 }
 
-optional<Token> Parser::peek(int next) {
-  // Defaults next = 0
-  if (m_currentTokenIndex + next < m_tokens.size())
-    return m_tokens[m_currentTokenIndex + next];
-  return {};
-}
+optional<Token> Parser::peek(int next) { return m_tokens.peek(next); }
 
-Token &Parser::consume() { return m_tokens[m_currentTokenIndex++]; }
\ No newline at end of file
+Token Parser::consume() { return m_tokens.consume(); }
\ No newline at end of file
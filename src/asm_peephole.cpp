@@ -0,0 +1,345 @@
+#include <Logger.h>
+#include <asm_cfg.h>
+#include <asm_codegen.h>
+#include <asm_peephole.h>
+#include <asm_timing.h>
+#include <iterator>
+
+namespace peephole {
+
+using ir::OperandKind;
+
+// Register fields, see ir::OperandKind::Reg
+constexpr uint32_t regH = 4;
+constexpr uint32_t regL = 5;
+constexpr uint32_t regM = 6;
+constexpr uint32_t regA = 7;
+// Register pair field of PUSH PSW and POP PSW
+constexpr uint32_t pairPsw = 3;
+
+// PSW flag bits
+constexpr uint8_t flagS = 0x80;
+constexpr uint8_t flagZ = 0x40;
+constexpr uint8_t flagAC = 0x10;
+constexpr uint8_t flagP = 0x04;
+constexpr uint8_t flagCY = 0x01;
+constexpr uint8_t allFlags = flagS | flagZ | flagAC | flagP | flagCY;
+
+struct FlagUse {
+  uint8_t reads;
+  uint8_t writes;
+};
+
+// Flags read and written by instructions that do not branch
+static FlagUse flagUse(TokenType op) {
+  switch (op) {
+  case TokenType::ADD:
+  case TokenType::ADI:
+  case TokenType::SUB:
+  case TokenType::SUI:
+  case TokenType::ANA:
+  case TokenType::ANI:
+  case TokenType::XRA:
+  case TokenType::XRI:
+  case TokenType::ORA:
+  case TokenType::ORI:
+  case TokenType::CMP:
+  case TokenType::CPI:
+    return {0, allFlags};
+  case TokenType::ADC:
+  case TokenType::ACI:
+  case TokenType::SBB:
+  case TokenType::SBI:
+    return {flagCY, allFlags};
+  case TokenType::DAA:
+    return {flagCY | flagAC, allFlags};
+  case TokenType::INR:
+  case TokenType::DCR:
+    return {0, flagS | flagZ | flagAC | flagP};
+  case TokenType::DAD:
+  case TokenType::RLC:
+  case TokenType::RRC:
+  case TokenType::STC:
+    return {0, flagCY};
+  case TokenType::RAL:
+  case TokenType::RAR:
+  case TokenType::CMC:
+    return {flagCY, flagCY};
+  default:
+    return {0, 0};
+  }
+}
+
+// Jumps, calls, returns, RST, PCHL and HLT
+static bool transfersControl(TokenType op) {
+  return (op >= TokenType::JMP && op <= TokenType::PCHL) ||
+         op == TokenType::HLT;
+}
+
+// The rows a rule looks at and changes. Rows are only flagged as removed
+// while the rules run and dropped from the program at the end.
+class Window {
+public:
+  static constexpr size_t none = SIZE_MAX;
+
+  Window(ir::Program &code, Report &report)
+      : code(code), removed(code.size(), false), m_report(report) {}
+
+  ir::Program &code;
+  vector<bool> removed;
+
+  TokenType op(size_t row) const { return code.opcode[row]; }
+  uint32_t operand(size_t row, int slot) const {
+    return code.operand(row, slot);
+  }
+
+  // The row executed after row if it belongs to the same window, none when
+  // the program ends or the row defines a label or is a directive (it moves
+  // the address, holds data or bounds a CYCLES region)
+  size_t next(size_t row) const {
+    do
+      ++row;
+    while (row < code.size() && removed[row]);
+    if (row == code.size() || code.labelDef[row] != ir::noSymbol ||
+        code.opcode[row] >= TokenType::ORG)
+      return none;
+    return row;
+  }
+
+  // A labeled row can only go if its label can move on to the next row
+  bool canErase(size_t row) const {
+    return code.labelDef[row] == ir::noSymbol || next(row) != none;
+  }
+
+  // Flags are dead after row if the rows that follow in the window overwrite
+  // each of them before anything reads it or control leaves the window
+  bool flagsDead(size_t row) const {
+    uint8_t pending = allFlags;
+    for (size_t at = next(row); at != none; at = next(at)) {
+      TokenType type = op(at);
+      if (transfersControl(type))
+        return false;
+      if (code.kind(at, 0) == OperandKind::RegPair &&
+          operand(at, 0) == pairPsw) {
+        if (type == TokenType::PUSH)
+          return false;
+        if (type == TokenType::POP)
+          return true;
+      }
+      FlagUse use = flagUse(type);
+      if (use.reads & pending)
+        return false;
+      pending &= ~use.writes;
+      if (!pending)
+        return true;
+    }
+    return false;
+  }
+
+  void erase(size_t row) {
+    credit(row, -1);
+    if (uint32_t label = code.labelDef[row]; label != ir::noSymbol) {
+      code.labelDef[next(row)] = label;
+      code.labelDef[row] = ir::noSymbol;
+    }
+    removed[row] = true;
+  }
+
+  // Replaces the instruction of row, keeping its operands unless given
+  void replace(size_t row, TokenType type) {
+    credit(row, -1);
+    code.opcode[row] = type;
+    credit(row, +1);
+  }
+  void replace(size_t row, TokenType type, OperandKind kind, uint32_t value) {
+    credit(row, -1);
+    code.opcode[row] = type;
+    code.operandKinds[row] = 0;
+    code.operands[row] = 0;
+    code.setOperand(row, 0, kind, value);
+    credit(row, +1);
+  }
+
+  void setRule(size_t rule) { m_rule = rule; }
+
+private:
+  // Books the size and time of row as saved (sign -1) or spent again (+1)
+  void credit(size_t row, int sign) {
+    RuleStats &stats = m_report.rules[m_rule];
+    uint8_t size = codegen::opcodeInfo(code.opcode[row]).size;
+    uint8_t time = timing::tStates[codegen::opcodeByte(code, row)];
+    stats.bytes -= sign * size;
+    stats.tStates -= sign * time;
+  }
+
+  Report &m_report;
+  size_t m_rule = 0;
+};
+
+// MOV r, r copies a register onto itself
+static bool movSelf(Window &w, size_t row) {
+  if (w.op(row) != TokenType::MOV || w.operand(row, 0) != w.operand(row, 1) ||
+      w.operand(row, 0) == regM || !w.canErase(row))
+    return false;
+  w.erase(row);
+  return true;
+}
+
+// MOV x, y then MOV y, x: the second copies back what is already there
+static bool movBack(Window &w, size_t row) {
+  if (w.op(row) != TokenType::MOV)
+    return false;
+  size_t second = w.next(row);
+  if (second == Window::none || w.op(second) != TokenType::MOV)
+    return false;
+  uint32_t x = w.operand(row, 0), y = w.operand(row, 1);
+  if (x == regM || y == regM || w.operand(second, 0) != y ||
+      w.operand(second, 1) != x)
+    return false;
+  w.erase(second);
+  return true;
+}
+
+// MOV x, y or MVI x, n then MOV x, z or MVI x, m: the first value of x is
+// never read. MOV H, M and MOV L, M read it as half of the address, and a
+// first MOV x, M stays for its read of memory.
+static bool movDead(Window &w, size_t row) {
+  if (w.op(row) != TokenType::MOV && w.op(row) != TokenType::MVI)
+    return false;
+  if (w.op(row) == TokenType::MOV && w.operand(row, 1) == regM)
+    return false;
+  uint32_t x = w.operand(row, 0);
+  size_t second = w.next(row);
+  if (x == regM || second == Window::none || w.operand(second, 0) != x)
+    return false;
+  if (w.op(second) == TokenType::MOV) {
+    uint32_t z = w.operand(second, 1);
+    if (z == x || (z == regM && (x == regH || x == regL)))
+      return false;
+  } else if (w.op(second) != TokenType::MVI) {
+    return false;
+  }
+  if (!w.canErase(row))
+    return false;
+  w.erase(row);
+  return true;
+}
+
+// MVI A, 0 is XRA A, a byte and 3 T-states shorter, when nothing reads the
+// flags XRA sets
+static bool zeroA(Window &w, size_t row) {
+  if (w.op(row) != TokenType::MVI || w.operand(row, 0) != regA ||
+      w.operand(row, 1) != 0 || !w.flagsDead(row))
+    return false;
+  w.replace(row, TokenType::XRA, OperandKind::Reg, regA);
+  return true;
+}
+
+// PUSH rp then POP rp leaves every register as it was
+static bool pushPop(Window &w, size_t row) {
+  if (w.op(row) != TokenType::PUSH || w.code.labelDef[row] != ir::noSymbol)
+    return false;
+  size_t second = w.next(row);
+  if (second == Window::none || w.op(second) != TokenType::POP ||
+      w.operand(second, 0) != w.operand(row, 0))
+    return false;
+  w.erase(row);
+  w.erase(second);
+  return true;
+}
+
+// CALL x then RET: x returns straight to our caller
+static bool tailCall(Window &w, size_t row) {
+  if (w.op(row) != TokenType::CALL)
+    return false;
+  size_t second = w.next(row);
+  if (second == Window::none || w.op(second) != TokenType::RET)
+    return false;
+  w.replace(row, TokenType::JMP);
+  w.erase(second);
+  return true;
+}
+
+struct Rule {
+  const char *name;
+  bool (*apply)(Window &window, size_t row);
+};
+
+static constexpr Rule rules[] = {
+    {"mov-self", movSelf},  {"mov-back", movBack}, {"mov-dead", movDead},
+    {"zero-a", zeroA},      {"push-pop", pushPop}, {"tail-call", tailCall},
+};
+// Reported after the window rules
+static constexpr const char *passNames[] = {"jump-thread", "unreachable"};
+constexpr size_t jumpThreadRule = size(rules);
+constexpr size_t unreachableRule = size(rules) + 1;
+static_assert(size(rules) + size(passNames) == ruleCount,
+              "ruleCount must match the rules and passes");
+
+const char *ruleName(size_t rule) {
+  return rule < size(rules) ? rules[rule].name : passNames[rule - size(rules)];
+}
+
+RuleStats Report::total() const {
+  RuleStats sum;
+  for (const RuleStats &stats : rules) {
+    sum.rewrites += stats.rewrites;
+    sum.bytes += stats.bytes;
+    sum.tStates += stats.tStates;
+  }
+  return sum;
+}
+
+void Report::print(const string &fileName) const {
+  if (!enabled)
+    return;
+  RuleStats sum = total();
+  Logger::fmtLog(LogLevel::Info,
+                 "%s: -O saved %u bytes and %llu T-states in %u rewrites",
+                 fileName.c_str(), sum.bytes,
+                 static_cast<unsigned long long>(sum.tStates), sum.rewrites);
+  for (size_t rule = 0; rule < ruleCount; ++rule) {
+    const RuleStats &stats = rules[rule];
+    if (stats.rewrites)
+      Logger::fmtLog(LogLevel::Info, "  %-10s %6u rewrites %6u bytes %8llu "
+                     "T-states",
+                     ruleName(rule), stats.rewrites, stats.bytes,
+                     static_cast<unsigned long long>(stats.tStates));
+  }
+}
+
+Report optimize(ir::Program &program, bool exported) {
+  Report report;
+  report.enabled = true;
+  Window window(program, report);
+
+  // A rewrite can let an earlier row match, so sweep until nothing changes.
+  // Every rewrite makes the code smaller or faster, which ends the loop.
+  bool changed;
+  do {
+    changed = false;
+    for (size_t row = 0; row < program.size(); ++row) {
+      bool matched = true;
+      while (matched && !window.removed[row]) {
+        matched = false;
+        for (size_t rule = 0; rule < size(rules) && !matched; ++rule) {
+          window.setRule(rule);
+          if (rules[rule].apply(window, row)) {
+            ++report.rules[rule].rewrites;
+            matched = changed = true;
+          }
+        }
+      }
+    }
+  } while (changed);
+
+  program.removeRows(window.removed);
+
+  // Tail calls have become jumps that may now be threaded, and threading
+  // leaves jumps behind that nothing reaches any more
+  cfg::threadJumps(program, report.rules[jumpThreadRule]);
+  cfg::removeUnreachable(program, report.rules[unreachableRule], exported);
+  return report;
+}
+
+} // namespace peephole
@@ -0,0 +1,166 @@
+#include <asm_scan.h>
+#include <bit>
+
+#if !defined(C85_NO_SIMD) && defined(__AVX2__)
+#define C85_SCAN_AVX2
+#include <immintrin.h>
+#elif !defined(C85_NO_SIMD) &&                                                 \
+    (defined(__SSE2__) || defined(_M_X64) ||                                   \
+     (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define C85_SCAN_SSE2
+#include <emmintrin.h>
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace scan {
+
+// Scalar fallbacks, also used for the tail shorter than one vector
+static size_t skipClass(const char *src, size_t pos, size_t end,
+                        uint8_t cls) {
+  while (pos < end && (classOf(src[pos]) & cls))
+    ++pos;
+  return pos;
+}
+
+static size_t findByte(const char *src, size_t pos, size_t end, char c) {
+  while (pos < end && src[pos] != c)
+    ++pos;
+  return pos;
+}
+
+static size_t countByte(const char *src, size_t pos, size_t end, char c) {
+  size_t count = 0;
+  for (; pos < end; ++pos)
+    count += src[pos] == c;
+  return count;
+}
+
+#if defined(C85_SCAN_AVX2) || defined(C85_SCAN_SSE2)
+static inline unsigned firstSetBit(uint32_t mask) {
+#ifdef _MSC_VER
+  unsigned long index;
+  _BitScanForward(&index, mask);
+  return static_cast<unsigned>(index);
+#else
+  return static_cast<unsigned>(__builtin_ctz(mask));
+#endif
+}
+
+#ifdef C85_SCAN_AVX2
+struct Vec {
+  using Reg = __m256i;
+  static constexpr size_t width = 32;
+  static Reg load(const char *p) {
+    return _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+  }
+  static Reg splat(char c) { return _mm256_set1_epi8(c); }
+  static Reg eq(Reg a, Reg b) { return _mm256_cmpeq_epi8(a, b); }
+  static Reg sub(Reg a, Reg b) { return _mm256_sub_epi8(a, b); }
+  static Reg min(Reg a, Reg b) { return _mm256_min_epu8(a, b); }
+  static Reg bitOr(Reg a, Reg b) { return _mm256_or_si256(a, b); }
+  static Reg andNot(Reg a, Reg b) { return _mm256_andnot_si256(a, b); }
+  static uint32_t mask(Reg a) {
+    return static_cast<uint32_t>(_mm256_movemask_epi8(a));
+  }
+  static constexpr uint32_t fullMask = 0xFFFFFFFFu;
+};
+#else
+struct Vec {
+  using Reg = __m128i;
+  static constexpr size_t width = 16;
+  static Reg load(const char *p) {
+    return _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+  }
+  static Reg splat(char c) { return _mm_set1_epi8(c); }
+  static Reg eq(Reg a, Reg b) { return _mm_cmpeq_epi8(a, b); }
+  static Reg sub(Reg a, Reg b) { return _mm_sub_epi8(a, b); }
+  static Reg min(Reg a, Reg b) { return _mm_min_epu8(a, b); }
+  static Reg bitOr(Reg a, Reg b) { return _mm_or_si128(a, b); }
+  static Reg andNot(Reg a, Reg b) { return _mm_andnot_si128(a, b); }
+  static uint32_t mask(Reg a) {
+    return static_cast<uint32_t>(_mm_movemask_epi8(a));
+  }
+  static constexpr uint32_t fullMask = 0xFFFFu;
+};
+#endif
+
+// Lanes where lo <= byte <= lo + span, using an unsigned min trick since
+// SSE2 only has signed byte compares
+static inline Vec::Reg inRange(Vec::Reg v, char lo, char span) {
+  Vec::Reg shifted = Vec::sub(v, Vec::splat(lo));
+  return Vec::eq(Vec::min(shifted, Vec::splat(span)), shifted);
+}
+
+size_t skipSpaces(const char *src, size_t pos, size_t end) {
+  const Vec::Reg space = Vec::splat(' ');
+  const Vec::Reg newline = Vec::splat('\n');
+  for (; pos + Vec::width <= end; pos += Vec::width) {
+    Vec::Reg v = Vec::load(src + pos);
+    // '\t' .. '\r' minus '\n', plus ' '
+    Vec::Reg blank = Vec::bitOr(
+        Vec::andNot(Vec::eq(v, newline), inRange(v, '\t', '\r' - '\t')),
+        Vec::eq(v, space));
+    uint32_t stop = ~Vec::mask(blank) & Vec::fullMask;
+    if (stop)
+      return pos + firstSetBit(stop);
+  }
+  return skipClass(src, pos, end, Space);
+}
+
+size_t findNewline(const char *src, size_t pos, size_t end) {
+  const Vec::Reg newline = Vec::splat('\n');
+  for (; pos + Vec::width <= end; pos += Vec::width) {
+    uint32_t hit = Vec::mask(Vec::eq(Vec::load(src + pos), newline));
+    if (hit)
+      return pos + firstSetBit(hit);
+  }
+  return findByte(src, pos, end, '\n');
+}
+
+size_t skipIdentifier(const char *src, size_t pos, size_t end) {
+  const Vec::Reg caseBit = Vec::splat(0x20);
+  const Vec::Reg underscore = Vec::splat('_');
+  for (; pos + Vec::width <= end; pos += Vec::width) {
+    Vec::Reg v = Vec::load(src + pos);
+    // Setting bit 5 folds 'A'..'Z' onto 'a'..'z' and nothing else onto it
+    Vec::Reg letter = inRange(Vec::bitOr(v, caseBit), 'a', 'z' - 'a');
+    Vec::Reg tail = Vec::bitOr(letter, Vec::eq(v, underscore));
+    uint32_t stop = ~Vec::mask(tail) & Vec::fullMask;
+    if (stop)
+      return pos + firstSetBit(stop);
+  }
+  return skipClass(src, pos, end, IdentTail);
+}
+
+size_t countNewlines(const char *src, size_t pos, size_t end) {
+  const Vec::Reg newline = Vec::splat('\n');
+  size_t count = 0;
+  for (; pos + Vec::width <= end; pos += Vec::width)
+    count += std::popcount(Vec::mask(Vec::eq(Vec::load(src + pos), newline)));
+  return count + countByte(src, pos, end, '\n');
+}
+
+#else
+
+size_t skipSpaces(const char *src, size_t pos, size_t end) {
+  return skipClass(src, pos, end, Space);
+}
+
+size_t findNewline(const char *src, size_t pos, size_t end) {
+  return findByte(src, pos, end, '\n');
+}
+
+size_t skipIdentifier(const char *src, size_t pos, size_t end) {
+  return skipClass(src, pos, end, IdentTail);
+}
+
+size_t countNewlines(const char *src, size_t pos, size_t end) {
+  return countByte(src, pos, end, '\n');
+}
+
+#endif
+
+} // namespace scan
@@ -0,0 +1,400 @@
+#include <ByteStream.h>
+#include <Logger.h>
+#include <asm_server.h>
+#include <cstdlib>
+#include <cstring>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <condition_variable>
+#include <csignal>
+#include <mutex>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+#endif
+
+// Bumped whenever the layout of a message changes
+static constexpr uint32_t protocolVersion = 9;
+
+#ifdef _WIN32
+
+string defaultSocketPath() { return {}; }
+
+int runServer(const string &) {
+  Logger::fmtLog(LogLevel::Error, "The compile server needs Unix sockets, "
+                                  "it is not available on Windows");
+  return 1;
+}
+
+optional<CompileResult> compileRemote(const string &, const string &,
+                                      const string &, const CompileOptions &) {
+  return {};
+}
+
+#else
+
+// Messages larger than this are refused. A reply that would be larger only
+// costs the fallback to an in-process compilation.
+static constexpr uint32_t maxMessageSize = 256u << 20;
+
+// Directory of the default socket: the user's runtime directory, or one of
+// our own in the temp directory
+static string socketDirectory() {
+  if (const char *dir = getenv("XDG_RUNTIME_DIR"); dir && *dir)
+    return dir;
+  const char *dir = getenv("TMPDIR");
+  return string(dir && *dir ? dir : "/tmp") + "/c85-" + to_string(getuid());
+}
+
+// True if dir is a directory, not a link, that we own and nobody else can
+// enter, so no one else can have put a socket there
+static bool isPrivateDirectory(const string &dir) {
+  struct stat info;
+  return ::lstat(dir.c_str(), &info) == 0 && S_ISDIR(info.st_mode) &&
+         info.st_uid == getuid() && (info.st_mode & 077) == 0;
+}
+
+static bool usesDefaultSocket() {
+  const char *path = getenv("C85_SOCKET");
+  return !path || !*path;
+}
+
+string defaultSocketPath() {
+  if (!usesDefaultSocket())
+    return getenv("C85_SOCKET");
+  return socketDirectory() + "/c85.sock";
+}
+
+// True if the process at the other end of fd runs as our user
+static bool peerIsUs(int fd) {
+#ifdef SO_PEERCRED
+  ucred credentials;
+  socklen_t size = sizeof(credentials);
+  return ::getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &credentials, &size) == 0 &&
+         credentials.uid == getuid();
+#else
+  uid_t uid;
+  gid_t gid;
+  return ::getpeereid(fd, &uid, &gid) == 0 && uid == getuid();
+#endif
+}
+
+static bool sendAll(int fd, const void *data, size_t size) {
+  const char *p = static_cast<const char *>(data);
+  while (size) {
+#ifdef MSG_NOSIGNAL
+    ssize_t n = ::send(fd, p, size, MSG_NOSIGNAL);
+#else
+    ssize_t n = ::send(fd, p, size, 0);
+#endif
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return false;
+    p += n;
+    size -= static_cast<size_t>(n);
+  }
+  return true;
+}
+
+static bool receiveAll(int fd, void *data, size_t size) {
+  char *p = static_cast<char *>(data);
+  while (size) {
+    ssize_t n = ::recv(fd, p, size, 0);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return false;
+    p += n;
+    size -= static_cast<size_t>(n);
+  }
+  return true;
+}
+
+static bool sendMessage(int fd, const vector<uint8_t> &payload) {
+  uint32_t size = static_cast<uint32_t>(payload.size());
+  return sendAll(fd, &size, sizeof(size)) &&
+         sendAll(fd, payload.data(), payload.size());
+}
+
+static bool receiveMessage(int fd, vector<uint8_t> &payload) {
+  uint32_t size;
+  if (!receiveAll(fd, &size, sizeof(size)) || size > maxMessageSize)
+    return false;
+  payload.resize(size);
+  return receiveAll(fd, payload.data(), size);
+}
+
+static bool makeAddress(const string &path, sockaddr_un &address) {
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(address.sun_path))
+    return false;
+  memcpy(address.sun_path, path.c_str(), path.size() + 1);
+  return true;
+}
+
+static int connectTo(const string &path) {
+  sockaddr_un address;
+  if (!makeAddress(path, address))
+    return -1;
+  int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0)
+    return -1;
+  if (::connect(fd, reinterpret_cast<sockaddr *>(&address),
+                sizeof(address)) != 0) {
+    ::close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+static string resolvePath(string_view cwd, string_view path) {
+  if (path.empty() || path[0] == '/')
+    return string(path);
+  return string(cwd) + "/" + string(path);
+}
+
+// Workspaces stay allocated between requests, each request takes a free one
+static mutex s_workspaceLock;
+static vector<unique_ptr<CompileWorkspace>> s_idleWorkspaces;
+// Connections still being served, shutdown waits for them to finish
+static size_t s_connections = 0;
+static condition_variable s_connectionsDone;
+
+static unique_ptr<CompileWorkspace> takeWorkspace() {
+  lock_guard<mutex> guard(s_workspaceLock);
+  if (s_idleWorkspaces.empty())
+    return std::make_unique<CompileWorkspace>();
+  unique_ptr<CompileWorkspace> workspace = move(s_idleWorkspaces.back());
+  s_idleWorkspaces.pop_back();
+  return workspace;
+}
+
+static void returnWorkspace(unique_ptr<CompileWorkspace> workspace) {
+  lock_guard<mutex> guard(s_workspaceLock);
+  s_idleWorkspaces.push_back(move(workspace));
+}
+
+// Request: version, format, fill, incremental, optimize, color, error limit,
+// threads, cwd, source path, inline source (used when the path is empty),
+// output path, cache directory and size.
+// Reply: version, 1 (0 if the request was not understood), log text, result.
+static void serveConnection(int fd) {
+  vector<uint8_t> request;
+  if (!receiveMessage(fd, request)) {
+    ::close(fd);
+    return;
+  }
+
+  ByteReader in(request);
+  ByteWriter out;
+  out.u32(protocolVersion);
+  if (in.u32() != protocolVersion) {
+    out.u8(0);
+    sendMessage(fd, out.data());
+    ::close(fd);
+    return;
+  }
+
+  CompileOptions options;
+  options.format = static_cast<output::Format>(in.u8());
+  options.fill = in.u8();
+  options.incremental = in.u8() != 0;
+  options.optimize = in.u8() != 0;
+  bool color = in.u8() != 0;
+  options.errorLimit = in.u32();
+  options.threads = in.u32();
+  string_view cwd = in.text();
+  string sourceFile = resolvePath(cwd, in.text());
+  string_view inlineSource = in.text();
+  string outputFile = resolvePath(cwd, in.text());
+  options.cacheDir = resolvePath(cwd, in.text());
+  options.cacheMaxBytes = in.u64();
+  // Inline sources include relative to where the client runs
+  options.includeDir = string(cwd);
+  if (!in.ok()) {
+    ::close(fd);
+    return;
+  }
+
+  unique_ptr<CompileWorkspace> workspace = takeWorkspace();
+  // Colored the way the client's terminal wants it, not the server's
+  Logger::BeginCapture(color);
+  CompileResult result;
+  if (!sourceFile.empty())
+    result = compileFromFile(sourceFile, outputFile, options, workspace.get());
+  else if (options.incremental)
+    result = compileIncremental(inlineSource, options,
+                                outputFile + ".c85cache", workspace.get());
+  else
+    result = compileSource(inlineSource, options, workspace.get());
+  string log = Logger::EndCapture();
+  returnWorkspace(move(workspace));
+
+  out.u8(1);
+  out.text(log);
+  writeResult(out, result);
+  sendMessage(fd, out.data());
+  ::close(fd);
+}
+
+static void runConnection(int fd) {
+  // Requests name files to read and write, only our own user may send them
+  if (peerIsUs(fd))
+    serveConnection(fd);
+  else
+    ::close(fd);
+  // The thread is detached, whatever it logged outside the capture would
+  // otherwise wait in its buffer until the thread ends
+  Logger::Flush();
+  lock_guard<mutex> guard(s_workspaceLock);
+  if (--s_connections == 0)
+    s_connectionsDone.notify_all();
+}
+
+static volatile sig_atomic_t s_stop = 0;
+
+static void onSignal(int) { s_stop = 1; }
+
+int runServer(const string &socketPath) {
+  sockaddr_un address;
+  if (!makeAddress(socketPath, address)) {
+    Logger::fmtLog(LogLevel::Error, "Socket path is too long: %s",
+                   socketPath.c_str());
+    return 1;
+  }
+
+  if (socketPath == defaultSocketPath() && usesDefaultSocket()) {
+    string dir = socketDirectory();
+    ::mkdir(dir.c_str(), 0700);
+    if (!isPrivateDirectory(dir)) {
+      Logger::fmtLog(LogLevel::Error,
+                     "%s must be a directory only this user can access",
+                     dir.c_str());
+      return 1;
+    }
+  }
+
+  // A socket file nobody listens on is left over from a crashed server
+  if (int fd = connectTo(socketPath); fd >= 0) {
+    ::close(fd);
+    Logger::fmtLog(LogLevel::Error, "A server is already running on %s",
+                   socketPath.c_str());
+    return 1;
+  }
+  ::unlink(socketPath.c_str());
+
+  // The socket is created accessible to this user only, there is no window
+  // in which others could connect
+  int listener = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  mode_t mask = ::umask(077);
+  bool bound = listener >= 0 &&
+               ::bind(listener, reinterpret_cast<sockaddr *>(&address),
+                      sizeof(address)) == 0;
+  ::umask(mask);
+  if (!bound || ::listen(listener, 64) != 0) {
+    Logger::fmtLog(LogLevel::Error, "Failed to listen on %s (%s)",
+                   socketPath.c_str(), strerror(errno));
+    if (listener >= 0)
+      ::close(listener);
+    return 1;
+  }
+
+  // No SA_RESTART, so a signal also breaks out of accept()
+  struct sigaction action {};
+  action.sa_handler = onSignal;
+  sigemptyset(&action.sa_mask);
+  sigaction(SIGINT, &action, nullptr);
+  sigaction(SIGTERM, &action, nullptr);
+  signal(SIGPIPE, SIG_IGN);
+
+  Logger::fmtLog(LogLevel::Info, "c85 server listening on %s",
+                 socketPath.c_str());
+  Logger::Flush();
+  while (!s_stop) {
+    int fd = ::accept(listener, nullptr, nullptr);
+    if (fd < 0)
+      continue;
+    {
+      lock_guard<mutex> guard(s_workspaceLock);
+      ++s_connections;
+    }
+    thread(runConnection, fd).detach();
+  }
+
+  ::close(listener);
+  ::unlink(socketPath.c_str());
+
+  // Let running requests answer before the workspaces go away
+  unique_lock<mutex> lock(s_workspaceLock);
+  s_connectionsDone.wait(lock, [] { return s_connections == 0; });
+  s_idleWorkspaces.clear();
+  return 0;
+}
+
+optional<CompileResult> compileRemote(const string &socketPath,
+                                      const string &sourceFile,
+                                      const string &outputFile,
+                                      const CompileOptions &options) {
+  // Whatever answers writes our output file, it must be our own server
+  if (socketPath == defaultSocketPath() && usesDefaultSocket() &&
+      !isPrivateDirectory(socketDirectory()))
+    return {};
+  int fd = connectTo(socketPath);
+  if (fd < 0)
+    return {};
+  if (!peerIsUs(fd)) {
+    ::close(fd);
+    return {};
+  }
+
+  char cwd[4096];
+  if (!getcwd(cwd, sizeof(cwd))) {
+    ::close(fd);
+    return {};
+  }
+
+  ByteWriter request;
+  request.u32(protocolVersion);
+  request.u8(static_cast<uint8_t>(options.format));
+  request.u8(options.fill);
+  request.u8(options.incremental);
+  request.u8(options.optimize);
+  request.u8(Logger::UseColor());
+  request.u32(static_cast<uint32_t>(options.errorLimit));
+  request.u32(options.threads);
+  request.text(cwd);
+  request.text(sourceFile);
+  request.text({});
+  request.text(outputFile);
+  request.text(options.cacheDir);
+  request.u64(options.cacheMaxBytes);
+
+  vector<uint8_t> reply;
+  bool answered =
+      sendMessage(fd, request.data()) && receiveMessage(fd, reply);
+  ::close(fd);
+  if (!answered)
+    return {};
+
+  ByteReader in(reply);
+  if (in.u32() != protocolVersion)
+    return {};
+
+  // A server that could not even read the request answers with 0
+  CompileResult result;
+  if (in.u8() != 1)
+    return {};
+  string_view log = in.text();
+  if (!readResult(in, result, options.errorLimit))
+    return {};
+
+  Logger::Raw(log);
+  return result;
+}
+
+#endif // _WIN32
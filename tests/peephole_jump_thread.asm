@@ -0,0 +1,13 @@
+; c85 peephole_jump_thread.asm out.hex -O
+; jump-thread drops JMP START, which goes to the next instruction, and points
+; JZ HOP and CALL HOP straight at FINISH. No one jumps to HOP any more, so
+; unreachable drops it.
+; Expected: 0000: 3E 01 CA 09 00 CD 09 00 76 C9
+ORG 0
+JMP START
+START: MVI A, 1
+JZ HOP
+CALL HOP
+HLT
+FINISH: RET
+HOP: JMP FINISH
@@ -0,0 +1,10 @@
+; c85 peephole_mov_back.asm out.hex -O
+; mov-back drops MOV B, A, which copies back what MOV A, B copied. The pair
+; through M stays: M is memory, another address than it may seem.
+; Expected: 0000: 78 81 7E 77 76
+MOV A, B
+MOV B, A
+ADD C
+MOV A, M
+MOV M, A
+HLT
@@ -0,0 +1,16 @@
+; c85 peephole_mov_dead.asm out.hex -O
+; mov-dead drops MVI B, 01H and MVI A, 01H, both overwritten unread. MVI H and
+; MVI L stay: MOV H, M and MOV L, M read them as half of the address. MOV A, M
+; stays before MOV A, B, memory may be a device that counts the read.
+; Expected: 0000: 41 21 00 30 26 20 66 2E 05 6E 7E 78 76
+MVI B, 01H
+MOV B, C
+LXI H, 3000H
+MVI H, 20H
+MOV H, M
+MVI L, 05H
+MOV L, M
+MVI A, 01H
+MOV A, M
+MOV A, B
+HLT
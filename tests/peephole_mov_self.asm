@@ -0,0 +1,7 @@
+; c85 peephole_mov_self.asm out.hex -O
+; mov-self drops MOV B, B
+; Expected: 0000: 06 12 48 76
+MVI B, 12H
+MOV B, B
+MOV C, B
+HLT
@@ -0,0 +1,9 @@
+; c85 peephole_push_pop.asm out.hex -O
+; push-pop drops PUSH B / POP B, PUSH B / POP D copies BC to DE and stays
+; Expected: 0000: 06 01 C5 D1 76
+MVI B, 01H
+PUSH B
+POP B
+PUSH B
+POP D
+HLT
@@ -0,0 +1,12 @@
+; c85 peephole_tail_call.asm out.hex -O
+; tail-call turns the second CALL DOUBLE and the RET after it into
+; JMP DOUBLE, the first CALL is followed by another instruction and stays
+; Expected: 0000: C3 05 00 87 C9 3E 01 CD 03 00 C3 03 00
+ORG 0
+JMP MAIN
+DOUBLE: ADD A
+RET
+MAIN: MVI A, 1
+CALL DOUBLE
+CALL DOUBLE
+RET
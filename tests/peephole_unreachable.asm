@@ -0,0 +1,11 @@
+; c85 peephole_unreachable.asm out.hex -O
+; unreachable drops everything after HLT: the loop is the only path from
+; the start, and no one jumps to DONE
+; Expected: 0000: 3D C2 00 00 76
+ORG 0
+LOOP: DCR A
+JNZ LOOP
+HLT
+MVI A, 2
+INR A
+DONE: HLT
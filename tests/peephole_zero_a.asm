@@ -0,0 +1,9 @@
+; c85 peephole_zero_a.asm out.hex -O
+; zero-a turns the first MVI A, 0 into XRA A, ADD B overwrites its flags.
+; The second stays, ACI reads the carry XRA would clear.
+; Expected: 0000: AF 80 3E 00 CE 05 76
+MVI A, 0
+ADD B
+MVI A, 0
+ACI 05H
+HLT